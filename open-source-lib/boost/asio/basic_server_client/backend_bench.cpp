@@ -0,0 +1,232 @@
+// Echo server backend comparison: asio (epoll) vs io_uring.
+//
+// The server runs in-process on its own thread(s); the load comes from one
+// client io_context with `connections` sockets each doing request/reply
+// ping-pong for `seconds`. Reported per backend:
+//   - requests/sec
+//   - server syscalls per request
+//
+// For the asio backend the server thread's syscalls are counted by
+// interposing the libc wrappers asio uses (recv, send, epoll_wait, ...)
+// in this binary; client threads are not counted. fcntl and ioctl are left
+// alone: they are variadic, so a wrapper cannot forward the argument with the
+// right type for every command, and asio only uses them once per socket to
+// switch it to non-blocking mode. The io_uring backend counts its own
+// io_uring_enter calls (plus the few direct syscalls it makes).
+//
+// usage: backend_bench [connections] [seconds] [uring-threads]
+
+#include <dlfcn.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "server.h"
+#ifdef HAVE_IO_URING
+#include "uring_server.h"
+#endif
+
+namespace {
+std::atomic<std::uint64_t> g_syscalls{0};
+thread_local bool t_countSyscalls = false;
+
+template <typename Fn>
+Fn realFn(const char* name) {
+  return reinterpret_cast<Fn>(dlsym(RTLD_NEXT, name));
+}
+
+inline void countSyscall() {
+  if (t_countSyscalls) g_syscalls.fetch_add(1, std::memory_order_relaxed);
+}
+}  // namespace
+
+// libc wrappers asio's reactor and socket ops go through
+extern "C" {
+ssize_t recv(int fd, void* buf, size_t n, int flags) {
+  static auto real = realFn<ssize_t (*)(int, void*, size_t, int)>("recv");
+  countSyscall();
+  return real(fd, buf, n, flags);
+}
+ssize_t send(int fd, const void* buf, size_t n, int flags) {
+  static auto real =
+      realFn<ssize_t (*)(int, const void*, size_t, int)>("send");
+  countSyscall();
+  return real(fd, buf, n, flags);
+}
+ssize_t recvmsg(int fd, msghdr* msg, int flags) {
+  static auto real = realFn<ssize_t (*)(int, msghdr*, int)>("recvmsg");
+  countSyscall();
+  return real(fd, msg, flags);
+}
+ssize_t sendmsg(int fd, const msghdr* msg, int flags) {
+  static auto real = realFn<ssize_t (*)(int, const msghdr*, int)>("sendmsg");
+  countSyscall();
+  return real(fd, msg, flags);
+}
+int epoll_wait(int epfd, epoll_event* events, int maxevents, int timeout) {
+  static auto real =
+      realFn<int (*)(int, epoll_event*, int, int)>("epoll_wait");
+  countSyscall();
+  return real(epfd, events, maxevents, timeout);
+}
+int epoll_ctl(int epfd, int op, int fd, epoll_event* event) __THROW {
+  static auto real =
+      realFn<int (*)(int, int, int, epoll_event*)>("epoll_ctl");
+  countSyscall();
+  return real(epfd, op, fd, event);
+}
+int accept(int fd, sockaddr* addr, socklen_t* len) {
+  static auto real = realFn<int (*)(int, sockaddr*, socklen_t*)>("accept");
+  countSyscall();
+  return real(fd, addr, len);
+}
+int close(int fd) {
+  static auto real = realFn<int (*)(int)>("close");
+  countSyscall();
+  return real(fd);
+}
+ssize_t read(int fd, void* buf, size_t n) {
+  static auto real = realFn<ssize_t (*)(int, void*, size_t)>("read");
+  countSyscall();
+  return real(fd, buf, n);
+}
+ssize_t write(int fd, const void* buf, size_t n) {
+  static auto real = realFn<ssize_t (*)(int, const void*, size_t)>("write");
+  countSyscall();
+  return real(fd, buf, n);
+}
+int setsockopt(int fd, int level, int name, const void* value,
+               socklen_t len) __THROW {
+  static auto real =
+      realFn<int (*)(int, int, int, const void*, socklen_t)>("setsockopt");
+  countSyscall();
+  return real(fd, level, name, value, len);
+}
+}
+
+namespace {
+using boost::asio::ip::tcp;
+
+// One ping-pong connection: write a line, wait for the reply, repeat.
+class PingClient {
+ public:
+  PingClient(boost::asio::io_context& io, const tcp::endpoint& endpoint,
+             std::atomic<bool>& running, std::uint64_t& completed)
+      : socket_(io), running_(running), completed_(completed) {
+    socket_.connect(endpoint);
+    socket_.set_option(tcp::no_delay(true));
+  }
+
+  void start() { send(); }
+
+ private:
+  void send() {
+    boost::asio::async_write(
+        socket_, boost::asio::buffer(kRequest),
+        [this](const boost::system::error_code& error, std::size_t) {
+          if (!error) receive();
+        });
+  }
+
+  void receive() {
+    boost::asio::async_read_until(
+        socket_, boost::asio::dynamic_buffer(reply_), '\n',
+        [this](const boost::system::error_code& error, std::size_t n) {
+          if (error) return;
+          reply_.erase(0, n);
+          ++completed_;
+          if (running_) send();
+        });
+  }
+
+  static constexpr std::string_view kRequest = "ping\n";
+  tcp::socket socket_;
+  std::string reply_;
+  std::atomic<bool>& running_;
+  std::uint64_t& completed_;
+};
+
+struct Result {
+  std::uint64_t requests = 0;
+  double seconds = 0;
+};
+
+Result drive(unsigned short port, int connections, int seconds) {
+  boost::asio::io_context io;
+  std::atomic<bool> running{true};
+  std::uint64_t completed = 0;
+  const tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+  std::vector<std::unique_ptr<PingClient>> clients;
+  for (int i = 0; i < connections; ++i) {
+    clients.push_back(
+        std::make_unique<PingClient>(io, endpoint, running, completed));
+  }
+  for (auto& c : clients) c->start();
+
+  const auto start = std::chrono::steady_clock::now();
+  io.run_for(std::chrono::seconds(seconds));
+  running = false;
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  return {completed, std::chrono::duration<double>(elapsed).count()};
+}
+
+void report(const char* name, const Result& r, std::uint64_t syscalls) {
+  std::printf("%-14s %12.0f req/s %10.2f syscalls/req\n", name,
+              r.requests / r.seconds,
+              r.requests ? static_cast<double>(syscalls) / r.requests : 0.0);
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int connections = argc > 1 ? std::atoi(argv[1]) : 64;
+  const int seconds = argc > 2 ? std::atoi(argv[2]) : 3;
+  const unsigned uringThreads =
+      argc > 3 ? static_cast<unsigned>(std::atoi(argv[3])) : 1;
+  std::printf("%d connections, %ds per backend, ping-pong depth 1\n",
+              connections, seconds);
+
+  {
+    boost::asio::io_context ioContext;
+    ServerOptions options;
+    options.verbose = false;
+    Server server(ioContext, 0, options);
+    auto work = boost::asio::make_work_guard(ioContext);
+    std::thread serverThread([&ioContext] {
+      t_countSyscalls = true;
+      ioContext.run();
+    });
+    const auto before = g_syscalls.load();
+    auto r = drive(server.port(), connections, seconds);
+    const auto syscalls = g_syscalls.load() - before;
+    // run() returns once the stopped server has nothing left in flight
+    work.reset();
+    server.stop();
+    serverThread.join();
+    report("asio/epoll", r, syscalls);
+  }
+
+#ifdef HAVE_IO_URING
+  {
+    UringServerOptions options;
+    options.threads = uringThreads;
+    UringEchoServer server(0, options);
+    server.start();
+    auto r = drive(server.port(), connections, seconds);
+    server.stop();
+    report("io_uring", r, server.syscalls());
+  }
+#else
+  std::printf("io_uring backend not built (no linux/io_uring.h)\n");
+#endif
+  return 0;
+}
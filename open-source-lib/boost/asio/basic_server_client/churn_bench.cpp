@@ -0,0 +1,134 @@
+// Connection churn benchmark for the echo Server in server.h.
+//
+// A blocking client opens a connection, does a few request/reply round trips
+// and closes it, over and over. The server runs on its own thread and every
+// operator new made on that thread is counted, with and without
+// ServerOptions::pooled:
+//
+//   allocs/msg   allocations per round trip on one long-lived connection
+//   allocs/conn  allocations of the churn phase per connection, less its
+//                messages at allocs/msg each
+//
+// usage: churn_bench [connections] [messages-per-connection]
+
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+
+#include "server.h"
+
+namespace {
+std::atomic<std::size_t> g_allocs{0};
+thread_local bool t_countAllocs = false;
+}  // namespace
+
+void* operator new(std::size_t size) {
+  if (t_countAllocs) g_allocs.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+struct Result {
+  double seconds = 0;
+  double allocsPerConnection = 0;
+  double allocsPerMessage = 0;
+};
+
+void roundTrip(boost::asio::ip::tcp::socket &socket,
+               const std::string &request, std::string &reply) {
+  boost::asio::write(socket, boost::asio::buffer(request));
+  auto n =
+      boost::asio::read_until(socket, boost::asio::dynamic_buffer(reply), '\n');
+  reply.erase(0, n);
+}
+
+Result runChurn(bool pooled, int connections, int messages) {
+  using boost::asio::ip::tcp;
+  boost::asio::io_context ioContext;
+  Server server(ioContext, 0, ServerOptions{pooled, /*verbose=*/false});
+  auto work = boost::asio::make_work_guard(ioContext);
+  std::thread serverThread([&ioContext] {
+    t_countAllocs = true;
+    ioContext.run();
+  });
+
+  const tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(),
+                               server.port());
+  const std::string request = "churn\n";
+  std::string reply;
+
+  // warm up once so lazily created io_context/reactor state is not counted
+  {
+    tcp::socket socket(ioContext);
+    socket.connect(endpoint);
+    roundTrip(socket, request, reply);
+  }
+
+  const auto churnAllocsBefore = g_allocs.load();
+  const auto start = std::chrono::steady_clock::now();
+  for (int c = 0; c < connections; ++c) {
+    tcp::socket socket(ioContext);
+    socket.connect(endpoint);
+    for (int m = 0; m < messages; ++m) {
+      roundTrip(socket, request, reply);
+    }
+  }
+  const auto end = std::chrono::steady_clock::now();
+  const auto churnAllocs = g_allocs.load() - churnAllocsBefore;
+
+  // the same number of messages on one connection, after its first one
+  const double totalMessages = static_cast<double>(connections) * messages;
+  std::size_t messageAllocs = 0;
+  {
+    tcp::socket socket(ioContext);
+    socket.connect(endpoint);
+    roundTrip(socket, request, reply);
+    const auto allocsBefore = g_allocs.load();
+    for (int m = 0; m < connections * messages; ++m) {
+      roundTrip(socket, request, reply);
+    }
+    messageAllocs = g_allocs.load() - allocsBefore;
+  }
+
+  // run() returns once the stopped server has nothing left in flight
+  work.reset();
+  server.stop();
+  serverThread.join();
+
+  Result result;
+  result.seconds = std::chrono::duration<double>(end - start).count();
+  result.allocsPerMessage =
+      totalMessages > 0 ? static_cast<double>(messageAllocs) / totalMessages
+                        : 0;
+  result.allocsPerConnection =
+      (static_cast<double>(churnAllocs) -
+       result.allocsPerMessage * totalMessages) /
+      connections;
+  return result;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int connections = argc > 1 ? std::atoi(argv[1]) : 5000;
+  const int messages = argc > 2 ? std::atoi(argv[2]) : 8;
+
+  std::printf("%d connections x %d messages\n", connections, messages);
+  std::printf("%-10s %14s %16s %16s\n", "mode", "accepts/sec", "allocs/conn",
+              "allocs/msg");
+  for (bool pooled : {false, true}) {
+    auto r = runChurn(pooled, connections, messages);
+    std::printf("%-10s %14.0f %16.2f %16.2f\n", pooled ? "pooled" : "heap",
+                connections / r.seconds, r.allocsPerConnection,
+                r.allocsPerMessage);
+  }
+  return 0;
+}
@@ -0,0 +1,131 @@
+// Pipelining benchmark for the asio echo server.
+//
+// The server runs in-process on its own thread; the load comes from one
+// client io_context with `connections` sockets. Each connection keeps
+// `depth` requests in flight: it starts by sending `depth` lines, and every
+// time replies come back it immediately sends as many new lines as it got
+// replies (batched into one write). Depth 1 is plain ping-pong; higher
+// depths measure how well the server answers a burst of lines that arrive
+// in a single read.
+//
+// Reported per depth (1, 2, 4, ..., max-depth): requests/sec.
+//
+// usage: pipeline_bench [connections] [seconds-per-depth] [max-depth]
+
+#include <array>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "server.h"
+
+using boost::asio::ip::tcp;
+
+namespace {
+class PipelineClient {
+ public:
+  PipelineClient(boost::asio::io_context& io, const tcp::endpoint& endpoint,
+                 int depth, std::atomic<bool>& running,
+                 std::uint64_t& completed)
+      : socket_(io), depth_(depth), running_(running), completed_(completed) {
+    socket_.connect(endpoint);
+    socket_.set_option(tcp::no_delay(true));
+  }
+
+  void start() {
+    owed_ = depth_;
+    send();
+    receive();
+  }
+
+ private:
+  // Send every request we owe the server in one write.
+  void send() {
+    if (writing_ || owed_ == 0 || !running_) return;
+    request_.clear();
+    for (; owed_ > 0; --owed_) request_.append(kRequest);
+    writing_ = true;
+    boost::asio::async_write(
+        socket_, boost::asio::buffer(request_),
+        [this](const boost::system::error_code& error, std::size_t) {
+          writing_ = false;
+          if (!error) send();
+        });
+  }
+
+  void receive() {
+    socket_.async_read_some(
+        boost::asio::buffer(reply_),
+        [this](const boost::system::error_code& error, std::size_t n) {
+          if (error) return;
+          int replies = 0;
+          for (const char* p = reply_.data(); p != reply_.data() + n; ++p) {
+            replies += *p == '\n';
+          }
+          completed_ += replies;
+          owed_ += replies;
+          send();
+          receive();
+        });
+  }
+
+  static constexpr std::string_view kRequest = "ping\n";
+  tcp::socket socket_;
+  std::string request_;
+  std::array<char, 64 * 1024> reply_;
+  int depth_;
+  int owed_ = 0;
+  bool writing_ = false;
+  std::atomic<bool>& running_;
+  std::uint64_t& completed_;
+};
+
+double drive(unsigned short port, int connections, int depth, int seconds) {
+  boost::asio::io_context io;
+  std::atomic<bool> running{true};
+  std::uint64_t completed = 0;
+  const tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+  std::vector<std::unique_ptr<PipelineClient>> clients;
+  for (int i = 0; i < connections; ++i) {
+    clients.push_back(std::make_unique<PipelineClient>(io, endpoint, depth,
+                                                       running, completed));
+  }
+  for (auto& c : clients) c->start();
+
+  const auto start = std::chrono::steady_clock::now();
+  io.run_for(std::chrono::seconds(seconds));
+  running = false;
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  return completed / std::chrono::duration<double>(elapsed).count();
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int connections = argc > 1 ? std::atoi(argv[1]) : 16;
+  const int seconds = argc > 2 ? std::atoi(argv[2]) : 2;
+  const int maxDepth = argc > 3 ? std::atoi(argv[3]) : 256;
+  std::printf("%d connections, %ds per depth\n", connections, seconds);
+
+  boost::asio::io_context ioContext;
+  ServerOptions options;
+  options.verbose = false;
+  Server server(ioContext, 0, options);
+  std::thread serverThread([&ioContext] { ioContext.run(); });
+
+  for (int depth = 1; depth <= maxDepth; depth *= 2) {
+    const double rate = drive(server.port(), connections, depth, seconds);
+    std::printf("depth %4d %12.0f req/s\n", depth, rate);
+  }
+
+  // run() returns once the stopped server has nothing left in flight
+  server.stop();
+  serverThread.join();
+  return 0;
+}
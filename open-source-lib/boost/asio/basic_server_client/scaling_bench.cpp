@@ -0,0 +1,141 @@
+// Thread scaling benchmark for the asio echo server.
+//
+// For every server thread count 1, 2, 4, ..., max-threads the server is
+// started in-process with io_context::run() on that many threads, once with
+// a single strand shared by all sessions and once with a strand per session.
+// The load comes from `connections` ping-pong sockets spread over
+// `client-threads` io_contexts (one thread each), so the client side is not
+// the bottleneck.
+//
+// Reported per configuration: requests/sec. With a shared strand the
+// throughput stays flat as threads are added; with per-session strands it
+// should grow until the cores (shared with the client threads) run out.
+//
+// usage: scaling_bench [connections] [seconds] [max-threads] [client-threads]
+
+#include <algorithm>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "server.h"
+
+using boost::asio::ip::tcp;
+
+namespace {
+class PingClient {
+ public:
+  PingClient(boost::asio::io_context& io, const tcp::endpoint& endpoint,
+             std::atomic<bool>& running, std::uint64_t& completed)
+      : socket_(io), running_(running), completed_(completed) {
+    socket_.connect(endpoint);
+    socket_.set_option(tcp::no_delay(true));
+  }
+
+  void start() { send(); }
+
+ private:
+  void send() {
+    boost::asio::async_write(
+        socket_, boost::asio::buffer(kRequest),
+        [this](const boost::system::error_code& error, std::size_t) {
+          if (!error) receive();
+        });
+  }
+
+  void receive() {
+    boost::asio::async_read_until(
+        socket_, boost::asio::dynamic_buffer(reply_), '\n',
+        [this](const boost::system::error_code& error, std::size_t n) {
+          if (error) return;
+          reply_.erase(0, n);
+          ++completed_;
+          if (running_) send();
+        });
+  }
+
+  static constexpr std::string_view kRequest = "ping\n";
+  tcp::socket socket_;
+  std::string reply_;
+  std::atomic<bool>& running_;
+  std::uint64_t& completed_;
+};
+
+double drive(unsigned short port, int connections, int seconds,
+             int clientThreads) {
+  std::vector<std::unique_ptr<boost::asio::io_context>> ios;
+  std::vector<std::uint64_t> completed(clientThreads);
+  for (int i = 0; i < clientThreads; ++i) {
+    ios.push_back(std::make_unique<boost::asio::io_context>(1));
+  }
+  std::atomic<bool> running{true};
+  const tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+  std::vector<std::unique_ptr<PingClient>> clients;
+  for (int i = 0; i < connections; ++i) {
+    const int t = i % clientThreads;
+    clients.push_back(
+        std::make_unique<PingClient>(*ios[t], endpoint, running, completed[t]));
+  }
+  for (auto& c : clients) c->start();
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (auto& io : ios) {
+    threads.emplace_back(
+        [&io, seconds] { io->run_for(std::chrono::seconds(seconds)); });
+  }
+  for (auto& t : threads) t.join();
+  running = false;
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  std::uint64_t total = 0;
+  for (auto c : completed) total += c;
+  return total / std::chrono::duration<double>(elapsed).count();
+}
+
+double measure(unsigned threads, bool strandPerSession, int connections,
+               int seconds, int clientThreads) {
+  boost::asio::io_context ioContext(static_cast<int>(threads));
+  ServerOptions options;
+  options.verbose = false;
+  options.strandPerSession = strandPerSession;
+  Server server(ioContext, 0, options);
+  std::thread serverThread(
+      [&ioContext, threads] { runThreads(ioContext, threads); });
+
+  const double rate = drive(server.port(), connections, seconds, clientThreads);
+
+  // run() returns once the stopped server has nothing left in flight
+  server.stop();
+  serverThread.join();
+  return rate;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int connections = argc > 1 ? std::atoi(argv[1]) : 256;
+  const int seconds = argc > 2 ? std::atoi(argv[2]) : 2;
+  const unsigned maxThreads =
+      argc > 3 ? static_cast<unsigned>(std::atoi(argv[3]))
+               : std::max(1u, std::thread::hardware_concurrency());
+  const int clientThreads = argc > 4 ? std::atoi(argv[4]) : 2;
+  std::printf("%d connections, %d client threads, %ds per run\n", connections,
+              clientThreads, seconds);
+  std::printf("%8s %18s %18s\n", "threads", "shared strand", "strand/session");
+
+  for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+    const double shared =
+        measure(threads, false, connections, seconds, clientThreads);
+    const double perSession =
+        measure(threads, true, connections, seconds, clientThreads);
+    std::printf("%8u %12.0f req/s %12.0f req/s\n", threads, shared,
+                perSession);
+  }
+  return 0;
+}
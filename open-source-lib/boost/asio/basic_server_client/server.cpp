@@ -1,136 +1,76 @@
-#include <boost/asio.hpp>
+#include <csignal>
+#include <cstdlib>
 #include <iostream>
-#include <memory>
+#include <string>
 
-/*
-A strand is a synchronization mechanism within the io_context that ensures
-serialized execution of handlers, providing control over the concurrency of
-handlers within the context. It helps guarantee sequential execution of certain
-operations while allowing other parts of the application to execute concurrently
-*/
+#include "server.h"
+#ifdef HAVE_IO_URING
+#include "uring_server.h"
+#endif
 
-/*
-Note: The use of shared_from_this() and capturing self in the lambda function
-ensures that the Session object remains valid until the completion of the
-asynchronous operation.
-
-Inside the lambda function, there is a callback for the asynchronous write
-operation. This lambda function might be invoked after the Session object has
-been destroyed if the Session object is managed by a raw pointer.
-
-By using shared_from_this(), a std::shared_ptr is created that shares
-ownership of the Session object. Capturing self in the lambda function ensures
-that the std::shared_ptr remains alive throughout the execution of the lambda.
-
-By extending the lifetime of the Session object using shared_from_this(), we
-can safely access member variables and call member functions inside the lambda
-without the risk of accessing invalid memory. This allows the asynchronous
-operations to complete successfully and ensures proper cleanup and destruction
-of the Session object when it's no longer needed.
-*/
-
-class Session : public std::enable_shared_from_this<Session> {
- public:
-  Session(boost::asio::ip::tcp::socket socket,
-          boost::asio::io_context::strand &strand)
-      : socket_(std::move(socket)), strand_(strand) {}
-
-  void start() { read(); }
-
- private:
-  void read() {
-    std::cout << "server async read...\n";
-    boost::asio::async_read_until(
-        socket_, buffer_, '\n',
-        boost::asio::bind_executor(
-            strand_,
-            [self = shared_from_this()](const boost::system::error_code &error,
-                                        std::size_t bytesTransferred) {
-              if (!error) {
-                auto start = boost::asio::buffers_begin(self->buffer_.data());
-                std::string message(start, start + bytesTransferred);
-                assert(message.back() == '\n');
-                message.pop_back();  // r_strip the \n
-                std::cout << "Received message: \"" << message << "\" from " <<
-                  self->socket_.remote_endpoint() << '\n';
-                self->write("Server ack'ed message: " + message);
-              } else if (error == boost::asio::error::eof) {
-                // Client disconnected
-                std::cout << "Client disconnected." << std::endl;
-              } else {
-                // Other read error
-                std::cerr << "Read error: " << error.message() << std::endl;
-              }
-              // Clean up the buffer
-              self->buffer_.consume(bytesTransferred);
-            }));
-  }
+namespace {
+void usage() {
+  std::cerr << "Usage: server [--backend asio|uring] [--threads <n>]\n"
+               "              [--port <port>] [--quiet]\n";
+}
+}  // namespace
 
-  void write(const std::string &message) {
-    boost::asio::async_write(
-        socket_, boost::asio::buffer(message + '\n'),
-        boost::asio::bind_executor(
-            strand_,
-            [self = shared_from_this()](const boost::system::error_code &error,
-                                        std::size_t /*bytesTransferred*/) {
-              if (!error) {
-                self->read();
-              } else {
-                std::cerr << "Write error: " << error.message() << std::endl;
-              }
-            }));
+int main(int argc, char* argv[]) {
+  std::string backend = "asio";
+  unsigned threads = 1;
+  unsigned short port = 12345;
+  bool verbose = true;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--quiet") {
+      verbose = false;
+    } else if (i + 1 < argc && arg == "--backend") {
+      backend = argv[++i];
+    } else if (i + 1 < argc && arg == "--threads") {
+      threads = static_cast<unsigned>(std::atoi(argv[++i]));
+    } else if (i + 1 < argc && arg == "--port") {
+      port = static_cast<unsigned short>(std::atoi(argv[++i]));
+    } else {
+      usage();
+      return 1;
+    }
   }
 
-  boost::asio::ip::tcp::socket socket_;
-  boost::asio::streambuf buffer_;
-  boost::asio::io_context::strand strand_;
-};
-
-class Server {
- public:
-  Server(boost::asio::io_context &ioContext, unsigned short port)
-      : port_(port),
-        acceptor_(ioContext, boost::asio::ip::tcp::endpoint(
-                                 boost::asio::ip::tcp::v4(), port)),
-        strand_(ioContext) {
-    std::cout << "server started to listen on port=" << port_ << '\n';
-    startAccept();
+  if (backend == "asio") {
+    boost::asio::io_context ioContext;
+    ServerOptions options;
+    options.verbose = verbose;
+    Server server(ioContext, port, options);
+    // Ctrl-C stops the server; run() returns once every session is closed
+    boost::asio::signal_set signals(ioContext, SIGINT, SIGTERM);
+    signals.async_wait(
+        [&server](const boost::system::error_code &error, int /*signal*/) {
+          if (!error) server.stop();
+        });
+    runThreads(ioContext, threads ? threads : 1);
+    return 0;
   }
-
- private:
-  void startAccept() {
-    acceptor_.async_accept([this](const boost::system::error_code &error,
-                                  boost::asio::ip::tcp::socket socket) {
-      if (!error) {
-        // The std::make_shared<Session> function creates a new Session object,
-        // which is allocated dynamically and managed by a shared pointer. This
-        // allows the Session object to persist even after the completion
-        // handler (this lambda) exits.
-
-        boost::asio::ip::tcp::endpoint remoteEndpoint =
-          socket.remote_endpoint();
-        boost::asio::ip::tcp::endpoint localEndpoint =
-          socket.local_endpoint();
-        std::cout << "Start new session for client: " << remoteEndpoint
-          << " using local: " << localEndpoint << '\n';
-        std::make_shared<Session>(std::move(socket), std::ref(strand_))
-            ->start();
-      }
-
-      // After handling the accepted connection, startAccept() is called again
-      // to initiate the next accept operation, creating a loop that
-      // continuously accepts new connections.
-      startAccept();
-    });
+#ifdef HAVE_IO_URING
+  if (backend == "uring") {
+    // Ctrl-C stops the server. The signals are blocked before the workers
+    // start so they inherit the mask and only sigwait() below sees them.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    UringServerOptions options;
+    options.threads = threads ? threads : 1;
+    UringEchoServer server(port, options);
+    std::cout << "io_uring server listening on port=" << server.port()
+              << " with " << options.threads << " thread(s)\n";
+    server.start();
+    int signal = 0;
+    sigwait(&signals, &signal);
+    server.stop();
+    return 0;
   }
-  unsigned short port_ = 0;
-  boost::asio::ip::tcp::acceptor acceptor_;
-  boost::asio::io_context::strand strand_;
-};
-
-int main() {
-  boost::asio::io_context ioContext;
-  Server server(ioContext, 12345);
-  ioContext.run();
-  return 0;
+#endif
+  usage();
+  return 1;
 }
@@ -0,0 +1,358 @@
+#pragma once
+
+#include <algorithm>
+#include <boost/asio.hpp>
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "handler_memory.h"
+#include "session_pool.h"
+
+/*
+A strand is a synchronization mechanism within the io_context that ensures
+serialized execution of handlers, providing control over the concurrency of
+handlers within the context. It helps guarantee sequential execution of certain
+operations while allowing other parts of the application to execute concurrently
+
+Every Session gets its own strand, so when io_context::run() is called from
+several threads (see runThreads() below) handlers of one connection are still
+serialized, but different connections run in parallel. A single strand shared
+by all sessions would serialize the whole server onto one thread at a time.
+
+The strands are boost::asio::strand<io_context::executor_type> rather than
+io_context::strand: the latter hashes every strand onto a fixed pool of
+implementations, so two unrelated sessions can end up serialized on the same
+one.
+*/
+
+using SessionStrand =
+    boost::asio::strand<boost::asio::io_context::executor_type>;
+
+/*
+Note: The use of shared_from_this() and capturing self in the lambda function
+ensures that the Session object remains valid until the completion of the
+asynchronous operation.
+
+Inside the lambda function, there is a callback for the asynchronous write
+operation. This lambda function might be invoked after the Session object has
+been destroyed if the Session object is managed by a raw pointer.
+
+By using shared_from_this(), a std::shared_ptr is created that shares
+ownership of the Session object. Capturing self in the lambda function ensures
+that the std::shared_ptr remains alive throughout the execution of the lambda.
+
+By extending the lifetime of the Session object using shared_from_this(), we
+can safely access member variables and call member functions inside the lambda
+without the risk of accessing invalid memory. This allows the asynchronous
+operations to complete successfully and ensures proper cleanup and destruction
+of the Session object when it's no longer needed.
+*/
+
+struct ServerOptions {
+  // Recycle Session objects through a SessionPool and give every async
+  // operation a per-session HandlerMemory arena (see util/handler_memory.h).
+  // When false, sessions come from make_shared and handlers from operator new.
+  bool pooled = true;
+  // Per-message logging; turn it off when benchmarking.
+  bool verbose = true;
+  // One strand per session. When false every session shares the server's
+  // strand (the old behaviour, kept to measure the difference).
+  bool strandPerSession = true;
+};
+
+/*
+Pipelining: a client may send many lines without waiting for the replies.
+Instead of strictly alternating read -> write -> read (one round trip of
+scheduling per line), the session
+
+  - keeps a read outstanding at all times and, on every completion, answers
+    every complete line already sitting in the streambuf
+  - appends the replies to pending_, and if no write is in flight swaps
+    pending_ with writing_ and sends the whole batch with one async_write
+  - while that write is in flight, replies keep accumulating in pending_
+    and go out as the next batch
+
+The two output strings are swapped, never reallocated, so their capacity is
+reused across batches. If the peer stops reading, reading is paused once
+pending_ grows past kMaxPending and resumed when the write drains.
+*/
+
+class Session : public std::enable_shared_from_this<Session> {
+ public:
+  Session(boost::asio::ip::tcp::socket socket,
+          SessionStrand strand, const ServerOptions &options)
+      : socket_(std::move(socket)),
+        strand_(strand),
+        verbose_(options.verbose),
+        readMemory_(options.pooled),
+        writeMemory_(options.pooled) {}
+
+  void start() { read(); }
+
+  // Closes the socket on the session's strand. The outstanding read and write
+  // complete with operation_aborted and drop their references to the session.
+  void close() {
+    boost::asio::dispatch(strand_, [self = shared_from_this()] {
+      boost::system::error_code ignored;
+      self->socket_.close(ignored);
+    });
+  }
+
+ private:
+  void read() {
+    if (!socket_.is_open()) {
+      return;  // closed by close() while a completion was queued
+    }
+    if (verbose_) std::cout << "server async read...\n";
+    socket_.async_read_some(
+        buffer_.prepare(kReadSize),
+        boost::asio::bind_executor(
+            strand_,
+            makeCustomAllocHandler(
+                readMemory_,
+                [self = shared_from_this()](
+                    const boost::system::error_code &error,
+                    std::size_t bytesTransferred) {
+                  self->onRead(error, bytesTransferred);
+                })));
+  }
+
+  void onRead(const boost::system::error_code &error,
+              std::size_t bytesTransferred) {
+    if (!error) {
+      buffer_.commit(bytesTransferred);
+      handleLines();
+      write();
+      if (pending_.size() < kMaxPending) {
+        read();
+      } else {
+        readPaused_ = true;
+      }
+    } else if (error == boost::asio::error::eof ||
+               error == boost::asio::error::connection_reset) {
+      // Client disconnected
+      if (verbose_) std::cout << "Client disconnected." << std::endl;
+    } else if (error == boost::asio::error::operation_aborted) {
+      // closed by Server::stop()
+    } else {
+      // Other read error
+      std::cerr << "Read error: " << error.message() << std::endl;
+    }
+  }
+
+  // Answer every complete line in buffer_, leave a partial one for later.
+  void handleLines() {
+    const auto input = buffer_.data();
+    std::string_view data(static_cast<const char *>(input.data()),
+                          input.size());
+    std::size_t consumed = 0;
+    for (auto nl = data.find('\n'); nl != std::string_view::npos;
+         nl = data.find('\n', consumed)) {
+      const auto line = data.substr(consumed, nl + 1 - consumed);
+      if (verbose_) {
+        std::cout << "Received message: \""
+                  << line.substr(0, line.size() - 1) << "\" from "
+                  << socket_.remote_endpoint() << '\n';
+      }
+      pending_.append(kAckPrefix);
+      pending_.append(line);  // keeps the '\n' delimiter
+      consumed = nl + 1;
+    }
+    // Clean up the buffer
+    buffer_.consume(consumed);
+  }
+
+  void write() {
+    if (writing_.size() != 0 || pending_.empty() || !socket_.is_open()) {
+      return;
+    }
+    // writing_ is a member so the buffer outlives the async_write
+    std::swap(writing_, pending_);
+    boost::asio::async_write(
+        socket_, boost::asio::buffer(writing_),
+        boost::asio::bind_executor(
+            strand_,
+            makeCustomAllocHandler(
+                writeMemory_,
+                [self = shared_from_this()](
+                    const boost::system::error_code &error,
+                    std::size_t /*bytesTransferred*/) {
+                  self->onWrite(error);
+                })));
+  }
+
+  void onWrite(const boost::system::error_code &error) {
+    if (error == boost::asio::error::operation_aborted) {
+      return;  // closed by Server::stop()
+    }
+    if (error) {
+      std::cerr << "Write error: " << error.message() << std::endl;
+      return;
+    }
+    writing_.clear();
+    write();
+    if (readPaused_ && pending_.size() < kMaxPending) {
+      readPaused_ = false;
+      read();  // reading was paused because the peer was not keeping up
+    }
+  }
+
+  static constexpr std::string_view kAckPrefix = "Server ack'ed message: ";
+  static constexpr std::size_t kReadSize = 4096;
+  static constexpr std::size_t kMaxPending = 1 << 20;
+
+  boost::asio::ip::tcp::socket socket_;
+  boost::asio::streambuf buffer_;
+  SessionStrand strand_;
+  bool verbose_ = true;
+  // Set only when onRead held back the next read for backpressure. After
+  // EOF or a read error nothing is paused, so onWrite does not read again.
+  bool readPaused_ = false;
+  // replies being written / replies waiting for the next write
+  std::string writing_;
+  std::string pending_;
+  // One arena per kind of outstanding operation: a session never has two
+  // reads or two writes in flight at once.
+  HandlerMemory readMemory_;
+  HandlerMemory writeMemory_;
+};
+
+/*
+Shutdown: the pending accept is allocated from acceptMemory_ and pooled
+sessions from sessionPool_, so no operation may still be queued in the
+io_context when the Server goes away. The io_context is normally declared
+before the Server and therefore outlives it, destroying whatever is still
+queued afterwards. Call stop() and let the io_context run out of work (run()
+returning on its own, or restart() + run() after io_context::stop()) before
+destroying the Server.
+*/
+
+class Server {
+ public:
+  Server(boost::asio::io_context &ioContext, unsigned short port,
+         ServerOptions options = {})
+      : ioContext_(ioContext),
+        options_(options),
+        acceptor_(ioContext, boost::asio::ip::tcp::endpoint(
+                                 boost::asio::ip::tcp::v4(), port)),
+        strand_(boost::asio::make_strand(ioContext)),
+        acceptMemory_(options.pooled) {
+    port_ = acceptor_.local_endpoint().port();
+    if (options_.verbose)
+      std::cout << "server started to listen on port=" << port_ << '\n';
+    startAccept();
+  }
+
+  // The actual listening port (useful when constructed with port 0).
+  unsigned short port() const { return port_; }
+
+  const BlockPool &sessionBlocks() const { return sessionPool_.blocks(); }
+
+  // Stops accepting and closes every session. May be called from any thread;
+  // the work is done on strand_, where the accept handler runs too.
+  void stop() {
+    boost::asio::dispatch(strand_, [this] {
+      stopped_ = true;
+      boost::system::error_code ignored;
+      acceptor_.close(ignored);
+      for (const auto &weak : sessions_) {
+        if (auto session = weak.lock()) {
+          session->close();
+        }
+      }
+      sessions_.clear();
+    });
+  }
+
+ private:
+  void startAccept() {
+    acceptor_.async_accept(boost::asio::bind_executor(
+        strand_, makeCustomAllocHandler(
+                     acceptMemory_,
+                     [this](const boost::system::error_code &error,
+                            boost::asio::ip::tcp::socket socket) {
+                       onAccept(error, std::move(socket));
+                     })));
+  }
+
+  void onAccept(const boost::system::error_code &error,
+                boost::asio::ip::tcp::socket socket) {
+    if (stopped_) {
+      return;  // an accepted socket closes as it goes out of scope
+    }
+    if (!error) {
+      // The Session object is allocated dynamically and managed by a shared
+      // pointer. This allows the Session object to persist even after the
+      // completion handler exits. In pooled mode the memory comes back from
+      // sessionPool_ instead of the global heap.
+      if (options_.verbose) {
+        std::cout << "Start new session for client: "
+                  << socket.remote_endpoint()
+                  << " using local: " << socket.local_endpoint() << '\n';
+      }
+      auto session = makeSession(std::move(socket));
+      track(session);
+      session->start();
+    }
+
+    // After handling the accepted connection, startAccept() is called again
+    // to initiate the next accept operation, creating a loop that
+    // continuously accepts new connections.
+    startAccept();
+  }
+
+  // Remembers the session for stop(). A weak_ptr keeps the pooled block of a
+  // finished session alive, so expired entries are swept whenever the list
+  // has doubled since the last sweep.
+  void track(const std::shared_ptr<Session> &session) {
+    if (sessions_.size() >= sweepAt_) {
+      sessions_.erase(
+          std::remove_if(sessions_.begin(), sessions_.end(),
+                         [](const auto &weak) { return weak.expired(); }),
+          sessions_.end());
+      sweepAt_ = std::max<std::size_t>(kMinSweep, 2 * sessions_.size());
+    }
+    sessions_.push_back(session);
+  }
+
+  std::shared_ptr<Session> makeSession(boost::asio::ip::tcp::socket socket) {
+    SessionStrand strand = options_.strandPerSession
+                               ? boost::asio::make_strand(ioContext_)
+                               : strand_;
+    if (options_.pooled) {
+      return sessionPool_.make(std::move(socket), strand, options_);
+    }
+    return std::make_shared<Session>(std::move(socket), strand, options_);
+  }
+
+  boost::asio::io_context &ioContext_;
+  ServerOptions options_;
+  unsigned short port_ = 0;
+  boost::asio::ip::tcp::acceptor acceptor_;
+  SessionStrand strand_;
+  SessionPool<Session> sessionPool_;
+  HandlerMemory acceptMemory_;
+  // only touched on strand_
+  static constexpr std::size_t kMinSweep = 64;
+  std::vector<std::weak_ptr<Session>> sessions_;
+  std::size_t sweepAt_ = kMinSweep;
+  bool stopped_ = false;
+};
+
+// Run ioContext on `threads` threads (the calling thread included) until it
+// runs out of work or is stopped.
+inline void runThreads(boost::asio::io_context &ioContext, unsigned threads) {
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < threads; ++i) {
+    pool.emplace_back([&ioContext] { ioContext.run(); });
+  }
+  ioContext.run();
+  for (auto &t : pool) {
+    t.join();
+  }
+}
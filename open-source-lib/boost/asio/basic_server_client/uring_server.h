@@ -0,0 +1,415 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "uring.h"
+
+/*
+io_uring backend for the echo server, thread-per-core.
+
+Same protocol as Session in server.h: every '\n' terminated line is answered
+with "Server ack'ed message: <line>\n". Unlike the asio backend there is no
+shared state at all between threads:
+
+  - every worker thread owns its ring, its listening socket (SO_REUSEPORT on
+    the same port, the kernel spreads incoming connections) and its
+    connections, and is pinned to one CPU
+  - one multishot accept per thread keeps accepting without re-arming
+  - one multishot recv per connection with IOSQE_BUFFER_SELECT: the kernel
+    picks the receive buffer from the thread's provided buffer ring, so idle
+    connections hold no receive buffer
+  - replies are staged in a per-connection slot of one registered (pinned)
+    region and sent with IORING_OP_WRITE_FIXED, which skips the per-call
+    page pinning of a regular send
+  - all complete lines of a recv are answered by one write
+
+The event loop does one io_uring_enter per iteration: submit everything
+queued by the previous batch of completions and wait for the next one.
+*/
+
+struct UringServerOptions {
+  unsigned threads = 1;
+  // per-thread limits; connections beyond maxConnections are closed
+  unsigned maxConnections = 1024;
+  unsigned ringEntries = 4096;
+  unsigned recvBuffers = 1024;  // power of 2
+  unsigned recvBufferSize = 4096;
+  unsigned sendSlotSize = 4096;
+  bool pinThreads = true;
+};
+
+class UringEchoWorker {
+ public:
+  UringEchoWorker(int listenFd, const UringServerOptions& options)
+      : options_(options),
+        listenFd_(listenFd),
+        ring_(options.ringEntries),
+        recvBuffers_(ring_, kRecvGroup, options.recvBuffers,
+                     options.recvBufferSize),
+        sendArena_(static_cast<std::size_t>(options.maxConnections) *
+                   options.sendSlotSize),
+        connections_(options.maxConnections) {
+    ring_.registerBuffers({iovec{sendArena_.data(), sendArena_.size()}});
+    wakeFd_ = ::eventfd(0, EFD_CLOEXEC);
+    for (unsigned i = options.maxConnections; i > 0; --i) {
+      freeSlots_.push_back(i - 1);
+    }
+  }
+
+  ~UringEchoWorker() {
+    for (auto& c : connections_) {
+      if (c.fd >= 0) ::close(c.fd);
+    }
+    ::close(wakeFd_);
+    ::close(listenFd_);
+  }
+
+  void run() {
+    armAccept();
+    armWake();
+    while (!stopped_.load(std::memory_order_relaxed)) {
+      ring_.submit(1);
+      ring_.forEachCqe([this](const io_uring_cqe& cqe) { onCqe(cqe); });
+    }
+  }
+
+  // Thread safe: wakes the worker through its eventfd.
+  void stop() {
+    stopped_ = true;
+    std::uint64_t one = 1;
+    [[maybe_unused]] auto n = ::write(wakeFd_, &one, sizeof(one));
+  }
+
+  // io_uring_enter calls plus the few syscalls made outside the ring
+  // (setsockopt on accept, shutdown/close on teardown paths).
+  std::uint64_t syscalls() const { return ring_.enterCalls() + directCalls_; }
+
+ private:
+  static constexpr std::uint16_t kRecvGroup = 0;
+  static constexpr std::string_view kAckPrefix = "Server ack'ed message: ";
+
+  enum Op : std::uint64_t { kAccept = 1, kRecv, kWrite, kClose, kWake };
+
+  struct Connection {
+    int fd = -1;
+    std::string partial;   // trailing bytes of an incomplete line
+    std::string pending;   // replies not yet copied into the send slot
+    unsigned slotOffset = 0;
+    unsigned slotLength = 0;
+    bool writing = false;
+    bool receiving = false;
+    bool closing = false;
+  };
+
+  static std::uint64_t tag(Op op, std::uint32_t slot) {
+    return (static_cast<std::uint64_t>(op) << 32) | slot;
+  }
+
+  char* sendSlot(std::uint32_t slot) {
+    return sendArena_.data() +
+           static_cast<std::size_t>(slot) * options_.sendSlotSize;
+  }
+
+  void armAccept() {
+    io_uring_sqe* sqe = ring_.getSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenFd_;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = tag(kAccept, 0);
+  }
+
+  void armWake() {
+    io_uring_sqe* sqe = ring_.getSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeFd_;
+    sqe->addr = reinterpret_cast<std::uint64_t>(&wakeValue_);
+    sqe->len = sizeof(wakeValue_);
+    sqe->user_data = tag(kWake, 0);
+  }
+
+  void armRecv(std::uint32_t slot) {
+    io_uring_sqe* sqe = ring_.getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = connections_[slot].fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = recvBuffers_.groupId();
+    sqe->user_data = tag(kRecv, slot);
+    connections_[slot].receiving = true;
+  }
+
+  void armWrite(std::uint32_t slot) {
+    Connection& c = connections_[slot];
+    io_uring_sqe* sqe = ring_.getSqe();
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = c.fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(sendSlot(slot) + c.slotOffset);
+    sqe->len = c.slotLength - c.slotOffset;
+    sqe->off = static_cast<std::uint64_t>(-1);
+    sqe->buf_index = 0;
+    sqe->user_data = tag(kWrite, slot);
+    c.writing = true;
+  }
+
+  void armClose(std::uint32_t slot) {
+    io_uring_sqe* sqe = ring_.getSqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = connections_[slot].fd;
+    sqe->user_data = tag(kClose, slot);
+  }
+
+  void onCqe(const io_uring_cqe& cqe) {
+    const auto op = static_cast<Op>(cqe.user_data >> 32);
+    const auto slot = static_cast<std::uint32_t>(cqe.user_data);
+    switch (op) {
+      case kAccept:
+        onAccept(cqe);
+        break;
+      case kRecv:
+        onRecv(slot, cqe);
+        break;
+      case kWrite:
+        onWrite(slot, cqe.res);
+        break;
+      case kClose:
+        connections_[slot] = Connection{};
+        freeSlots_.push_back(slot);
+        break;
+      case kWake:
+        break;
+    }
+  }
+
+  void onAccept(const io_uring_cqe& cqe) {
+    if (!(cqe.flags & IORING_CQE_F_MORE) && !stopped_) {
+      armAccept();
+    }
+    if (cqe.res < 0) {
+      return;
+    }
+    if (freeSlots_.empty()) {
+      ::close(cqe.res);
+      ++directCalls_;
+      return;
+    }
+    const std::uint32_t slot = freeSlots_.back();
+    freeSlots_.pop_back();
+    int one = 1;
+    ::setsockopt(cqe.res, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    ++directCalls_;
+    connections_[slot].fd = cqe.res;
+    armRecv(slot);
+  }
+
+  void onRecv(std::uint32_t slot, const io_uring_cqe& cqe) {
+    Connection& c = connections_[slot];
+    const bool more = cqe.flags & IORING_CQE_F_MORE;
+    if (!more) {
+      c.receiving = false;
+    }
+    if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+      const auto bid =
+          static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+      consume(c, std::string_view(recvBuffers_.data(bid), cqe.res));
+      recvBuffers_.recycle(bid);
+      flush(slot);
+      if (!more) recvEnded(slot);
+      return;
+    }
+    if (cqe.res == -ENOBUFS) {
+      // every provided buffer is in use; they come back as we consume
+      if (!more) recvEnded(slot);
+      return;
+    }
+    // EOF or error
+    c.closing = true;
+    maybeClose(slot);
+  }
+
+  // The multishot recv ended without EOF or error: re-arm it, or, if the
+  // connection is closing (e.g. after a write error), close it now that
+  // nothing reads from it any more.
+  void recvEnded(std::uint32_t slot) {
+    if (connections_[slot].closing) {
+      maybeClose(slot);
+    } else {
+      armRecv(slot);
+    }
+  }
+
+  // Answer every complete line, keep the tail for the next recv.
+  void consume(Connection& c, std::string_view data) {
+    while (!data.empty()) {
+      const auto nl = data.find('\n');
+      if (nl == std::string_view::npos) {
+        c.partial.append(data);
+        return;
+      }
+      c.pending.append(kAckPrefix);
+      if (!c.partial.empty()) {
+        c.pending.append(c.partial);
+        c.partial.clear();
+      }
+      c.pending.append(data.substr(0, nl + 1));
+      data.remove_prefix(nl + 1);
+    }
+  }
+
+  // Move pending replies into the registered slot and start a write.
+  void flush(std::uint32_t slot) {
+    Connection& c = connections_[slot];
+    if (c.writing || c.pending.empty() || c.closing) {
+      return;
+    }
+    const auto n = static_cast<unsigned>(
+        std::min<std::size_t>(c.pending.size(), options_.sendSlotSize));
+    std::memcpy(sendSlot(slot), c.pending.data(), n);
+    c.pending.erase(0, n);
+    c.slotOffset = 0;
+    c.slotLength = n;
+    armWrite(slot);
+  }
+
+  void onWrite(std::uint32_t slot, int res) {
+    Connection& c = connections_[slot];
+    c.writing = false;
+    if (res <= 0) {
+      c.closing = true;
+      maybeClose(slot);
+      return;
+    }
+    c.slotOffset += res;
+    if (c.slotOffset < c.slotLength && !c.closing) {
+      armWrite(slot);  // short write, send the rest of the slot
+      return;
+    }
+    if (c.closing) {
+      maybeClose(slot);
+      return;
+    }
+    flush(slot);
+  }
+
+  // Close once nothing in flight references the connection any more. A
+  // still-armed multishot recv ends with a final CQE after the close.
+  void maybeClose(std::uint32_t slot) {
+    Connection& c = connections_[slot];
+    if (c.writing || c.receiving || c.fd < 0) {
+      if (c.receiving && !c.writing) {
+        ::shutdown(c.fd, SHUT_RDWR);  // ends the multishot recv
+        ++directCalls_;
+      }
+      return;
+    }
+    armClose(slot);
+  }
+
+  UringServerOptions options_;
+  int listenFd_ = -1;
+  int wakeFd_ = -1;
+  std::uint64_t wakeValue_ = 0;
+  std::atomic<bool> stopped_{false};
+  std::uint64_t directCalls_ = 0;
+  Uring ring_;
+  BufferRing recvBuffers_;
+  std::vector<char> sendArena_;
+  std::vector<Connection> connections_;
+  std::vector<std::uint32_t> freeSlots_;
+};
+
+class UringEchoServer {
+ public:
+  UringEchoServer(unsigned short port, UringServerOptions options = {})
+      : options_(options) {
+    for (unsigned i = 0; i < options_.threads; ++i) {
+      int fd = openListener(port);
+      if (port == 0) {
+        // the first listener picked the port, the others share it
+        sockaddr_in addr{};
+        socklen_t len = sizeof(addr);
+        ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+        port = ntohs(addr.sin_port);
+      }
+      workers_.push_back(std::make_unique<UringEchoWorker>(fd, options_));
+    }
+    port_ = port;
+  }
+
+  ~UringEchoServer() { stop(); }
+
+  unsigned short port() const { return port_; }
+
+  void start() {
+    for (unsigned i = 0; i < workers_.size(); ++i) {
+      threads_.emplace_back([this, i] { workers_[i]->run(); });
+      if (options_.pinThreads) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(i % std::thread::hardware_concurrency(), &cpuset);
+        pthread_setaffinity_np(threads_.back().native_handle(),
+                               sizeof(cpu_set_t), &cpuset);
+      }
+    }
+  }
+
+  void stop() {
+    for (auto& w : workers_) {
+      w->stop();
+    }
+    for (auto& t : threads_) {
+      if (t.joinable()) t.join();
+    }
+  }
+
+  // Sum of io_uring_enter calls of all workers. Only read after stop().
+  std::uint64_t syscalls() const {
+    std::uint64_t n = 0;
+    for (const auto& w : workers_) n += w->syscalls();
+    return n;
+  }
+
+ private:
+  static int openListener(unsigned short port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      throw std::system_error(errno, std::system_category(), "socket");
+    }
+    int one = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        ::listen(fd, SOMAXCONN) < 0) {
+      int err = errno;
+      ::close(fd);
+      throw std::system_error(err, std::system_category(), "bind/listen");
+    }
+    return fd;
+  }
+
+  UringServerOptions options_;
+  unsigned short port_ = 0;
+  std::vector<std::unique_ptr<UringEchoWorker>> workers_;
+  std::vector<std::thread> threads_;
+};
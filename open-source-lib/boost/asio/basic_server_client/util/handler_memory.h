@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+Handler memory, the classic asio "allocation" example pattern.
+
+Every async_read/async_write needs an operation object that wraps the
+completion handler, and asio allocates it through the handler's associated
+allocator (std::allocator, i.e. operator new, by default). For a given
+connection there is at most one outstanding read and one outstanding write at
+any time, and asio releases the operation memory *before* invoking the
+handler. So a small inline arena per outstanding operation is enough to make
+the steady-state read/write loop allocation free: the memory just gets
+recycled by the next operation started from inside the handler.
+
+If the arena is busy (or the request is too large) we silently fall back to
+operator new, so correctness never depends on the arena size.
+*/
+
+class HandlerMemory {
+ public:
+  explicit HandlerMemory(bool enabled = true) : enabled_(enabled) {}
+
+  HandlerMemory(const HandlerMemory&) = delete;
+  HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+  void* allocate(std::size_t size) {
+    if (enabled_ && !in_use_ && size <= sizeof(storage_)) {
+      in_use_ = true;
+      return &storage_;
+    }
+    return ::operator new(size);
+  }
+
+  void deallocate(void* pointer) {
+    if (pointer == &storage_) {
+      in_use_ = false;
+    } else {
+      ::operator delete(pointer);
+    }
+  }
+
+ private:
+  std::aligned_storage_t<1024> storage_;
+  bool in_use_ = false;
+  bool enabled_ = true;
+};
+
+// The minimal allocator asio needs, forwarding to a HandlerMemory arena.
+template <typename T>
+class HandlerAllocator {
+ public:
+  using value_type = T;
+
+  explicit HandlerAllocator(HandlerMemory& mem) : memory_(mem) {}
+
+  template <typename U>
+  HandlerAllocator(const HandlerAllocator<U>& other) noexcept
+      : memory_(other.memory_) {}
+
+  bool operator==(const HandlerAllocator& other) const noexcept {
+    return &memory_ == &other.memory_;
+  }
+
+  bool operator!=(const HandlerAllocator& other) const noexcept {
+    return &memory_ != &other.memory_;
+  }
+
+  T* allocate(std::size_t n) const {
+    return static_cast<T*>(memory_.allocate(sizeof(T) * n));
+  }
+
+  void deallocate(T* p, std::size_t /*n*/) const {
+    return memory_.deallocate(p);
+  }
+
+ private:
+  template <typename>
+  friend class HandlerAllocator;
+
+  HandlerMemory& memory_;
+};
+
+// Wraps a handler so asio picks up HandlerAllocator as its associated
+// allocator. Composes with bind_executor (executor_binder forwards the
+// associated allocator of the wrapped handler).
+template <typename Handler>
+class CustomAllocHandler {
+ public:
+  using allocator_type = HandlerAllocator<Handler>;
+
+  CustomAllocHandler(HandlerMemory& m, Handler h)
+      : memory_(m), handler_(std::move(h)) {}
+
+  allocator_type get_allocator() const noexcept {
+    return allocator_type(memory_);
+  }
+
+  template <typename... Args>
+  void operator()(Args&&... args) {
+    handler_(std::forward<Args>(args)...);
+  }
+
+ private:
+  HandlerMemory& memory_;
+  Handler handler_;
+};
+
+template <typename Handler>
+inline CustomAllocHandler<std::decay_t<Handler>> makeCustomAllocHandler(
+    HandlerMemory& m, Handler&& h) {
+  return CustomAllocHandler<std::decay_t<Handler>>(m, std::forward<Handler>(h));
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+/*
+Session object pool.
+
+Sessions are owned through std::shared_ptr (handlers keep them alive via
+shared_from_this()), so instead of handing out raw objects the pool plugs in
+as the allocator of std::allocate_shared. allocate_shared makes exactly one
+allocation per object (control block + object together), always of the same
+size for a given session type, so the pool only needs to recycle fixed-size
+blocks:
+
+  - on allocate, pop a block from the free list, or operator new a fresh one
+  - on deallocate (last shared_ptr gone), push the block back
+
+Under connection churn this turns "one malloc/free per accepted connection"
+into "one malloc per peak concurrent connection".
+
+The allocator copy living in each control block holds a shared_ptr to the
+pool, so sessions destroyed late (e.g. when io_context destroys pending
+handlers after the server object is gone) still return memory to a live pool.
+*/
+
+class BlockPool {
+ public:
+  explicit BlockPool(std::size_t maxCached = 4096) : maxCached_(maxCached) {}
+
+  BlockPool(const BlockPool&) = delete;
+  BlockPool& operator=(const BlockPool&) = delete;
+
+  ~BlockPool() {
+    for (void* block : free_) {
+      ::operator delete(block);
+    }
+  }
+
+  void* allocate(std::size_t size) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (blockSize_ == 0) {
+        blockSize_ = size;
+      }
+      if (size == blockSize_ && !free_.empty()) {
+        void* block = free_.back();
+        free_.pop_back();
+        ++reused_;
+        return block;
+      }
+      ++fresh_;
+    }
+    return ::operator new(size);
+  }
+
+  void deallocate(void* block, std::size_t size) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (size == blockSize_ && free_.size() < maxCached_) {
+        free_.push_back(block);
+        return;
+      }
+    }
+    ::operator delete(block);
+  }
+
+  // How many allocations were served from the free list vs operator new.
+  std::size_t reused() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return reused_;
+  }
+
+  std::size_t fresh() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fresh_;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::vector<void*> free_;
+  std::size_t blockSize_ = 0;
+  std::size_t maxCached_ = 0;
+  std::size_t reused_ = 0;
+  std::size_t fresh_ = 0;
+};
+
+template <typename T>
+class PoolAllocator {
+ public:
+  using value_type = T;
+
+  explicit PoolAllocator(std::shared_ptr<BlockPool> pool)
+      : pool_(std::move(pool)) {}
+
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>& other) noexcept : pool_(other.pool_) {}
+
+  T* allocate(std::size_t n) {
+    return static_cast<T*>(pool_->allocate(sizeof(T) * n));
+  }
+
+  void deallocate(T* p, std::size_t n) { pool_->deallocate(p, sizeof(T) * n); }
+
+  template <typename U>
+  bool operator==(const PoolAllocator<U>& other) const noexcept {
+    return pool_ == other.pool_;
+  }
+
+  template <typename U>
+  bool operator!=(const PoolAllocator<U>& other) const noexcept {
+    return pool_ != other.pool_;
+  }
+
+ private:
+  template <typename>
+  friend class PoolAllocator;
+
+  std::shared_ptr<BlockPool> pool_;
+};
+
+// Pool of shared_ptr-managed objects of type T.
+template <typename T>
+class SessionPool {
+ public:
+  explicit SessionPool(std::size_t maxCached = 4096)
+      : pool_(std::make_shared<BlockPool>(maxCached)) {}
+
+  template <typename... Args>
+  std::shared_ptr<T> make(Args&&... args) {
+    return std::allocate_shared<T>(PoolAllocator<T>(pool_),
+                                   std::forward<Args>(args)...);
+  }
+
+  const BlockPool& blocks() const { return *pool_; }
+
+ private:
+  std::shared_ptr<BlockPool> pool_;
+};
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+/*
+A minimal io_uring wrapper on top of the raw syscalls (no liburing needed).
+
+io_uring shares two ring buffers with the kernel:
+  - the submission queue (SQ): we fill in io_uring_sqe entries and bump the
+    tail; the kernel consumes from the head.
+  - the completion queue (CQ): the kernel appends io_uring_cqe entries and
+    bumps the tail; we consume from the head.
+Only io_uring_enter() crosses into the kernel, and one call can both submit
+a batch of SQEs and wait for completions. That is where the syscall saving
+over epoll + recvmsg/sendmsg comes from.
+
+Memory ordering: the tails we publish are release stores, the tails the
+kernel publishes are read with acquire loads (same as liburing).
+
+Only what the echo server needs is here: SQE/CQE handling, fixed buffer
+registration (for IORING_OP_WRITE_FIXED) and provided buffer rings (for
+multishot recv with IOSQE_BUFFER_SELECT).
+*/
+
+class Uring {
+ public:
+  explicit Uring(unsigned entries, unsigned flags = 0) {
+    io_uring_params p{};
+    p.flags = flags;
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+    if (fd_ < 0) {
+      throw std::system_error(errno, std::system_category(), "io_uring_setup");
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+      ::close(fd_);
+      throw std::runtime_error("io_uring: no IORING_FEAT_SINGLE_MMAP");
+    }
+
+    ringSize_ = std::max(p.sq_off.array + p.sq_entries * sizeof(unsigned),
+                         p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+    ring_ = mapOrThrow(ringSize_, IORING_OFF_SQ_RING);
+    sqesSize_ = p.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(mapOrThrow(sqesSize_, IORING_OFF_SQES));
+
+    auto* base = static_cast<char*>(ring_);
+    sqHead_ = reinterpret_cast<unsigned*>(base + p.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(base + p.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(base + p.sq_off.ring_mask);
+    sqEntries_ = p.sq_entries;
+    sqArray_ = reinterpret_cast<unsigned*>(base + p.sq_off.array);
+    cqHead_ = reinterpret_cast<unsigned*>(base + p.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(base + p.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(base + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(base + p.cq_off.cqes);
+    sqeTail_ = *sqTail_;
+  }
+
+  Uring(const Uring&) = delete;
+  Uring& operator=(const Uring&) = delete;
+
+  ~Uring() {
+    ::munmap(sqes_, sqesSize_);
+    ::munmap(ring_, ringSize_);
+    ::close(fd_);
+  }
+
+  int fd() const { return fd_; }
+
+  // Next free SQE (zeroed), submitting pending ones first if the SQ is full.
+  // Without SQPOLL the kernel consumes every SQE during io_uring_enter, so
+  // the SQ can only stay full if that failed (EINTR, or EBUSY while the CQ
+  // overflows); the caller gets an exception rather than an SQE that
+  // overwrites a pending one.
+  io_uring_sqe* getSqe() {
+    if (sqFull()) {
+      submit();
+      if (sqFull()) {
+        throw std::runtime_error("io_uring: submission queue full");
+      }
+    }
+    const unsigned index = sqeTail_ & sqMask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    ++sqeTail_;
+    return sqe;
+  }
+
+  // Publish pending SQEs and optionally wait for `waitFor` completions, in a
+  // single io_uring_enter.
+  int submit(unsigned waitFor = 0) {
+    const unsigned pending = sqeTail_ - *sqTail_;
+    __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+    if (pending == 0 && waitFor == 0) {
+      return 0;
+    }
+    ++enterCalls_;
+    int ret = static_cast<int>(
+        syscall(__NR_io_uring_enter, fd_, pending, waitFor,
+                waitFor ? IORING_ENTER_GETEVENTS : 0u, nullptr, 0));
+    if (ret < 0 && errno != EINTR && errno != EBUSY) {
+      throw std::system_error(errno, std::system_category(), "io_uring_enter");
+    }
+    return ret;
+  }
+
+  // Call f(const io_uring_cqe&) for every available completion.
+  template <typename F>
+  unsigned forEachCqe(F&& f) {
+    unsigned head = *cqHead_;
+    const unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    unsigned seen = 0;
+    for (; head != tail; ++head, ++seen) {
+      f(cqes_[head & cqMask_]);
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    return seen;
+  }
+
+  // Pin `iovecs` for IORING_OP_READ_FIXED/WRITE_FIXED (buf_index = position).
+  void registerBuffers(const std::vector<iovec>& iovecs) {
+    registerOrThrow(IORING_REGISTER_BUFFERS, iovecs.data(),
+                    static_cast<unsigned>(iovecs.size()));
+  }
+
+  void registerOrThrow(unsigned opcode, const void* arg, unsigned nrArgs) {
+    if (syscall(__NR_io_uring_register, fd_, opcode, arg, nrArgs) < 0) {
+      throw std::system_error(errno, std::system_category(),
+                              "io_uring_register");
+    }
+  }
+
+  // Number of io_uring_enter calls so far (the only syscalls on the data
+  // path).
+  std::uint64_t enterCalls() const { return enterCalls_; }
+
+ private:
+  bool sqFull() const {
+    return sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_;
+  }
+
+  void* mapOrThrow(std::size_t size, off_t offset) {
+    void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd_, offset);
+    if (p == MAP_FAILED) {
+      throw std::system_error(errno, std::system_category(), "mmap io_uring");
+    }
+    return p;
+  }
+
+  int fd_ = -1;
+  void* ring_ = nullptr;
+  std::size_t ringSize_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  std::size_t sqesSize_ = 0;
+  unsigned* sqHead_ = nullptr;
+  unsigned* sqTail_ = nullptr;
+  unsigned* sqArray_ = nullptr;
+  unsigned sqMask_ = 0;
+  unsigned sqEntries_ = 0;
+  unsigned sqeTail_ = 0;
+  unsigned* cqHead_ = nullptr;
+  unsigned* cqTail_ = nullptr;
+  unsigned cqMask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+  std::uint64_t enterCalls_ = 0;
+};
+
+/*
+Provided buffer ring (IORING_REGISTER_PBUF_RING, kernel 5.19+).
+
+The kernel picks a free buffer from this ring when a recv with
+IOSQE_BUFFER_SELECT completes, and reports its id in the CQE flags. The
+application hands the buffer back with recycle() once it has consumed the
+data. Combined with multishot recv this means no per-connection receive
+buffer and no re-arming syscall per read.
+*/
+class BufferRing {
+ public:
+  BufferRing(Uring& ring, std::uint16_t groupId, unsigned count,
+             unsigned bufferSize)
+      : ring_(ring),
+        groupId_(groupId),
+        mask_(count - 1),
+        bufferSize_(bufferSize),
+        storage_(static_cast<std::size_t>(count) * bufferSize) {
+    if (count == 0 || (count & (count - 1)) != 0 || count > 32768) {
+      throw std::invalid_argument("BufferRing: count must be a power of 2");
+    }
+    ringBytes_ = count * sizeof(io_uring_buf);
+    void* mem = ::mmap(nullptr, ringBytes_, PROT_READ | PROT_WRITE,
+                       MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (mem == MAP_FAILED) {
+      throw std::system_error(errno, std::system_category(), "mmap buf ring");
+    }
+    bufs_ = static_cast<io_uring_buf*>(mem);
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<std::uint64_t>(bufs_);
+    reg.ring_entries = count;
+    reg.bgid = groupId;
+    ring.registerOrThrow(IORING_REGISTER_PBUF_RING, &reg, 1);
+
+    for (unsigned bid = 0; bid < count; ++bid) {
+      add(static_cast<std::uint16_t>(bid), bid);
+    }
+    publish(count);
+  }
+
+  BufferRing(const BufferRing&) = delete;
+  BufferRing& operator=(const BufferRing&) = delete;
+
+  // Unregisters the ring before unmapping it, so the kernel never picks a
+  // buffer from freed memory. The Uring must outlive this object.
+  ~BufferRing() {
+    io_uring_buf_reg reg{};
+    reg.bgid = groupId_;
+    ::syscall(__NR_io_uring_register, ring_.fd(), IORING_UNREGISTER_PBUF_RING,
+              &reg, 1);
+    ::munmap(bufs_, ringBytes_);
+  }
+
+  std::uint16_t groupId() const { return groupId_; }
+  char* data(std::uint16_t bid) {
+    return storage_.data() + static_cast<std::size_t>(bid) * bufferSize_;
+  }
+
+  // Give buffer `bid` back to the kernel.
+  void recycle(std::uint16_t bid) {
+    add(bid, 0);
+    publish(1);
+  }
+
+ private:
+  void add(std::uint16_t bid, unsigned offset) {
+    io_uring_buf& buf = bufs_[(tail_ + offset) & mask_];
+    buf.addr = reinterpret_cast<std::uint64_t>(data(bid));
+    buf.len = bufferSize_;
+    buf.bid = bid;
+  }
+
+  void publish(unsigned added) {
+    tail_ = static_cast<std::uint16_t>(tail_ + added);
+    // the ring tail overlays bufs[0].resv, see struct io_uring_buf_ring
+    __atomic_store_n(&bufs_[0].resv, tail_, __ATOMIC_RELEASE);
+  }
+
+  Uring& ring_;
+  std::uint16_t groupId_ = 0;
+  unsigned mask_ = 0;
+  unsigned bufferSize_ = 0;
+  std::vector<char> storage_;
+  io_uring_buf* bufs_ = nullptr;
+  std::size_t ringBytes_ = 0;
+  std::uint16_t tail_ = 0;
+};
@@ -0,0 +1,95 @@
+#ifndef BACKPRESSURE_HPP_
+#define BACKPRESSURE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+/*
+Slow consumer handling for the per-session write queue.
+
+Every broadcast is appended to each participant's write queue. If a client
+stops reading, its queue used to grow forever. Now each queue has a high and a
+low watermark (counted in messages, each message being a fixed MsgT frame):
+
+  - once the queue reaches high_watermark the policy kicks in
+  - drop_oldest: silently discard the oldest queued messages until only
+                 low_watermark remain
+  - coalesce:    same, but the discarded run is replaced by a single notice
+                 telling the client how many messages it missed
+  - disconnect:  close the connection and release the whole queue
+
+The low watermark gives hysteresis: after trimming, a slow client gets
+(high - low) messages of slack before being trimmed again, instead of paying
+the policy on every single broadcast.
+
+The message currently being written is kept out of the queue, as async_write
+still references it and trimming a deque may move any of its elements.
+*/
+
+enum class SlowConsumerPolicy { drop_oldest, coalesce, disconnect };
+
+inline SlowConsumerPolicy parsePolicy(const std::string& name) {
+  if (name == "drop-oldest") return SlowConsumerPolicy::drop_oldest;
+  if (name == "coalesce") return SlowConsumerPolicy::coalesce;
+  if (name == "disconnect") return SlowConsumerPolicy::disconnect;
+  throw std::invalid_argument("unknown slow consumer policy: " + name);
+}
+
+struct BackpressureConfig {
+  std::size_t high_watermark = 1024;
+  std::size_t low_watermark = 256;
+  SlowConsumerPolicy policy = SlowConsumerPolicy::drop_oldest;
+};
+
+// Server-wide accounting shared by every session. Sessions update it from
+// their handlers; anyone may read it (e.g. the periodic metrics dump).
+class ChatMetrics {
+ public:
+  void onQueued(std::size_t bytes) {
+    auto now =
+        queued_bytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    auto peak = peak_queued_bytes_.load(std::memory_order_relaxed);
+    while (now > peak && !peak_queued_bytes_.compare_exchange_weak(
+                             peak, now, std::memory_order_relaxed)) {
+    }
+  }
+  void onReleased(std::size_t bytes) {
+    queued_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+  void onDropped(std::size_t msgs) {
+    dropped_msgs_.fetch_add(msgs, std::memory_order_relaxed);
+  }
+  void onCoalesced() {
+    coalesce_events_.fetch_add(1, std::memory_order_relaxed);
+  }
+  void onDisconnected() {
+    slow_disconnects_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::uint64_t queuedBytes() const { return queued_bytes_.load(); }
+  std::uint64_t peakQueuedBytes() const { return peak_queued_bytes_.load(); }
+  std::uint64_t droppedMsgs() const { return dropped_msgs_.load(); }
+  std::uint64_t coalesceEvents() const { return coalesce_events_.load(); }
+  std::uint64_t slowDisconnects() const { return slow_disconnects_.load(); }
+
+  friend std::ostream& operator<<(std::ostream& os, const ChatMetrics& m) {
+    return os << "queued_bytes=" << m.queuedBytes()
+              << " peak_queued_bytes=" << m.peakQueuedBytes()
+              << " dropped_msgs=" << m.droppedMsgs()
+              << " coalesce_events=" << m.coalesceEvents()
+              << " slow_disconnects=" << m.slowDisconnects();
+  }
+
+ private:
+  std::atomic<std::uint64_t> queued_bytes_{0};
+  std::atomic<std::uint64_t> peak_queued_bytes_{0};
+  std::atomic<std::uint64_t> dropped_msgs_{0};
+  std::atomic<std::uint64_t> coalesce_events_{0};
+  std::atomic<std::uint64_t> slow_disconnects_{0};
+};
+
+#endif /* BACKPRESSURE_HPP_ */
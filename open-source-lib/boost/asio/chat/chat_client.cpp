@@ -29,8 +29,10 @@ class ChatRoomClient {
         });
   }
 
+  // msg is copied into the handler: the caller reuses its buffer for the
+  // next line before the io thread gets to run writeImpl.
   void write(const MsgT& msg) {
-    io_service_.post([this, &msg]() { this->writeImpl(msg); });
+    io_service_.post([this, msg]() { this->writeImpl(msg); });
   }
 
   void close() {
@@ -0,0 +1,294 @@
+// Headless load generator for chat_server.
+//
+// Opens many connections from one process, spread over a few io_contexts
+// (one thread each). A subset of the connections send messages at a fixed
+// aggregate rate with the send time embedded in the text; every connection
+// reads the broadcasts and records the end-to-end delivery latency into a
+// per-thread LatencyHistogram. At the end the histograms are merged and the
+// send/delivery throughput and latency percentiles are printed.
+//
+// Sender and receivers live in the same process, so steady_clock stamps are
+// directly comparable. Broadcasts delivered from the room history (sent
+// before the measurement window) are ignored.
+//
+// e.g. against a local server:
+// >$./chat_server --metrics-interval 0 8888
+// >$./chat_loadgen --connections 2000 --senders 20 --rate 2000 --duration 10
+
+#include <array>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "latency_histogram.h"
+#include "protocol.hpp"
+
+using boost::asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+using MsgT = std::array<char, MAX_IP_PACK_SIZE>;
+
+namespace {
+struct Options {
+  std::string host = "127.0.0.1";
+  std::string port = "8888";
+  int connections = 1000;
+  int senders = 10;
+  int threads = 2;
+  double rate = 1000;  // messages per second, all senders together
+  int duration = 10;   // seconds of measurement
+};
+
+// Per io_context, only touched by that io_context's thread.
+struct Stats {
+  LatencyHistogram latency;
+  std::uint64_t sent = 0;
+  std::uint64_t send_skipped = 0;  // tick fired while previous write pending
+  std::uint64_t delivered = 0;
+  std::uint64_t errors = 0;
+};
+
+std::atomic<int> g_connected{0};
+std::atomic<Clock::rep> g_measure_start{
+    std::numeric_limits<Clock::rep>::max()};
+
+class LoadConnection {
+ public:
+  LoadConnection(boost::asio::io_context& io, Stats& stats, int id)
+      : socket_(io), timer_(io), stats_(stats) {
+    nickname_.fill('\0');
+    std::snprintf(nickname_.data(), nickname_.size(), "lg%d", id);
+  }
+
+  void start(const tcp::resolver::results_type& endpoints,
+             Clock::duration send_interval) {
+    send_interval_ = send_interval;
+    boost::asio::async_connect(
+        socket_, endpoints, [this](const auto& error, const auto&) {
+          if (error) {
+            ++stats_.errors;
+            return;
+          }
+          socket_.set_option(tcp::no_delay(true));
+          boost::asio::async_write(
+              socket_, boost::asio::buffer(nickname_),
+              [this](const auto& error, std::size_t) {
+                if (error) {
+                  ++stats_.errors;
+                  return;
+                }
+                ++g_connected;
+                read();
+                if (send_interval_ != Clock::duration::zero()) {
+                  next_send_ = Clock::now() + send_interval_;
+                  scheduleSend();
+                }
+              });
+        });
+  }
+
+ private:
+  void read() {
+    boost::asio::async_read(
+        socket_, boost::asio::buffer(read_msg_),
+        [this](const boost::system::error_code& error, std::size_t) {
+          if (error) {
+            ++stats_.errors;
+            return;
+          }
+          read_msg_.back() = '\0';
+          if (const char* p = std::strstr(read_msg_.data(), "t=")) {
+            const Clock::rep stamp = std::atoll(p + 2);
+            if (stamp >= g_measure_start.load(std::memory_order_relaxed)) {
+              stats_.latency.record(Clock::now().time_since_epoch() -
+                                    Clock::duration(stamp));
+              ++stats_.delivered;
+            }
+          }
+          read();
+        });
+  }
+
+  void scheduleSend() {
+    timer_.expires_at(next_send_);
+    timer_.async_wait([this](const boost::system::error_code& error) {
+      if (error) {
+        return;
+      }
+      next_send_ += send_interval_;
+      if (writing_) {
+        ++stats_.send_skipped;
+      } else if (Clock::now().time_since_epoch().count() >=
+                 g_measure_start.load(std::memory_order_relaxed)) {
+        send();
+      }
+      scheduleSend();
+    });
+  }
+
+  void send() {
+    writing_ = true;
+    write_msg_.fill('\0');
+    std::snprintf(write_msg_.data(), MAX_IP_PACK_SIZE - PADDING - MAX_NICKNAME,
+                  "seq=%llu t=%lld",
+                  static_cast<unsigned long long>(seq_++),
+                  static_cast<long long>(
+                      Clock::now().time_since_epoch().count()));
+    boost::asio::async_write(
+        socket_, boost::asio::buffer(write_msg_),
+        [this](const boost::system::error_code& error, std::size_t) {
+          writing_ = false;
+          if (error) {
+            ++stats_.errors;
+            return;
+          }
+          ++stats_.sent;
+        });
+  }
+
+  tcp::socket socket_;
+  boost::asio::steady_timer timer_;
+  Stats& stats_;
+  std::array<char, MAX_NICKNAME> nickname_;
+  MsgT read_msg_;
+  MsgT write_msg_;
+  Clock::duration send_interval_{};
+  Clock::time_point next_send_{};
+  std::uint64_t seq_ = 0;
+  bool writing_ = false;
+};
+
+void usage() {
+  std::cerr << "Usage: chat_loadgen [--host <host>] [--port <port>]\n"
+               "                    [--connections <n>] [--senders <n>]\n"
+               "                    [--threads <n>] [--rate <msgs/sec>]\n"
+               "                    [--duration <sec>]\n";
+}
+
+bool parse(int argc, char* argv[], Options& opt) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 == argc) return false;
+    std::string value = argv[++i];
+    if (arg == "--host") {
+      opt.host = value;
+    } else if (arg == "--port") {
+      opt.port = value;
+    } else if (arg == "--connections") {
+      opt.connections = std::stoi(value);
+    } else if (arg == "--senders") {
+      opt.senders = std::stoi(value);
+    } else if (arg == "--threads") {
+      opt.threads = std::stoi(value);
+    } else if (arg == "--rate") {
+      opt.rate = std::stod(value);
+    } else if (arg == "--duration") {
+      opt.duration = std::stoi(value);
+    } else {
+      return false;
+    }
+  }
+  return opt.connections > 0 && opt.threads > 0 && opt.senders >= 0 &&
+         opt.senders <= opt.connections && opt.rate > 0;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options opt;
+  try {
+    if (!parse(argc, argv, opt)) {
+      usage();
+      return 1;
+    }
+  } catch (std::exception& e) {
+    usage();
+    return 1;
+  }
+
+  std::vector<std::unique_ptr<boost::asio::io_context>> ios;
+  std::vector<Stats> stats(opt.threads);
+  for (int i = 0; i < opt.threads; ++i) {
+    ios.push_back(std::make_unique<boost::asio::io_context>(1));
+  }
+
+  tcp::resolver resolver(*ios.front());
+  const auto endpoints = resolver.resolve(opt.host, opt.port);
+
+  const auto send_interval =
+      opt.senders == 0
+          ? Clock::duration::zero()
+          : std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(opt.senders / opt.rate));
+
+  std::vector<std::unique_ptr<LoadConnection>> connections;
+  for (int i = 0; i < opt.connections; ++i) {
+    const int t = i % opt.threads;
+    connections.push_back(
+        std::make_unique<LoadConnection>(*ios[t], stats[t], i));
+    connections.back()->start(
+        endpoints, i < opt.senders ? send_interval : Clock::duration::zero());
+  }
+
+  std::vector<std::thread> threads;
+  std::vector<boost::asio::executor_work_guard<
+      boost::asio::io_context::executor_type>>
+      work;
+  for (auto& io : ios) {
+    work.push_back(boost::asio::make_work_guard(*io));
+    threads.emplace_back([&io] { io->run(); });
+  }
+
+  // wait for the connections to be established, then open the window
+  const auto connect_deadline = Clock::now() + std::chrono::seconds(30);
+  while (g_connected.load() < opt.connections &&
+         Clock::now() < connect_deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::printf("connected %d/%d\n", g_connected.load(), opt.connections);
+
+  const auto start = Clock::now();
+  g_measure_start = start.time_since_epoch().count();
+  std::this_thread::sleep_for(std::chrono::seconds(opt.duration));
+  const auto elapsed =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  for (auto& io : ios) {
+    io->stop();
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  Stats total;
+  for (const auto& s : stats) {
+    total.latency.merge(s.latency);
+    total.sent += s.sent;
+    total.send_skipped += s.send_skipped;
+    total.delivered += s.delivered;
+    total.errors += s.errors;
+  }
+
+  std::printf(
+      "connections=%d senders=%d threads=%d target_rate=%.0f/s "
+      "duration=%.1fs\n",
+      opt.connections, opt.senders, opt.threads, opt.rate, elapsed);
+  std::printf(
+      "sent=%llu (%.0f/s) skipped=%llu delivered=%llu (%.0f/s, fan-out "
+      "%.1f) errors=%llu\n",
+      static_cast<unsigned long long>(total.sent), total.sent / elapsed,
+      static_cast<unsigned long long>(total.send_skipped),
+      static_cast<unsigned long long>(total.delivered),
+      total.delivered / elapsed,
+      total.sent ? static_cast<double>(total.delivered) / total.sent : 0.0,
+      static_cast<unsigned long long>(total.errors));
+  total.latency.print("delivery latency");
+  return 0;
+}
@@ -0,0 +1,140 @@
+#ifndef CHAT_ROOM_HPP_
+#define CHAT_ROOM_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "protocol.hpp"
+
+using MsgT = std::array<char, MAX_IP_PACK_SIZE>;
+
+class IParticipant {
+ public:
+  virtual ~IParticipant() {}
+  virtual void onMessage(MsgT& msg) = 0;
+  // Kept inline in the participant (e.g. the session's nickname buffer), so
+  // the room never needs a side table to format a message.
+  virtual std::string_view nickname() const = 0;
+};
+
+using ParticipantSPtr = std::shared_ptr<IParticipant>;
+
+inline std::string getTimestamp() {
+  time_t t = time(0);  // get time now
+  struct tm* now = localtime(&t);
+  std::stringstream ss;
+  ss << '[' << (now->tm_year + 1900) << '-' << std::setfill('0') << std::setw(2)
+     << (now->tm_mon + 1) << '-' << std::setfill('0') << std::setw(2)
+     << now->tm_mday << ' ' << std::setfill('0') << std::setw(2) << now->tm_hour
+     << ":" << std::setfill('0') << std::setw(2) << now->tm_min << ":"
+     << std::setfill('0') << std::setw(2) << now->tm_sec << "] ";
+
+  return ss.str();
+}
+
+/*
+Participants live in a dense vector that broadcast walks front to back, so the
+fan-out is a linear scan over contiguous pointers instead of a walk over
+unordered_set buckets.
+
+Each participant is handed a stable integer id on enter(). The id indexes
+slot_of_, which tells where the participant currently sits in the dense
+vector; leave() swaps the last participant into the hole and patches its
+slot, so both enter and leave are O(1) and ids never move. Freed ids are
+recycled through a free list.
+
+A participant must call leave() at most once per id: an id is reused by the
+next participant that enters.
+*/
+class ChatRoom {
+ public:
+  using ParticipantId = std::uint32_t;
+  static constexpr ParticipantId invalid_id =
+      std::numeric_limits<ParticipantId>::max();
+
+  ParticipantId enter(ParticipantSPtr participant) {
+    ParticipantId id;
+    if (!free_ids_.empty()) {
+      id = free_ids_.back();
+      free_ids_.pop_back();
+    } else {
+      id = static_cast<ParticipantId>(slot_of_.size());
+      slot_of_.push_back(invalid_id);
+    }
+    slot_of_[id] = static_cast<ParticipantId>(participants_.size());
+    participants_.push_back(participant);
+    ids_.push_back(id);
+
+    std::for_each(recent_msgs_.begin(), recent_msgs_.end(),
+                  [&participant](auto& msg) { participant->onMessage(msg); });
+    return id;
+  }
+
+  void leave(ParticipantId id) {
+    if (id >= slot_of_.size() || slot_of_[id] == invalid_id) {
+      return;
+    }
+    const ParticipantId slot = slot_of_[id];
+    const auto last = static_cast<ParticipantId>(participants_.size() - 1);
+    if (slot != last) {
+      participants_[slot] = std::move(participants_[last]);
+      ids_[slot] = ids_[last];
+      slot_of_[ids_[slot]] = slot;
+    }
+    participants_.pop_back();
+    ids_.pop_back();
+    slot_of_[id] = invalid_id;
+    free_ids_.push_back(id);
+  }
+
+  void broadcast(MsgT& msg, const IParticipant& sender) {
+    std::string timestamp = getTimestamp();
+    std::string_view nickname = sender.nickname();
+    MsgT formatted_msg;
+
+    // boundary correctness is guarded by protocol.hpp; the body is clamped
+    // anyway in case a client sends an unterminated message
+    char* out = formatted_msg.data();
+    out = std::copy(timestamp.begin(), timestamp.end(), out);
+    out = std::copy(nickname.begin(), nickname.end(), out);
+    const std::size_t room =
+        formatted_msg.size() - 1 - (out - formatted_msg.data());
+    out = std::copy_n(msg.data(), strnlen(msg.data(), room), out);
+    *out = '\0';
+
+    recent_msgs_.push_back(formatted_msg);
+    while (recent_msgs_.size() > max_recent_msgs) {
+      recent_msgs_.pop_front();
+    }
+
+    for (auto& p : participants_) {
+      p->onMessage(formatted_msg);
+    }
+  }
+
+  std::size_t size() const { return participants_.size(); }
+
+ private:
+  enum { max_recent_msgs = 100 };
+  // dense, iterated on every broadcast
+  std::vector<ParticipantSPtr> participants_;
+  // ids_[slot] is the id of participants_[slot]
+  std::vector<ParticipantId> ids_;
+  // slot_of_[id] is the position in participants_, or invalid_id if free
+  std::vector<ParticipantId> slot_of_;
+  std::vector<ParticipantId> free_ids_;
+  std::deque<MsgT> recent_msgs_;
+};
+
+#endif /* CHAT_ROOM_HPP_ */
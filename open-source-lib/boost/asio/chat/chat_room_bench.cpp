@@ -0,0 +1,97 @@
+// Broadcast fan-out cost of ChatRoom vs. the previous layout
+// (unordered_set<shared_ptr> + unordered_map<shared_ptr, std::string> name
+// table with a nickname hash lookup on every broadcast).
+//
+// Participants are in-memory stubs, so this only measures the room side:
+// formatting once plus iterating every participant.
+
+#include <benchmark/benchmark.h>
+
+#include <unordered_map>
+#include <unordered_set>
+
+#include "chat_room.hpp"
+
+namespace {
+class StubParticipant : public IParticipant {
+ public:
+  void onMessage(MsgT& msg) override {
+    ++received_;
+    benchmark::DoNotOptimize(msg.data());
+  }
+  std::string_view nickname() const override { return "stub: "; }
+
+ private:
+  std::size_t received_ = 0;
+};
+
+class LegacyChatRoom {
+ public:
+  void enter(ParticipantSPtr participant, const std::string& nickname) {
+    participants_.insert(participant);
+    name_table_[participant] = nickname;
+  }
+
+  void broadcast(MsgT& msg, ParticipantSPtr participant) {
+    std::string timestamp = getTimestamp();
+    std::string nickname = name_table_[participant];
+    MsgT formatted_msg;
+    strcpy(formatted_msg.data(), timestamp.c_str());
+    strcat(formatted_msg.data(), nickname.c_str());
+    strcat(formatted_msg.data(), msg.data());
+    for (auto& p : participants_) {
+      p->onMessage(formatted_msg);
+    }
+  }
+
+ private:
+  std::unordered_set<ParticipantSPtr> participants_;
+  std::unordered_map<ParticipantSPtr, std::string> name_table_;
+};
+
+MsgT makeMsg() {
+  MsgT msg{};
+  strcpy(msg.data(), "hello everyone");
+  return msg;
+}
+
+void BM_LegacyBroadcast(benchmark::State& state) {
+  LegacyChatRoom room;
+  std::vector<ParticipantSPtr> people;
+  for (int i = 0; i < state.range(0); ++i) {
+    people.push_back(std::make_shared<StubParticipant>());
+    room.enter(people.back(), "stub: ");
+  }
+  MsgT msg = makeMsg();
+  for (auto _ : state) {
+    room.broadcast(msg, people.front());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_SlotBroadcast(benchmark::State& state) {
+  ChatRoom room;
+  std::vector<ParticipantSPtr> people;
+  for (int i = 0; i < state.range(0); ++i) {
+    people.push_back(std::make_shared<StubParticipant>());
+    room.enter(people.back());
+  }
+  // punch some holes and refill them so the dense vector has been shuffled
+  for (ChatRoom::ParticipantId id = 0; id < people.size(); id += 7) {
+    room.leave(id);
+  }
+  for (std::size_t i = 0; i < people.size(); i += 7) {
+    room.enter(people[i]);
+  }
+  MsgT msg = makeMsg();
+  for (auto _ : state) {
+    room.broadcast(msg, *people.front());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+}  // namespace
+
+BENCHMARK(BM_LegacyBroadcast)->Arg(100)->Arg(1000)->Arg(10000);
+BENCHMARK(BM_SlotBroadcast)->Arg(100)->Arg(1000)->Arg(10000);
+
+BENCHMARK_MAIN();
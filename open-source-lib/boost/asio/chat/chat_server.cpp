@@ -1,48 +1,23 @@
 /* Modified from: https://github.com/botaojia/chat */
 
-#include <algorithm>
-#include <array>
 #include <boost/asio.hpp>
 #include <boost/thread/thread.hpp>
-#include <ctime>
-#include <deque>
-#include <iomanip>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include <list>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
-#include <unordered_map>
-#include <unordered_set>
+#include <vector>
 
-#include "protocol.hpp"
+#include "backpressure.hpp"
+#include "chat_server.hpp"
 
 using boost::asio::ip::tcp;
-using MsgT = std::array<char, MAX_IP_PACK_SIZE>;
-
-class IParticipant {
- public:
-  virtual ~IParticipant() {}
-  virtual void onMessage(MsgT& msg) = 0;
-};
-
-using ParticipantSPtr = std::shared_ptr<IParticipant>;
 
 namespace {
-std::string getTimestamp() {
-  time_t t = time(0);  // get time now
-  struct tm* now = localtime(&t);
-  std::stringstream ss;
-  ss << '[' << (now->tm_year + 1900) << '-' << std::setfill('0') << std::setw(2)
-     << (now->tm_mon + 1) << '-' << std::setfill('0') << std::setw(2)
-     << now->tm_mday << ' ' << std::setfill('0') << std::setw(2) << now->tm_hour
-     << ":" << std::setfill('0') << std::setw(2) << now->tm_min << ":"
-     << std::setfill('0') << std::setw(2) << now->tm_sec << "] ";
-
-  return ss.str();
-}
-
 class WorkerThread {
  public:
   static void run(std::shared_ptr<boost::asio::io_service> io_service) {
@@ -66,189 +41,63 @@ class WorkerThread {
 };
 
 std::mutex WorkerThread::m;
-}  // namespace
-
-class ChatRoom {
- public:
-  void enter(ParticipantSPtr participant, const std::string& nickname) {
-    participants_.insert(participant);
-    name_table_[participant] = nickname;
-    std::for_each(recent_msgs_.begin(), recent_msgs_.end(),
-                  [participant](auto& msg) { participant->onMessage(msg); });
-  }
-
-  void leave(ParticipantSPtr participant) {
-    participants_.erase(participant);
-    name_table_.erase(participant);
-  }
-
-  void broadcast(MsgT& msg, ParticipantSPtr participant) {
-    std::string timestamp = getTimestamp();
-    std::string nickname = getNickname(participant);
-    MsgT formatted_msg;
-
-    // boundary correctness is guarded by protocol.hpp
-    strcpy(formatted_msg.data(), timestamp.c_str());
-    strcat(formatted_msg.data(), nickname.c_str());
-    strcat(formatted_msg.data(), msg.data());
-
-    recent_msgs_.push_back(formatted_msg);
-    while (recent_msgs_.size() > max_recent_msgs) {
-      recent_msgs_.pop_front();
-    }
 
-    std::for_each(participants_.begin(), participants_.end(),
-                  [&formatted_msg](auto& p) { p->onMessage(formatted_msg); });
-  }
-
-  std::string getNickname(ParticipantSPtr participant) {
-    return name_table_[participant];
-  }
-
- private:
-  enum { max_recent_msgs = 100 };
-  std::unordered_set<ParticipantSPtr> participants_;
-  std::unordered_map<ParticipantSPtr, std::string> name_table_;
-  std::deque<MsgT> recent_msgs_;
-};
-
-class SessionPerPerson : public IParticipant,
-                         public std::enable_shared_from_this<SessionPerPerson> {
- public:
-  SessionPerPerson(boost::asio::io_service& io_service,
-                   boost::asio::io_service::strand& strand, ChatRoom& room)
-      : socket_(io_service), strand_(strand), room_(room) {}
-
-  tcp::socket& socket() { return socket_; }
-
-  void start() {
-    boost::asio::async_read(
-        socket_, boost::asio::buffer(nickname_, nickname_.size()),
-        strand_.wrap([self = shared_from_this()](const auto& error,
-                                                 const auto& byteTransferred) {
-          self->nicknameHandler(error);
-        }));
-  }
-
-  void onMessage(MsgT& msg) {
-    bool write_in_progress = !write_msgs_.empty();
-    write_msgs_.push_back(msg);
-    if (!write_in_progress) {
-      boost::asio::async_write(
-          socket_,
-          boost::asio::buffer(write_msgs_.front(), write_msgs_.front().size()),
-          strand_.wrap([self = shared_from_this()](
-                           const auto& error, const auto& byteTransferred) {
-            self->writeHandler(error);
-          }));
-    }
-  }
-
- private:
-  void nicknameHandler(const boost::system::error_code& error) {
-    if (strlen(nickname_.data()) <= MAX_NICKNAME - 2) {
-      strcat(nickname_.data(), ": ");
-    } else {
-      // cut off nickname if too long
-      nickname_[MAX_NICKNAME - 2] = ':';
-      nickname_[MAX_NICKNAME - 1] = ' ';
-    }
-
-    room_.enter(shared_from_this(), std::string(nickname_.data()));
-
-    boost::asio::async_read(
-        socket_, boost::asio::buffer(read_msg_, read_msg_.size()),
-        strand_.wrap([self = shared_from_this()](const auto& error,
-                                                 const auto& byteTransferred) {
-          self->readHandler(error);
-        }));
-  }
-
-  void readHandler(const boost::system::error_code& error) {
-    if (!error) {
-      room_.broadcast(read_msg_, shared_from_this());
-
-      boost::asio::async_read(
-          socket_, boost::asio::buffer(read_msg_, read_msg_.size()),
-          strand_.wrap([self = shared_from_this()](
-                           const auto& error, const auto& byteTransferred) {
-            self->readHandler(error);
-          }));
-    } else {
-      room_.leave(shared_from_this());
-    }
-  }
-
-  void writeHandler(const boost::system::error_code& error) {
-    if (!error) {
-      write_msgs_.pop_front();
-
-      if (!write_msgs_.empty()) {
-        boost::asio::async_write(
-            socket_,
-            boost::asio::buffer(write_msgs_.front(),
-                                write_msgs_.front().size()),
-            strand_.wrap([self = shared_from_this()](
-                             const auto& error, const auto& byteTransferred) {
-              self->writeHandler(error);
-            }));
-      }
-    } else {
-      room_.leave(shared_from_this());
-    }
-  }
-
-  tcp::socket socket_;
-  boost::asio::io_service::strand& strand_;
-  ChatRoom& room_;
-  std::array<char, MAX_NICKNAME> nickname_;
-  MsgT read_msg_;
-  std::deque<MsgT> write_msgs_;
-};
-
-class ChatRoomServer {
- public:
-  ChatRoomServer(boost::asio::io_service& io_service,
-                 boost::asio::io_service::strand& strand,
-                 const tcp::endpoint& endpoint)
-      : io_service_(io_service),
-        strand_(strand),
-        acceptor_(io_service, endpoint) {
-    run();
-  }
-
- private:
-  void run() {
-    std::shared_ptr<SessionPerPerson> new_participant(
-        new SessionPerPerson(io_service_, strand_, room_));
-    acceptor_.async_accept(
-        new_participant->socket(),
-        strand_.wrap([this, new_participant](const auto& error) {
-          this->onAccept(new_participant, error);
-        }));
-  }
+void usage() {
+  std::cerr << "Usage: chat_server [--high <msgs>] [--low <msgs>]\n"
+               "                   [--policy drop-oldest|coalesce|disconnect]\n"
+               "                   [--metrics-interval <sec>]\n"
+               "                   <port> [<port> ...]\n";
+}
 
-  void onAccept(std::shared_ptr<SessionPerPerson> new_participant,
-                const boost::system::error_code& error) {
-    if (!error) {
-      new_participant->start();
+// Periodically dump the server-wide queue accounting to stdout.
+void scheduleMetricsDump(boost::asio::steady_timer& timer,
+                         std::chrono::seconds interval,
+                         const ChatMetrics& metrics) {
+  timer.expires_after(interval);
+  timer.async_wait([&timer, interval, &metrics](const auto& error) {
+    if (error) {
+      return;
     }
-
-    run();
-  }
-
-  boost::asio::io_service& io_service_;
-  boost::asio::io_service::strand& strand_;
-  tcp::acceptor acceptor_;
-  ChatRoom room_;
-};
+    std::cout << "[metrics] " << metrics << std::endl;
+    scheduleMetricsDump(timer, interval, metrics);
+  });
+}
+}  // namespace
 
 //----------------------------------------------------------------------
 
 int main(int argc, char* argv[]) {
   try {
-    if (argc < 2) {
-      std::cerr << "Usage: chat_server <port> [<port> ...]\n";
+    BackpressureConfig config;
+    int metrics_interval = 10;
+    std::vector<unsigned short> ports;
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if (arg.rfind("--", 0) == 0) {
+        if (i + 1 == argc) {
+          usage();
+          return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--high") {
+          config.high_watermark = std::stoul(value);
+        } else if (arg == "--low") {
+          config.low_watermark = std::stoul(value);
+        } else if (arg == "--policy") {
+          config.policy = parsePolicy(value);
+        } else if (arg == "--metrics-interval") {
+          metrics_interval = std::stoi(value);
+        } else {
+          usage();
+          return 1;
+        }
+      } else {
+        ports.push_back(static_cast<unsigned short>(std::atoi(argv[i])));
+      }
+    }
+    if (ports.empty() || config.high_watermark < 2 ||
+        config.low_watermark >= config.high_watermark) {
+      usage();
       return 1;
     }
 
@@ -262,10 +111,17 @@ int main(int argc, char* argv[]) {
     std::cout << "[" << std::this_thread::get_id() << "]"
               << "server starts" << std::endl;
 
+    ChatMetrics metrics;
     std::list<ChatRoomServer> servers;
-    for (int i = 1; i < argc; ++i) {
-      tcp::endpoint endpoint(tcp::v4(), std::atoi(argv[i]));
-      servers.emplace_back(*io_service, *strand, endpoint);
+    for (auto port : ports) {
+      tcp::endpoint endpoint(tcp::v4(), port);
+      servers.emplace_back(*io_service, *strand, endpoint, config, metrics);
+    }
+
+    boost::asio::steady_timer metrics_timer(*io_service);
+    if (metrics_interval > 0) {
+      scheduleMetricsDump(metrics_timer, std::chrono::seconds(metrics_interval),
+                          metrics);
     }
 
     boost::thread_group workers;
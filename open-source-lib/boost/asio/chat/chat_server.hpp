@@ -0,0 +1,326 @@
+#ifndef CHAT_SERVER_HPP_
+#define CHAT_SERVER_HPP_
+
+#include <algorithm>
+#include <array>
+#include <boost/asio.hpp>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "backpressure.hpp"
+#include "chat_room.hpp"
+#include "handler_memory.h"
+#include "protocol.hpp"
+#include "session_pool.h"
+
+class SessionPerPerson : public IParticipant,
+                         public std::enable_shared_from_this<SessionPerPerson> {
+ public:
+  SessionPerPerson(boost::asio::io_service& io_service,
+                   boost::asio::io_service::strand& strand, ChatRoom& room,
+                   const BackpressureConfig& config, ChatMetrics& metrics)
+      : socket_(io_service),
+        strand_(strand),
+        room_(room),
+        config_(config),
+        metrics_(metrics) {}
+
+  ~SessionPerPerson() { metrics_.onReleased(queued() * sizeof(MsgT)); }
+
+  boost::asio::ip::tcp::socket& socket() { return socket_; }
+
+  void start() {
+    boost::asio::async_read(
+        socket_, boost::asio::buffer(nickname_, nickname_.size()),
+        wrap(read_memory_, [self = shared_from_this()](
+                               const auto& error, const auto& byteTransferred) {
+          self->nicknameHandler(error);
+        }));
+  }
+
+  std::string_view nickname() const override {
+    return std::string_view(nickname_.data(),
+                            strnlen(nickname_.data(), nickname_.size()));
+  }
+
+  // Closes the socket; must run on the strand. The pending read and write
+  // complete with operation_aborted, and the read handler leaves the room.
+  void close() {
+    closing_ = true;
+    boost::system::error_code ignored;
+    socket_.close(ignored);
+  }
+
+  void onMessage(MsgT& msg) override {
+    if (closing_) {
+      return;
+    }
+    write_msgs_.push_back(msg);
+    metrics_.onQueued(sizeof(MsgT));
+    if (queued() >= config_.high_watermark) {
+      onHighWatermark();
+    }
+    if (!writing_ && !closing_) {
+      startWrite();
+    }
+  }
+
+ private:
+  void nicknameHandler(const boost::system::error_code& error) {
+    if (error) {
+      return;  // never entered the room
+    }
+    if (strnlen(nickname_.data(), nickname_.size()) < MAX_NICKNAME - 2) {
+      strcat(nickname_.data(), ": ");
+    } else {
+      // cut off nickname if too long
+      nickname_[MAX_NICKNAME - 2] = ':';
+      nickname_[MAX_NICKNAME - 1] = ' ';
+    }
+
+    room_id_ = room_.enter(shared_from_this());
+
+    boost::asio::async_read(
+        socket_, boost::asio::buffer(read_msg_, read_msg_.size()),
+        wrap(read_memory_, [self = shared_from_this()](
+                               const auto& error, const auto& byteTransferred) {
+          self->readHandler(error);
+        }));
+  }
+
+  void readHandler(const boost::system::error_code& error) {
+    if (!error) {
+      room_.broadcast(read_msg_, *this);
+
+      boost::asio::async_read(
+          socket_, boost::asio::buffer(read_msg_, read_msg_.size()),
+          wrap(read_memory_, [self = shared_from_this()](
+                                 const auto& error,
+                                 const auto& byteTransferred) {
+            self->readHandler(error);
+          }));
+    } else {
+      leaveRoom();
+    }
+  }
+
+  void startWrite() {
+    write_msg_ = write_msgs_.front();
+    write_msgs_.pop_front();
+    writing_ = true;
+    boost::asio::async_write(
+        socket_, boost::asio::buffer(write_msg_, write_msg_.size()),
+        wrap(write_memory_, [self = shared_from_this()](
+                                const auto& error,
+                                const auto& byteTransferred) {
+          self->writeHandler(error);
+        }));
+  }
+
+  void writeHandler(const boost::system::error_code& error) {
+    if (!error) {
+      writing_ = false;
+      metrics_.onReleased(sizeof(MsgT));
+
+      if (!write_msgs_.empty()) {
+        startWrite();
+      }
+    } else {
+      leaveRoom();
+    }
+  }
+
+  // See backpressure.hpp for the policies. The frame async_write is working
+  // on is in write_msg_, out of the queue's reach: erasing from a deque may
+  // move or free any element, the front included.
+  void onHighWatermark() {
+    switch (config_.policy) {
+      case SlowConsumerPolicy::disconnect:
+        disconnect();
+        return;
+      case SlowConsumerPolicy::drop_oldest:
+        trimTo(config_.low_watermark, false);
+        return;
+      case SlowConsumerPolicy::coalesce:
+        trimTo(config_.low_watermark, true);
+        return;
+    }
+  }
+
+  // Drops the oldest queued frames until `target` are left, counting the one
+  // being written.
+  void trimTo(std::size_t target, bool leave_notice) {
+    target = std::max<std::size_t>(target, 1);
+    if (queued() <= target) {
+      return;
+    }
+    const std::size_t dropped = queued() - target;
+    write_msgs_.erase(write_msgs_.begin(), write_msgs_.begin() + dropped);
+    metrics_.onReleased(dropped * sizeof(MsgT));
+    metrics_.onDropped(dropped);
+    if (leave_notice) {
+      MsgT notice;
+      std::snprintf(notice.data(), notice.size(),
+                    "*** %zu messages skipped, connection too slow ***",
+                    dropped);
+      write_msgs_.push_front(notice);
+      metrics_.onQueued(sizeof(MsgT));
+      metrics_.onCoalesced();
+    }
+  }
+
+  void disconnect() {
+    closing_ = true;
+    metrics_.onDisconnected();
+    if (!write_msgs_.empty()) {
+      metrics_.onDropped(write_msgs_.size());
+      metrics_.onReleased(write_msgs_.size() * sizeof(MsgT));
+      write_msgs_.clear();
+    }
+    // Don't leave the room from here: we are inside ChatRoom::broadcast's
+    // loop. The pending read fails once the socket is closed and its handler
+    // does the leaveRoom().
+    boost::system::error_code ignored;
+    socket_.close(ignored);
+  }
+
+  // Frames held by the session: the queue and the one being written.
+  std::size_t queued() const { return write_msgs_.size() + (writing_ ? 1 : 0); }
+
+  // Both the read and the write path may notice the connection is gone; the
+  // room id must only be released once since the room recycles it.
+  void leaveRoom() {
+    room_.leave(room_id_);
+    room_id_ = ChatRoom::invalid_id;
+  }
+
+  // Serialize through the shared strand and allocate the handler from one of
+  // the per-session arenas. At most one read and one write are in flight.
+  template <typename Handler>
+  boost::asio::executor_binder<CustomAllocHandler<std::decay_t<Handler>>,
+                               boost::asio::io_service::strand>
+  wrap(HandlerMemory& memory, Handler&& handler) {
+    return boost::asio::bind_executor(
+        strand_,
+        makeCustomAllocHandler(memory, std::forward<Handler>(handler)));
+  }
+
+  boost::asio::ip::tcp::socket socket_;
+  boost::asio::io_service::strand& strand_;
+  ChatRoom& room_;
+  const BackpressureConfig& config_;
+  ChatMetrics& metrics_;
+  bool closing_ = false;
+  ChatRoom::ParticipantId room_id_ = ChatRoom::invalid_id;
+  std::array<char, MAX_NICKNAME> nickname_;
+  MsgT read_msg_;
+  // the frame being written, and the ones waiting behind it
+  MsgT write_msg_;
+  bool writing_ = false;
+  std::deque<MsgT> write_msgs_;
+  HandlerMemory read_memory_;
+  HandlerMemory write_memory_;
+};
+
+// The pending accept is allocated from accept_memory_ and sessions from
+// session_pool_, and sessions refer to room_. Call stop() and let the
+// io_service run out of work (or restart() and run() it after stopping it)
+// before the server is destroyed; the io_service usually outlives the server
+// and would otherwise destroy the queued operations after it.
+class ChatRoomServer {
+ public:
+  ChatRoomServer(boost::asio::io_service& io_service,
+                 boost::asio::io_service::strand& strand,
+                 const boost::asio::ip::tcp::endpoint& endpoint,
+                 const BackpressureConfig& config, ChatMetrics& metrics)
+      : io_service_(io_service),
+        strand_(strand),
+        acceptor_(io_service, endpoint),
+        port_(acceptor_.local_endpoint().port()),
+        config_(config),
+        metrics_(metrics) {
+    run();
+  }
+
+  unsigned short port() const { return port_; }
+
+  // Stops accepting and closes every session, on the strand. May be called
+  // from any thread.
+  void stop() {
+    boost::asio::dispatch(strand_, [this] {
+      stopped_ = true;
+      boost::system::error_code ignored;
+      acceptor_.close(ignored);
+      for (const auto& weak : sessions_) {
+        if (auto session = weak.lock()) {
+          session->close();
+        }
+      }
+      sessions_.clear();
+    });
+  }
+
+ private:
+  void run() {
+    // Session memory is recycled through session_pool_ rather than a fresh
+    // new/delete per connection.
+    auto new_participant = session_pool_.make(io_service_, strand_, room_,
+                                              config_, metrics_);
+    acceptor_.async_accept(
+        new_participant->socket(),
+        boost::asio::bind_executor(
+            strand_, makeCustomAllocHandler(
+                         accept_memory_,
+                         [this, new_participant](const auto& error) {
+                           this->onAccept(new_participant, error);
+                         })));
+  }
+
+  void onAccept(std::shared_ptr<SessionPerPerson> new_participant,
+                const boost::system::error_code& error) {
+    if (stopped_) {
+      return;
+    }
+    if (!error) {
+      track(new_participant);
+      new_participant->start();
+    }
+
+    run();
+  }
+
+  // Remembers the session for stop(). A weak_ptr keeps the pooled block of a
+  // finished session, so expired entries are swept whenever the list has
+  // doubled since the last sweep.
+  void track(const std::shared_ptr<SessionPerPerson>& session) {
+    if (sessions_.size() >= sweep_at_) {
+      sessions_.erase(
+          std::remove_if(sessions_.begin(), sessions_.end(),
+                         [](const auto& weak) { return weak.expired(); }),
+          sessions_.end());
+      sweep_at_ = std::max<std::size_t>(min_sweep, 2 * sessions_.size());
+    }
+    sessions_.push_back(session);
+  }
+
+  boost::asio::io_service& io_service_;
+  boost::asio::io_service::strand& strand_;
+  boost::asio::ip::tcp::acceptor acceptor_;
+  unsigned short port_;
+  const BackpressureConfig& config_;
+  ChatMetrics& metrics_;
+  ChatRoom room_;
+  SessionPool<SessionPerPerson> session_pool_;
+  HandlerMemory accept_memory_;
+  // only touched on the strand
+  static constexpr std::size_t min_sweep = 64;
+  std::vector<std::weak_ptr<SessionPerPerson>> sessions_;
+  std::size_t sweep_at_ = min_sweep;
+  bool stopped_ = false;
+};
+
+#endif /* CHAT_SERVER_HPP_ */
@@ -0,0 +1,473 @@
+// Slow consumer harness for the chat server write queue policies.
+//
+// An in-process ChatRoomServer with small watermarks is started, then:
+//   - a few slow clients join and read one frame every 10ms (tiny receive
+//     buffer), far slower than the sender; once the fast clients have
+//     everything, the slow ones read what is left at full speed
+//   - a few fast clients join and read everything
+//   - a sender broadcasts N stamped messages at a fixed rate
+//
+// The sender is paced so that delivery latency is the server's, not frames
+// piling up in the sender's own socket buffer. A baseline run without slow
+// clients measures the fast clients' latency at that rate; then every
+// SlowConsumerPolicy is run with the slow clients. A policy passes when
+//   - the server's peak queued bytes stays under participants * (high + 1)
+//     frames, i.e. memory is bounded by the watermarks, not by N
+//   - every fast client received all N messages
+//   - fast client p99 delivery latency stays within max_p99_factor times the
+//     baseline p99 plus max_p99_margin, i.e. slow clients do not hold the
+//     fast ones back
+//   - every frame any client reads is intact and in order: a message whose
+//     body matches its sequence number, or a well-formed skip notice. The
+//     queue trimming must not touch the frame being written.
+//
+// usage: slow_consumer_test [messages] [messages/s]
+
+#include <algorithm>
+#include <array>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "backpressure.hpp"
+#include "chat_server.hpp"
+
+using boost::asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+constexpr int fast_clients = 4;
+constexpr int slow_clients = 4;
+constexpr int max_p99_factor = 3;
+constexpr auto max_p99_margin = std::chrono::milliseconds(25);
+constexpr auto slow_read_period = std::chrono::milliseconds(10);
+constexpr auto catch_up_idle = std::chrono::milliseconds(100);
+constexpr int body_size = 400;  // sender's message, NUL not included
+static_assert(body_size < MAX_IP_PACK_SIZE - PADDING - MAX_NICKNAME);
+constexpr int not_a_message = -1;
+constexpr int bad_frame = -2;
+
+std::array<char, MAX_NICKNAME> makeNickname(const char* name) {
+  std::array<char, MAX_NICKNAME> nickname{};
+  std::strncpy(nickname.data(), name, nickname.size() - 1);
+  return nickname;
+}
+
+// Message `seq`: the header, then filler that depends on seq up to
+// body_size, so a frame pieced together from two messages or read out of
+// freed memory does not check out.
+void formatBody(char* out, int seq, long long stamp) {
+  int n = std::snprintf(out, body_size + 1, "seq=%d t=%lld ", seq, stamp);
+  for (; n < body_size; ++n) {
+    out[n] = static_cast<char>('a' + (seq + n) % 26);
+  }
+  out[body_size] = '\0';
+}
+
+// Returns the sequence number of an intact message frame, not_a_message for
+// an intact skip notice and bad_frame for anything else.
+int checkFrame(MsgT& frame, long long& stamp) {
+  frame.back() = '\0';
+  if (const char* p = std::strstr(frame.data(), "seq=")) {
+    int seq = 0;
+    if (std::sscanf(p, "seq=%d t=%lld", &seq, &stamp) != 2 || seq < 0) {
+      return bad_frame;
+    }
+    std::array<char, body_size + 1> expected;
+    formatBody(expected.data(), seq, stamp);
+    return std::strcmp(p, expected.data()) == 0 ? seq : bad_frame;
+  }
+  std::size_t skipped = 0;
+  if (std::sscanf(frame.data(), "*** %zu", &skipped) == 1) {
+    MsgT expected;
+    std::snprintf(expected.data(), expected.size(),
+                  "*** %zu messages skipped, connection too slow ***",
+                  skipped);
+    return std::strcmp(frame.data(), expected.data()) == 0 ? not_a_message
+                                                           : bad_frame;
+  }
+  return bad_frame;
+}
+
+// Counts frames that fail checkFrame or arrive out of order.
+class FrameChecker {
+ public:
+  // Returns the sequence number, or a negative value if `frame` is not a
+  // message.
+  int check(MsgT& frame, long long& stamp) {
+    const int seq = checkFrame(frame, stamp);
+    if (seq == bad_frame || (seq >= 0 && seq <= last_seq_)) {
+      ++bad_;
+      return bad_frame;
+    }
+    if (seq >= 0) {
+      last_seq_ = seq;
+    }
+    return seq;
+  }
+
+  int bad() const { return bad_; }
+
+ private:
+  int last_seq_ = -1;
+  int bad_ = 0;
+};
+
+// Joins the room and reads one frame every slow_read_period. Its queue fills
+// up and gets trimmed (or the policy disconnects it) while a write to it is
+// pending, so catchUp() reads the rest, written after the trims.
+class SlowClient {
+ public:
+  SlowClient(boost::asio::io_context& io, const tcp::endpoint& endpoint)
+      : socket_(io), timer_(io), nickname_(makeNickname("slow")) {
+    socket_.open(tcp::v4());
+    socket_.set_option(boost::asio::socket_base::receive_buffer_size(1024));
+    socket_.connect(endpoint);
+    boost::asio::write(socket_, boost::asio::buffer(nickname_));
+    wait();
+  }
+
+  int badFrames() const { return checker_.bad(); }
+  Clock::time_point lastFrame() const { return last_frame_; }
+
+  void catchUp() {
+    catching_up_ = true;
+    timer_.cancel();  // the read chain continues without waiting
+    if (!reading_) {
+      read();
+    }
+  }
+
+ private:
+  void wait() {
+    if (catching_up_) {
+      read();
+      return;
+    }
+    timer_.expires_after(slow_read_period);
+    timer_.async_wait([this](const boost::system::error_code& error) {
+      // catchUp() may have started the read while this handler was queued
+      if (!error && !reading_) {
+        read();
+      }
+    });
+  }
+
+  void read() {
+    reading_ = true;
+    boost::asio::async_read(
+        socket_, boost::asio::buffer(frame_),
+        [this](const boost::system::error_code& error, std::size_t) {
+          reading_ = false;
+          if (error) {
+            return;  // disconnected by the policy
+          }
+          last_frame_ = Clock::now();
+          long long stamp = 0;
+          checker_.check(frame_, stamp);
+          wait();
+        });
+  }
+
+  tcp::socket socket_;
+  boost::asio::steady_timer timer_;
+  std::array<char, MAX_NICKNAME> nickname_;
+  MsgT frame_;
+  FrameChecker checker_;
+  bool reading_ = false;
+  bool catching_up_ = false;
+  Clock::time_point last_frame_;
+};
+
+// Reads every frame and records the delivery latency of stamped ones.
+class FastClient {
+ public:
+  FastClient(boost::asio::io_context& io, const tcp::endpoint& endpoint,
+             int expected)
+      : socket_(io), nickname_(makeNickname("fast")), expected_(expected) {
+    socket_.connect(endpoint);
+    boost::asio::write(socket_, boost::asio::buffer(nickname_));
+    latencies_.reserve(expected);
+    read();
+  }
+
+  bool done() const { return received_ >= expected_; }
+  int received() const { return received_; }
+  int badFrames() const { return checker_.bad(); }
+  const std::vector<Clock::duration>& latencies() const { return latencies_; }
+
+ private:
+  void read() {
+    boost::asio::async_read(
+        socket_, boost::asio::buffer(frame_),
+        [this](const boost::system::error_code& error, std::size_t) {
+          if (error) {
+            return;
+          }
+          long long stamp = 0;
+          if (checker_.check(frame_, stamp) >= 0) {
+            latencies_.push_back(Clock::now().time_since_epoch() -
+                                 Clock::duration(stamp));
+            ++received_;
+          }
+          read();
+        });
+  }
+
+  tcp::socket socket_;
+  std::array<char, MAX_NICKNAME> nickname_;
+  MsgT frame_;
+  FrameChecker checker_;
+  int expected_ = 0;
+  int received_ = 0;
+  std::vector<Clock::duration> latencies_;
+};
+
+// Writes `count` stamped messages, message i at start + i * period. The
+// sender is a participant too, so it drains its own copy of every broadcast.
+class Sender {
+ public:
+  Sender(boost::asio::io_context& io, const tcp::endpoint& endpoint, int count,
+         Clock::duration period)
+      : socket_(io),
+        timer_(io),
+        nickname_(makeNickname("sender")),
+        count_(count),
+        period_(period) {
+    socket_.connect(endpoint);
+    boost::asio::write(socket_, boost::asio::buffer(nickname_));
+    drain();
+  }
+
+  void start() {
+    start_ = Clock::now();
+    send();
+  }
+
+ private:
+  void drain() {
+    boost::asio::async_read(
+        socket_, boost::asio::buffer(echo_),
+        [this](const boost::system::error_code& error, std::size_t) {
+          if (!error) {
+            drain();
+          }
+        });
+  }
+
+  void send() {
+    if (sent_ == count_) {
+      return;
+    }
+    const auto due = start_ + sent_ * period_;
+    if (Clock::now() < due) {
+      timer_.expires_at(due);
+      timer_.async_wait([this](const boost::system::error_code& error) {
+        if (!error) {
+          send();
+        }
+      });
+      return;
+    }
+    msg_.fill('\0');
+    formatBody(msg_.data(), sent_,
+               static_cast<long long>(Clock::now().time_since_epoch().count()));
+    boost::asio::async_write(
+        socket_, boost::asio::buffer(msg_),
+        [this](const boost::system::error_code& error, std::size_t) {
+          if (!error) {
+            ++sent_;
+            send();
+          }
+        });
+  }
+
+  tcp::socket socket_;
+  boost::asio::steady_timer timer_;
+  std::array<char, MAX_NICKNAME> nickname_;
+  MsgT msg_;
+  MsgT echo_;
+  int count_ = 0;
+  int sent_ = 0;
+  Clock::duration period_;
+  Clock::time_point start_;
+};
+
+const char* policyName(SlowConsumerPolicy policy) {
+  switch (policy) {
+    case SlowConsumerPolicy::drop_oldest:
+      return "drop-oldest";
+    case SlowConsumerPolicy::coalesce:
+      return "coalesce";
+    case SlowConsumerPolicy::disconnect:
+      return "disconnect";
+  }
+  return "?";
+}
+
+struct RunResult {
+  std::uint64_t peak_queued = 0;
+  std::uint64_t bound = 0;
+  std::uint64_t dropped = 0;
+  std::uint64_t coalesce = 0;
+  std::uint64_t disconnects = 0;
+  int min_received = 0;
+  int bad_frames = 0;
+  Clock::duration p50{};
+  Clock::duration p99{};
+};
+
+RunResult run(SlowConsumerPolicy policy, int slow_count, int messages,
+              Clock::duration period) {
+  BackpressureConfig config;
+  config.high_watermark = 64;
+  config.low_watermark = 16;
+  config.policy = policy;
+  ChatMetrics metrics;
+
+  boost::asio::io_context server_io;
+  boost::asio::io_context::strand strand(server_io);
+  const tcp::endpoint any_port(boost::asio::ip::address_v4::loopback(), 0);
+  ChatRoomServer server(server_io, strand, any_port, config, metrics);
+  auto work = boost::asio::make_work_guard(server_io);
+  std::thread server_thread([&server_io] { server_io.run(); });
+
+  boost::asio::io_context client_io;
+  const tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(),
+                               server.port());
+  std::vector<std::unique_ptr<SlowClient>> slow;
+  std::vector<std::unique_ptr<FastClient>> fast;
+  for (int i = 0; i < slow_count; ++i) {
+    slow.push_back(std::make_unique<SlowClient>(client_io, endpoint));
+  }
+  for (int i = 0; i < fast_clients; ++i) {
+    fast.push_back(std::make_unique<FastClient>(client_io, endpoint, messages));
+  }
+  Sender sender(client_io, endpoint, messages, period);
+
+  // give the server a moment to register every nickname before sending
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  sender.start();
+
+  const auto deadline =
+      Clock::now() + messages * period + std::chrono::seconds(30);
+  while (Clock::now() < deadline &&
+         !std::all_of(fast.begin(), fast.end(),
+                      [](const auto& c) { return c->done(); })) {
+    client_io.run_for(std::chrono::milliseconds(10));
+  }
+
+  // Drain the slow clients until nothing has come for catch_up_idle: the
+  // writes pending to them since before their queues were trimmed complete
+  // now.
+  for (auto& c : slow) {
+    c->catchUp();
+  }
+  const auto catch_up_deadline = Clock::now() + std::chrono::seconds(10);
+  for (bool idle = false; !idle && Clock::now() < catch_up_deadline;) {
+    client_io.run_for(std::chrono::milliseconds(10));
+    const auto now = Clock::now();
+    idle = std::all_of(slow.begin(), slow.end(), [now](const auto& c) {
+      return now - c->lastFrame() > catch_up_idle;
+    });
+  }
+
+  // run() returns once the stopped server has nothing left in flight
+  server.stop();
+  work.reset();
+  server_thread.join();
+
+  std::vector<Clock::duration> all;
+  RunResult result;
+  result.min_received = messages;
+  for (const auto& c : fast) {
+    all.insert(all.end(), c->latencies().begin(), c->latencies().end());
+    result.min_received = std::min(result.min_received, c->received());
+    result.bad_frames += c->badFrames();
+  }
+  for (const auto& c : slow) {
+    result.bad_frames += c->badFrames();
+  }
+  std::sort(all.begin(), all.end());
+  auto pct = [&all](double p) {
+    return all.empty() ? Clock::duration::zero()
+                       : all[static_cast<std::size_t>(p * (all.size() - 1))];
+  };
+  const std::uint64_t participants = fast_clients + slow_count + 1;
+  result.bound = participants * (config.high_watermark + 1) * sizeof(MsgT);
+  result.peak_queued = metrics.peakQueuedBytes();
+  result.dropped = metrics.droppedMsgs();
+  result.coalesce = metrics.coalesceEvents();
+  result.disconnects = metrics.slowDisconnects();
+  result.p50 = pct(0.5);
+  result.p99 = pct(0.99);
+  return result;
+}
+
+long long micros(Clock::duration d) {
+  return static_cast<long long>(
+      std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+}
+
+void print(const char* name, const RunResult& r, int messages,
+           const char* verdict) {
+  std::printf(
+      "%-12s peak_queued=%8llu (bound %llu) dropped=%8llu coalesce=%5llu "
+      "disconnects=%llu fast_min_rx=%d/%d bad_frames=%d p50=%lldus "
+      "p99=%lldus -> %s\n",
+      name, static_cast<unsigned long long>(r.peak_queued),
+      static_cast<unsigned long long>(r.bound),
+      static_cast<unsigned long long>(r.dropped),
+      static_cast<unsigned long long>(r.coalesce),
+      static_cast<unsigned long long>(r.disconnects), r.min_received, messages,
+      r.bad_frames, micros(r.p50), micros(r.p99), verdict);
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int messages = argc > 1 ? std::atoi(argv[1]) : 6000;
+  const int rate = argc > 2 ? std::atoi(argv[2]) : 2000;
+  const auto period = std::chrono::duration_cast<Clock::duration>(
+                          std::chrono::seconds(1)) /
+                      rate;
+  std::printf("%d messages at %d/s, %d fast and %d slow clients\n", messages,
+              rate, fast_clients, slow_clients);
+
+  // the policy does not matter without slow clients
+  const auto baseline =
+      run(SlowConsumerPolicy::drop_oldest, 0, messages, period);
+  bool ok = baseline.min_received == messages && baseline.bad_frames == 0;
+  print("baseline", baseline, messages, ok ? "ok" : "FAILED");
+  const auto max_p99 = max_p99_factor * baseline.p99 + max_p99_margin;
+  std::printf("p99 limit %lldus\n", micros(max_p99));
+
+  for (auto policy :
+       {SlowConsumerPolicy::drop_oldest, SlowConsumerPolicy::coalesce,
+        SlowConsumerPolicy::disconnect}) {
+    // One retry if only the latency misses: a scheduling hiccup on a busy
+    // machine moves p99 of a single run, slow clients holding the fast ones
+    // back would not go away.
+    for (int attempt = 0;; ++attempt) {
+      const auto r = run(policy, slow_clients, messages, period);
+      const bool bounded = r.peak_queued <= r.bound;
+      const bool complete = r.min_received == messages && r.bad_frames == 0;
+      const bool timely = r.p99 <= max_p99;
+      const bool retry = bounded && complete && !timely && attempt == 0;
+      print(policyName(policy), r, messages,
+            bounded && complete && timely ? "ok"
+            : retry                       ? "retry"
+                                          : "FAILED");
+      if (!retry) {
+        ok = bounded && complete && timely && ok;
+        break;
+      }
+    }
+  }
+  return ok ? 0 : 1;
+}
@@ -1,10 +1,14 @@
 #pragma once
 
+// awaitable.hpp in boost 1.74 uses std::exchange without including <utility>
+#include <utility>
 #include <boost/asio.hpp>
 #include <boost/asio/detail/throw_error.hpp>
 #include <boost/asio/error.hpp>
 #include <string>
 
+#include "file_monitor_event.hpp"
+
 namespace services {
 template <typename Service>
 class basic_file_monitor : public boost::asio::basic_io_object<Service> {
@@ -14,16 +18,26 @@ class basic_file_monitor : public boost::asio::basic_io_object<Service> {
 
   void add_file(const std::string& filename) {
     boost::system::error_code ec;
-    this->service.add_file(this->implementation, filename, ec);
+    this->get_service().add_file(this->get_implementation(), filename, ec);
+    boost::asio::detail::throw_error(ec, "add_file");
+  }
+
+  void add_file(const std::string& filename, const watch_options& options) {
+    boost::system::error_code ec;
+    this->get_service().add_file(this->get_implementation(), filename, options,
+                                 ec);
     boost::asio::detail::throw_error(ec, "add_file");
   }
 
   template <typename MonHandler>
   void async_monitor(BOOST_ASIO_MOVE_ARG(MonHandler) handler) {
     boost::system::error_code ec;
-    this->service.async_monitor(this->implementation, ec,
-                                BOOST_ASIO_MOVE_CAST(MonHandler)(handler));
+    this->get_service().async_monitor(this->get_implementation(), ec,
+                                      BOOST_ASIO_MOVE_CAST(MonHandler)(handler));
     boost::asio::detail::throw_error(ec, "async_monitor");
   }
+
+  // The running async_monitor's handler is called with operation_aborted.
+  void cancel() { this->get_service().cancel(this->get_implementation()); }
 };
 }  // namespace services
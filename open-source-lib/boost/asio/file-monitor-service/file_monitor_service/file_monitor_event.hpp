@@ -1,6 +1,10 @@
 #pragma once
 
-#include <string>
+#include <sys/inotify.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string_view>
 
 namespace services {
 struct event {
@@ -14,12 +18,34 @@ struct event {
     delete_self,
     move_self,
     open,
+    create,
+    remove,
+    moved_from,
+    moved_to,
+    overflow,  // the kernel queue overflowed, events were lost
   };
 
   type t;
-  std::string filename;
+  // The watched path, and for a watched directory the name of the entry the
+  // event is about. Both point into the monitor: valid only for the duration
+  // of the handler call.
+  std::string_view filename;
+  std::string_view name;
+  bool is_dir = false;  // the event is about a directory
+
+  event(std::string_view f = {}, type tin = event::type::null,
+        std::string_view n = {})
+      : t(tin), filename(f), name(n) {}
+};
 
-  event(const std::string& f = "", type tin = event::type::null)
-      : filename(f), t(tin) {}
+// What add_file watches. The defaults are what add_file(path) does.
+struct watch_options {
+  // inotify event bits to report, e.g. IN_MODIFY | IN_CLOSE_WRITE
+  std::uint32_t mask = IN_ALL_EVENTS;
+  // also watch every directory below, including ones created later
+  bool recursive = false;
+  // Report at most one modify per file per window: repeats within the window
+  // are held back and reported as one modify when it has passed. Zero is off.
+  std::chrono::milliseconds coalesce{0};
 };
 }  // namespace services
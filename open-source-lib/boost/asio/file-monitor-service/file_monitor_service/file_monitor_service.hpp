@@ -10,7 +10,10 @@
 #include <errno.h>
 #include <sys/inotify.h>
 
-#include <boost/array.hpp>
+#include <array>
+#include <atomic>
+// awaitable.hpp in boost 1.74 uses std::exchange without including <utility>
+#include <utility>
 #include <boost/asio.hpp>
 #include <boost/assign.hpp>
 #include <boost/noncopyable.hpp>
@@ -18,7 +21,16 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/system/error_code.hpp>
 #include <boost/system/system_error.hpp>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "file_monitor_event.hpp"
 
@@ -28,12 +40,67 @@ namespace detail {
 
 class file_monitor_service {
  public:
+  using clock = std::chrono::steady_clock;
+
+  // The state of one monitor. A running async_monitor shares ownership, so
+  // the state outlives a destroyed monitor until its operations completed.
+  struct core {
+    struct watch {
+      std::string path;
+      watch_options options;
+    };
+
+    // A file with recent modify events, see watch_options::coalesce.
+    struct recent {
+      clock::time_point last;
+      bool pending = false;  // a modify was held back
+    };
+
+    core(boost::asio::io_service& io_service, int fd)
+        : strand_(boost::asio::make_strand(io_service)),
+          input_(strand_, fd),
+          coalesce_timer_(strand_) {}
+
+    int fd() { return input_.native_handle(); }
+
+    // Reads, timer waits and handler calls of the monitor run here. The I/O
+    // objects name the strand type: behind any_io_executor it would be
+    // copied to the heap for every operation.
+    using strand_type =
+        boost::asio::strand<boost::asio::io_service::executor_type>;
+    strand_type strand_;
+    boost::asio::posix::basic_stream_descriptor<strand_type> input_;
+    boost::asio::basic_waitable_timer<
+        clock, boost::asio::wait_traits<clock>, strand_type>
+        coalesce_timer_;
+
+    // add_file may be called from any thread, the rest is used on strand_.
+    std::mutex watches_mutex_;
+    std::map<int, watch> watches_;
+    clock::duration coalesce_tick_{};  // smallest coalesce window in use
+
+    // Events are decoded in place; only a trailing partial event is kept
+    // (moved to the front) for the next read to complete.
+    alignas(inotify_event) std::array<char, 4096> buffer_;
+    std::size_t decoded_ = 0;  // bytes of complete events
+    std::size_t tail_ = 0;     // bytes of the partial event after them
+    std::vector<event> batch_;  // reused, handed to the handler as a span
+    // Watches the kernel dropped (IN_IGNORED). Erased after the batch was
+    // handed out, since its events may point at their paths.
+    std::vector<int> ignored_;
+
+    // Keyed by the watch descriptor's bytes followed by the entry name;
+    // key_ is reused to build lookup keys without allocating.
+    std::unordered_map<std::string, recent> recent_;
+    std::string key_;
+    bool coalesce_armed_ = false;
+
+    std::atomic<bool> monitoring_{false};
+    bool cancelled_ = false;
+  };
+
   class implementation_type : private boost::asio::detail::noncopyable {
-    int fd_;
-    std::map<int, std::string> watched_files_;
-    boost::shared_ptr<boost::asio::posix::stream_descriptor> input_;
-    boost::array<char, 4096> buffer_;
-    std::string buffer_str_;
+    std::shared_ptr<core> core_;
 
     friend class file_monitor_service;
   };
@@ -44,59 +111,341 @@ class file_monitor_service {
   void shutdown_service() {}
 
   void construct(implementation_type& impl) {
-    impl.fd_ = init_fd();
-    impl.input_.reset(
-        new boost::asio::posix::stream_descriptor(io_service_, impl.fd_));
+    impl.core_ = std::make_shared<core>(io_service_, init_fd());
   }
 
-  void destroy(implementation_type& impl) { impl.input_.reset(); }
+  // Closes the inotify fd. A running monitor completes with
+  // operation_aborted.
+  void destroy(implementation_type& impl) {
+    auto c = std::move(impl.core_);
+    boost::asio::dispatch(c->strand_, [c] {
+      boost::system::error_code ignored;
+      c->cancelled_ = true;
+      c->coalesce_timer_.cancel();
+      c->input_.close(ignored);
+    });
+  }
 
   void add_file(implementation_type& impl, const std::string& file,
                 boost::system::error_code& ec) {
-    int wd = inotify_add_watch(impl.fd_, file.c_str(), IN_ALL_EVENTS);
+    add_file(impl, file, watch_options(), ec);
+  }
 
-    if (wd == -1) {
-      ec = boost::system::error_code(errno, boost::system::system_category());
-    } else if (impl.watched_files_.find(wd) == impl.watched_files_.end()) {
-      impl.watched_files_[wd] = file;
-    }
+  // With options.recursive every directory below `file` is watched as well.
+  // Subdirectories created later are added when their IN_CREATE arrives;
+  // entries created in them before that are not reported.
+  void add_file(implementation_type& impl, const std::string& file,
+                const watch_options& options, boost::system::error_code& ec) {
+    std::lock_guard<std::mutex> lock(impl.core_->watches_mutex_);
+    add_tree(*impl.core_, file, options, ec);
   }
 
+  // The handler is called as handler(ec, std::span<const event>) with every
+  // event decoded from one read (or held back modify events once their
+  // coalesce window has passed), on the monitor's strand. Monitoring goes on
+  // until cancel(), the destruction of the monitor or a read error, which
+  // is delivered as a last call with an empty span. One async_monitor at a
+  // time per monitor: another one fails with already_started.
   template <typename MonHandler>
   void async_monitor(implementation_type& impl, boost::system::error_code& ec,
-                     MonHandler handler) {
-    impl.input_->async_read_some(boost::asio::buffer(impl.buffer_), [&]() {
-      handle_monitor<MonHandler>(impl, boost::asio::placeholders::error,
-                                 boost::asio::placeholders::bytes_transferred,
-                                 handler);
+                     MonHandler&& handler) {
+    auto& c = impl.core_;
+    if (c->monitoring_.exchange(true)) {
+      ec = boost::asio::error::already_started;
+      return;
+    }
+    ec = boost::system::error_code();
+    auto op = std::make_shared<monitor_op<std::decay_t<MonHandler>>>(
+        c, std::forward<MonHandler>(handler));
+    boost::asio::dispatch(c->strand_, [op] { op->start(); });
+  }
+
+  // Stops a running async_monitor: its handler is called with
+  // operation_aborted, also if a batch was already on its way.
+  void cancel(implementation_type& impl) {
+    auto c = impl.core_;
+    boost::asio::dispatch(c->strand_, [c] {
+      c->cancelled_ = true;
+      c->coalesce_timer_.cancel();
+      c->input_.cancel();
     });
   }
 
  private:
-  template <typename MonHandler>
-  void handle_monitor(implementation_type& impl, boost::system::error_code ec,
-                      std::size_t bytes_transferred, MonHandler handler) {
-    if (!ec) {
-      impl.buffer_str_.append(impl.buffer_.data(),
-                              impl.buffer_.data() + bytes_transferred);
-
-      while (impl.buffer_str_.size() >= sizeof(inotify_event)) {
-        const inotify_event* iev =
-            reinterpret_cast<const inotify_event*>(impl.buffer_str_.data());
-        events_t::const_iterator event_i = events.find(iev->mask);
-        if (event_i != events.end()) {
-          io_service_.post(boost::asio::detail::bind_handler(
-              handler, ec,
-              event(impl.watched_files_[iev->wd], event_i->second)));
-        }
-        impl.buffer_str_.erase(0, sizeof(inotify_event) + iev->len);
+  // A running async_monitor: it owns the handler, which two chains call,
+  // the reads of the inotify fd and the coalesce timer. Each pending
+  // operation holds a reference.
+  template <typename Handler>
+  class monitor_op : public std::enable_shared_from_this<monitor_op<Handler>> {
+   public:
+    monitor_op(std::shared_ptr<core> c, Handler handler)
+        : core_(std::move(c)), handler_(std::move(handler)) {}
+
+    void start() {
+      core_->cancelled_ = false;
+      read();
+    }
+
+   private:
+    void read() {
+      core_->input_.async_read_some(
+          boost::asio::buffer(core_->buffer_.data() + core_->tail_,
+                              core_->buffer_.size() - core_->tail_),
+          [self = this->shared_from_this()](boost::system::error_code ec,
+                                            std::size_t n) {
+            self->on_read(ec, n);
+          });
+    }
+
+    void on_read(boost::system::error_code ec, std::size_t bytes_transferred) {
+      if (!ec && core_->cancelled_) ec = boost::asio::error::operation_aborted;
+      if (ec) {
+        finish(ec);
+        return;
+      }
+
+      decode_buffer(*core_, bytes_transferred);
+      deliver();
+      compact_buffer(*core_);
+      {
+        std::lock_guard<std::mutex> lock(core_->watches_mutex_);
+        for (int wd : core_->ignored_) core_->watches_.erase(wd);
+      }
+      core_->ignored_.clear();
+
+      // the handler may have cancelled
+      if (core_->cancelled_) {
+        finish(boost::asio::error::operation_aborted);
+        return;
+      }
+      if (!core_->recent_.empty() && !core_->coalesce_armed_) arm_coalesce();
+      read();
+    }
+
+    void arm_coalesce() {
+      core_->coalesce_armed_ = true;
+      {
+        std::lock_guard<std::mutex> lock(core_->watches_mutex_);
+        core_->coalesce_timer_.expires_after(core_->coalesce_tick_);
+      }
+      core_->coalesce_timer_.async_wait(
+          [self = this->shared_from_this()](boost::system::error_code ec) {
+            self->core_->coalesce_armed_ = false;
+            if (ec || self->done_) return;
+            flush_coalesced(*self->core_);
+            self->deliver();
+            if (!self->core_->recent_.empty()) self->arm_coalesce();
+          });
+    }
+
+    void deliver() {
+      if (core_->batch_.empty()) return;
+      handler_(boost::system::error_code(),
+               std::span<const event>(core_->batch_));
+    }
+
+    void finish(boost::system::error_code ec) {
+      done_ = true;
+      core_->coalesce_timer_.cancel();
+      core_->monitoring_ = false;  // the handler may start monitoring again
+      handler_(ec, std::span<const event>());
+    }
+
+    std::shared_ptr<core> core_;
+    Handler handler_;
+    bool done_ = false;
+  };
+
+  // Called with watches_mutex_ held.
+  static void add_tree(core& c, const std::string& file,
+                       const watch_options& options,
+                       boost::system::error_code& ec) {
+    add_watch(c, file, options, ec);
+    if (ec || !options.recursive) return;
+
+    namespace fs = std::filesystem;
+    std::error_code walk_ec;
+    fs::recursive_directory_iterator dir_i(
+        file, fs::directory_options::skip_permission_denied, walk_ec);
+    for (; !walk_ec && dir_i != fs::recursive_directory_iterator();
+         dir_i.increment(walk_ec)) {
+      std::error_code type_ec;
+      if (dir_i->is_directory(type_ec) && !dir_i->is_symlink(type_ec)) {
+        boost::system::error_code ignored;
+        add_watch(c, dir_i->path().string(), options, ignored);
       }
-      async_monitor(impl, ec, handler);
+    }
+  }
+
+  static void add_watch(core& c, const std::string& path,
+                        const watch_options& options,
+                        boost::system::error_code& ec) {
+    std::uint32_t mask = options.mask;
+    // new subdirectories have to be seen to be watched
+    if (options.recursive) mask |= IN_CREATE | IN_MOVED_TO;
+    int wd = inotify_add_watch(c.fd(), path.c_str(), mask);
+
+    if (wd == -1) {
+      ec = boost::system::error_code(errno, boost::system::system_category());
+      return;
+    }
+    c.watches_.try_emplace(wd, core::watch{path, options});
+    if (options.coalesce.count() > 0 &&
+        (c.coalesce_tick_.count() == 0 || options.coalesce < c.coalesce_tick_)) {
+      c.coalesce_tick_ = options.coalesce;
+    }
+  }
+
+  // Decodes the complete events of the buffer into the batch and keeps a
+  // trailing partial one for the next read.
+  static void decode_buffer(core& c, std::size_t bytes_transferred) {
+    const auto now = clock::now();
+    const char* p = c.buffer_.data();
+    const char* const end = p + c.tail_ + bytes_transferred;
+    c.batch_.clear();
+    {
+      std::lock_guard<std::mutex> lock(c.watches_mutex_);
+      while (static_cast<std::size_t>(end - p) >= sizeof(inotify_event)) {
+        const auto* iev = reinterpret_cast<const inotify_event*>(p);
+        const std::size_t size = sizeof(inotify_event) + iev->len;
+        if (static_cast<std::size_t>(end - p) < size) break;
+        decode(c, *iev, now);
+        p += size;
+      }
+    }
+    c.decoded_ = static_cast<std::size_t>(p - c.buffer_.data());
+    c.tail_ = static_cast<std::size_t>(end - p);
+  }
+
+  // Moves the partial event to the front, once the batch (which points at
+  // names in the buffer) has been handed out.
+  static void compact_buffer(core& c) {
+    std::memmove(c.buffer_.data(), c.buffer_.data() + c.decoded_, c.tail_);
+  }
+
+  // Appends the event for `iev` to the batch unless it is filtered out.
+  static void decode(core& c, const inotify_event& iev,
+                     clock::time_point now) {
+    if (iev.mask & IN_IGNORED) {
+      c.ignored_.push_back(iev.wd);
+      return;
+    }
+    const event::type type = type_of(iev.mask);
+    if (type == event::type::overflow) {
+      c.batch_.emplace_back(std::string_view(), type);
+      return;
+    }
+    auto watch_i = c.watches_.find(iev.wd);
+    if (type == event::type::null || watch_i == c.watches_.end()) return;
+
+    const auto& watch = watch_i->second;
+    const std::string_view name =
+        iev.len ? std::string_view(iev.name) : std::string_view();
+    if (watch.options.recursive && (iev.mask & IN_ISDIR) &&
+        (iev.mask & (IN_CREATE | IN_MOVED_TO))) {
+      boost::system::error_code ignored;
+      add_tree(c, watch.path + '/' + std::string(name), watch.options,
+               ignored);
+    }
+    // IN_CREATE/IN_MOVED_TO may only be watched for the recursion
+    if (!(iev.mask & watch.options.mask)) return;
+    if (watch.options.coalesce.count() > 0 &&
+        !coalesce(c, iev.wd, name, type, watch.options.coalesce, now)) {
+      return;
+    }
+
+    auto& e = c.batch_.emplace_back(watch.path, type, name);
+    e.is_dir = (iev.mask & IN_ISDIR) != 0;
+  }
+
+  // Whether to report the event now; a modify within the window of the
+  // previous one is marked pending instead.
+  static bool coalesce(core& c, int wd, std::string_view name,
+                       event::type type, clock::duration window,
+                       clock::time_point now) {
+    c.key_.assign(reinterpret_cast<const char*>(&wd), sizeof(wd));
+    c.key_.append(name);
+    if (type == event::type::modify) {
+      auto [recent_i, inserted] = c.recent_.try_emplace(c.key_);
+      auto& r = recent_i->second;
+      if (!inserted && now - r.last < window) {
+        r.pending = true;
+        return false;
+      }
+      r.last = now;
+      r.pending = false;
+      return true;
+    }
+    // a held back modify is superseded by these
+    if (type == event::type::close_write || type == event::type::remove ||
+        type == event::type::moved_from || type == event::type::delete_self) {
+      c.recent_.erase(c.key_);
+    }
+    return true;
+  }
+
+  // Puts the held back modify events whose window has passed into the batch
+  // and forgets files that have been quiet for a window.
+  static void flush_coalesced(core& c) {
+    const auto now = clock::now();
+    c.batch_.clear();
+    std::lock_guard<std::mutex> lock(c.watches_mutex_);
+    for (auto recent_i = c.recent_.begin(); recent_i != c.recent_.end();) {
+      int wd;
+      std::memcpy(&wd, recent_i->first.data(), sizeof(wd));
+      auto watch_i = c.watches_.find(wd);
+      auto& r = recent_i->second;
+      if (watch_i != c.watches_.end() &&
+          now - r.last < watch_i->second.options.coalesce) {
+        ++recent_i;
+      } else if (watch_i == c.watches_.end() || !r.pending) {
+        recent_i = c.recent_.erase(recent_i);
+      } else {
+        r.pending = false;
+        r.last = now;
+        c.batch_.emplace_back(
+            watch_i->second.path, event::type::modify,
+            std::string_view(recent_i->first).substr(sizeof(wd)));
+        ++recent_i;
+      }
+    }
+  }
+
+  static event::type type_of(std::uint32_t mask) {
+    if (mask & IN_Q_OVERFLOW) return event::type::overflow;
+    // one event bit per event, plus flags such as IN_ISDIR
+    switch (mask & IN_ALL_EVENTS) {
+      case IN_ACCESS:
+        return event::type::access;
+      case IN_ATTRIB:
+        return event::type::attrib;
+      case IN_CLOSE_WRITE:
+        return event::type::close_write;
+      case IN_CLOSE_NOWRITE:
+        return event::type::close_nowrite;
+      case IN_MODIFY:
+        return event::type::modify;
+      case IN_DELETE_SELF:
+        return event::type::delete_self;
+      case IN_MOVE_SELF:
+        return event::type::move_self;
+      case IN_OPEN:
+        return event::type::open;
+      case IN_CREATE:
+        return event::type::create;
+      case IN_DELETE:
+        return event::type::remove;
+      case IN_MOVED_FROM:
+        return event::type::moved_from;
+      case IN_MOVED_TO:
+        return event::type::moved_to;
+      default:
+        return event::type::null;
     }
   }
 
   int init_fd() {
-    int fd = inotify_init1(IN_NONBLOCK);
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
     if (fd == -1) {
       boost::system::system_error e(
           boost::system::error_code(errno, boost::system::system_category()),
@@ -107,20 +456,7 @@ class file_monitor_service {
   }
 
   boost::asio::io_service& io_service_;
-
-  using events_t = std::map<int, event::type>;
-  static const events_t events;
 };
-
-const file_monitor_service::events_t file_monitor_service::events = {
-    {IN_ACCESS, event::type::access},
-    {IN_ATTRIB, event::type::attrib},
-    {IN_CLOSE_WRITE, event::type::close_write},
-    {IN_CLOSE_NOWRITE, event::type::close_nowrite},
-    {IN_MODIFY, event::type::modify},
-    {IN_DELETE_SELF, event::type::delete_self},
-    {IN_MOVE_SELF, event::type::move_self},
-    {IN_OPEN, event::type::open}};
 }  // namespace detail
 
 class file_monitor_service : public boost::asio::io_service::service {
@@ -145,6 +481,11 @@ class file_monitor_service : public boost::asio::io_service::service {
     service_impl_.add_file(impl, file, ec);
   }
 
+  void add_file(implementation_type& impl, const std::string& file,
+                const watch_options& options, boost::system::error_code& ec) {
+    service_impl_.add_file(impl, file, options, ec);
+  }
+
   template <typename MonHandler>
   void async_monitor(implementation_type& impl, boost::system::error_code& ec,
                      BOOST_ASIO_MOVE_ARG(MonHandler) handler) {
@@ -152,6 +493,8 @@ class file_monitor_service : public boost::asio::io_service::service {
                                 BOOST_ASIO_MOVE_CAST(MonHandler)(handler));
   }
 
+  void cancel(implementation_type& impl) { service_impl_.cancel(impl); }
+
  private:
   void shutdown_service() { service_impl_.shutdown_service(); }
 
@@ -0,0 +1,138 @@
+// Event throughput and latency of file_monitor_service.
+//
+// A writer thread creates `files` empty files (open + close) in a fresh
+// directory under /tmp that the monitor watches, recording the time of each.
+// The monitor delivers the decoded events in batches; for every close_write
+// the latency from the writer's timestamp to the handler is recorded.
+//
+// Reported: events/sec delivered, events per batch (one batch per read of the
+// inotify fd), lost events (IN_Q_OVERFLOW, see
+// /proc/sys/fs/inotify/max_queued_events) and the touch -> handler latency.
+//
+// usage: monitor_bench [files]
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "file_monitor_service/file_monitor.hpp"
+#include "latency_histogram.h"
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+struct stats {
+  std::uint64_t events = 0;
+  std::uint64_t batches = 0;
+  std::uint64_t closes = 0;
+  std::uint64_t overflows = 0;
+  Clock::time_point last_event{};
+  LatencyHistogram latency;
+};
+
+std::string file_path(const std::string& dir, int i) {
+  return dir + "/f" + std::to_string(i);
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int files = argc > 1 ? std::atoi(argv[1]) : 100000;
+
+  char dir_template[] = "/tmp/monitor_bench.XXXXXX";
+  if (!mkdtemp(dir_template)) {
+    std::perror("mkdtemp");
+    return 1;
+  }
+  const std::string dir = dir_template;
+
+  boost::asio::io_context ctx;
+  services::file_monitor monitor(ctx);
+  monitor.add_file(dir);
+
+  // touch times, written by the writer thread before each file is created
+  auto stamps = std::make_unique<std::atomic<Clock::rep>[]>(files);
+  stats s;
+  monitor.async_monitor([&](const boost::system::error_code& ec,
+                            std::span<const services::event> batch) {
+    if (ec) return;
+    const auto now = Clock::now();
+    ++s.batches;
+    s.events += batch.size();
+    s.last_event = now;
+    for (const auto& e : batch) {
+      if (e.t == services::event::type::overflow) {
+        ++s.overflows;
+      } else if (e.t == services::event::type::close_write &&
+                 e.name.size() > 1) {
+        int i = -1;
+        std::from_chars(e.name.data() + 1, e.name.data() + e.name.size(), i);
+        if (i < 0 || i >= files) continue;
+        const Clock::time_point touched(
+            Clock::duration(stamps[i].load(std::memory_order_acquire)));
+        s.latency.record(now - touched);
+        if (++s.closes == static_cast<std::uint64_t>(files)) ctx.stop();
+      }
+    }
+  });
+
+  std::atomic<bool> writer_done{false};
+  const auto start = Clock::now();
+  std::thread writer([&] {
+    for (int i = 0; i < files; ++i) {
+      stamps[i].store(Clock::now().time_since_epoch().count(),
+                      std::memory_order_release);
+      const int fd = ::open(file_path(dir, i).c_str(),
+                            O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+      if (fd != -1) ::close(fd);
+    }
+    writer_done = true;
+  });
+
+  // with lost events not every close arrives: stop once the writer is done
+  // and the monitor has gone quiet
+  boost::asio::steady_timer idle(ctx);
+  std::uint64_t seen = 0;
+  std::function<void()> check_idle = [&] {
+    idle.expires_after(std::chrono::milliseconds(500));
+    idle.async_wait([&](const boost::system::error_code& ec) {
+      if (ec) return;
+      if (writer_done && s.events == seen) {
+        ctx.stop();
+        return;
+      }
+      seen = s.events;
+      check_idle();
+    });
+  };
+  check_idle();
+
+  ctx.run();
+  writer.join();
+
+  const double elapsed =
+      std::chrono::duration<double>(s.last_event - start).count();
+  std::printf("%d files touched\n", files);
+  std::printf("%llu events in %llu batches (%.1f per batch), %.0f events/s\n",
+              static_cast<unsigned long long>(s.events),
+              static_cast<unsigned long long>(s.batches),
+              s.batches ? static_cast<double>(s.events) / s.batches : 0.0,
+              elapsed > 0 ? s.events / elapsed : 0.0);
+  std::printf("%llu of %d close_write events, %llu queue overflows\n",
+              static_cast<unsigned long long>(s.closes), files,
+              static_cast<unsigned long long>(s.overflows));
+  s.latency.print("touch -> handler");
+
+  for (int i = 0; i < files; ++i) ::unlink(file_path(dir, i).c_str());
+  ::rmdir(dir.c_str());
+  return 0;
+}
@@ -0,0 +1,263 @@
+// Lifetime, cancellation and steady-state behaviour of async_monitor.
+//
+//   continuous  two monitors on one io_context run by two threads, each on
+//               its own directory, through `rounds` rounds of touching
+//               `files` files. Every close_write must arrive, and after the
+//               first round the io threads must not allocate per event.
+//   cancel      cancel() ends the handler with one operation_aborted call,
+//               no events follow, and async_monitor can be started again.
+//   busy        a second async_monitor on a running monitor throws
+//               already_started.
+//   destroy     destroying a running monitor ends its handler with
+//               operation_aborted.
+//
+// usage: monitor_test [files] [rounds]
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "file_monitor_service/file_monitor.hpp"
+
+using Clock = std::chrono::steady_clock;
+using namespace std::chrono_literals;
+
+namespace {
+thread_local bool t_count_allocs = false;
+std::atomic<std::uint64_t> g_allocs{0};
+}  // namespace
+
+void* operator new(std::size_t size) {
+  if (t_count_allocs) g_allocs.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+// A fresh directory under /tmp, removed again at the end.
+class temp_dir {
+ public:
+  temp_dir() {
+    char path[] = "/tmp/monitor_test.XXXXXX";
+    if (mkdtemp(path)) path_ = path;
+  }
+  ~temp_dir() {
+    std::error_code ignored;
+    std::filesystem::remove_all(path_, ignored);
+  }
+
+  const std::string& path() const { return path_; }
+
+  void touch(int i) const {
+    const auto file = path_ + "/f" + std::to_string(i);
+    const int fd = ::open(file.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+    if (fd != -1) ::close(fd);
+  }
+
+ private:
+  std::string path_;
+};
+
+struct counts {
+  std::atomic<std::uint64_t> events{0};
+  std::atomic<std::uint64_t> closes{0};
+  std::atomic<int> errors{0};
+  boost::system::error_code last_error;
+};
+
+auto counting_handler(counts& c) {
+  return [&c](const boost::system::error_code& ec,
+              std::span<const services::event> batch) {
+    if (ec) {
+      c.last_error = ec;
+      ++c.errors;
+      return;
+    }
+    c.events += batch.size();
+    for (const auto& e : batch) {
+      if (e.t == services::event::type::close_write) ++c.closes;
+    }
+  };
+}
+
+template <typename Predicate>
+bool wait_for(Predicate done, Clock::duration timeout = 5s) {
+  const auto end = Clock::now() + timeout;
+  while (!done()) {
+    if (Clock::now() > end) return false;
+    std::this_thread::sleep_for(1ms);
+  }
+  return true;
+}
+
+// Runs `ctx` on this thread until `done` or the timeout.
+template <typename Predicate>
+bool run_until(boost::asio::io_context& ctx, Predicate done,
+               Clock::duration timeout = 5s) {
+  const auto end = Clock::now() + timeout;
+  ctx.restart();
+  while (!done()) {
+    if (Clock::now() > end) return false;
+    ctx.run_one_for(10ms);
+  }
+  return true;
+}
+
+bool check(bool ok, const char* what) {
+  std::printf("  %-58s %s\n", what, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+bool test_continuous(int files, int rounds) {
+  std::printf("continuous (%d files x %d rounds, 2 monitors, 2 threads)\n",
+              files, rounds);
+  boost::asio::io_context ctx;
+  temp_dir dir1, dir2;
+  services::file_monitor monitor1(ctx), monitor2(ctx);
+  monitor1.add_file(dir1.path());
+  monitor2.add_file(dir2.path());
+  counts c1, c2;
+  monitor1.async_monitor(counting_handler(c1));
+  monitor2.async_monitor(counting_handler(c2));
+
+  auto work = boost::asio::make_work_guard(ctx);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 2; ++i) {
+    threads.emplace_back([&ctx] {
+      t_count_allocs = true;
+      ctx.run();
+    });
+  }
+
+  bool delivered = true;
+  std::uint64_t allocs0 = 0;
+  std::uint64_t events0 = 0;
+  for (int round = 0; round < rounds && delivered; ++round) {
+    if (round == 1) {
+      // the first round warms up the buffers and the handler memory
+      allocs0 = g_allocs.load();
+      events0 = c1.events + c2.events;
+    }
+    for (int i = 0; i < files; ++i) {
+      dir1.touch(i);
+      dir2.touch(i);
+    }
+    const auto expected = static_cast<std::uint64_t>(files) * (round + 1);
+    delivered = wait_for(
+        [&] { return c1.closes >= expected && c2.closes >= expected; });
+  }
+  const auto allocs = g_allocs.load() - allocs0;
+  const auto events = c1.events + c2.events - events0;
+
+  work.reset();
+  ctx.stop();
+  for (auto& t : threads) t.join();
+
+  std::printf("  %llu events after warm-up, %llu allocations\n",
+              static_cast<unsigned long long>(events),
+              static_cast<unsigned long long>(allocs));
+  bool ok = check(delivered, "every close_write delivered to both monitors");
+  ok &= check(c1.errors == 0 && c2.errors == 0, "no errors");
+  ok &= check(allocs * 100 < events, "less than one allocation per 100 events");
+  return ok;
+}
+
+bool test_cancel() {
+  std::printf("cancel\n");
+  boost::asio::io_context ctx;
+  temp_dir dir;
+  services::file_monitor monitor(ctx);
+  monitor.add_file(dir.path());
+  counts c;
+  monitor.async_monitor(counting_handler(c));
+
+  dir.touch(0);
+  bool ok = check(run_until(ctx, [&] { return c.closes == 1; }),
+                  "events delivered before cancel");
+
+  // an event in flight must not keep the monitor going
+  dir.touch(1);
+  monitor.cancel();
+  ok &= check(run_until(ctx, [&] { return c.errors == 1; }),
+              "handler ends with one error call");
+  ok &= check(c.last_error == boost::asio::error::operation_aborted,
+              "the error is operation_aborted");
+
+  const auto events = c.events.load();
+  dir.touch(2);
+  run_until(ctx, [] { return false; }, 100ms);
+  ok &= check(c.events == events && c.errors == 1,
+              "no calls after the cancellation");
+
+  // the queued events are still there for the next async_monitor
+  counts again;
+  monitor.async_monitor(counting_handler(again));
+  dir.touch(3);
+  ok &= check(run_until(ctx, [&] { return again.closes >= 1; }),
+              "async_monitor can be started again");
+  return ok;
+}
+
+bool test_busy() {
+  std::printf("busy\n");
+  boost::asio::io_context ctx;
+  temp_dir dir;
+  services::file_monitor monitor(ctx);
+  monitor.add_file(dir.path());
+  counts c;
+  monitor.async_monitor(counting_handler(c));
+
+  boost::system::error_code error;
+  try {
+    monitor.async_monitor(counting_handler(c));
+  } catch (const boost::system::system_error& e) {
+    error = e.code();
+  }
+  return check(error == boost::asio::error::already_started,
+               "second async_monitor throws already_started");
+}
+
+bool test_destroy() {
+  std::printf("destroy\n");
+  boost::asio::io_context ctx;
+  temp_dir dir;
+  counts c;
+  {
+    services::file_monitor monitor(ctx);
+    monitor.add_file(dir.path());
+    monitor.async_monitor(counting_handler(c));
+    run_until(ctx, [] { return false; }, 10ms);
+  }
+  bool ok = check(run_until(ctx, [&] { return c.errors == 1; }),
+                  "handler ends when the monitor is destroyed");
+  ok &= check(c.last_error == boost::asio::error::operation_aborted,
+              "the error is operation_aborted");
+  return ok;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int files = argc > 1 ? std::atoi(argv[1]) : 2000;
+  const int rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+
+  bool ok = test_continuous(files, rounds);
+  ok &= test_cancel();
+  ok &= test_busy();
+  ok &= test_destroy();
+  std::printf("%s\n", ok ? "PASSED" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+// Event volume and monitor CPU under a write storm, per watch_options.
+//
+// A writer thread appends 64 bytes at a time to `files` files spread over
+// `dirs` subdirectories, round robin, closing and reopening one file every
+// 64 writes, like a build or log directory with heavy churn. Shortly after
+// the start it creates another subdirectory and writes there too, which only
+// a recursive watch picks up. The monitor watches the root recursively with:
+//
+//   all events  IN_ALL_EVENTS, every write is a modify (plus open/close...)
+//   narrow      IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE
+//   coalesced   narrow, with modify events coalesced per file over 50ms
+//
+// Reported per configuration: writes/s, events and handler calls delivered,
+// events from the late subdirectory, and the CPU time of the monitor thread.
+//
+// usage: storm_bench [seconds] [files] [dirs]
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "file_monitor_service/file_monitor.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+struct stats {
+  std::uint64_t events = 0;
+  std::uint64_t batches = 0;
+  std::uint64_t modifies = 0;
+  std::uint64_t late = 0;  // events from the subdirectory created later
+};
+
+double thread_cpu_seconds() {
+  timespec ts{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void run(const char* name, const services::watch_options& options,
+         int seconds, int files, int dirs) {
+  char dir_template[] = "/tmp/storm_bench.XXXXXX";
+  if (!mkdtemp(dir_template)) {
+    std::perror("mkdtemp");
+    return;
+  }
+  const std::string root = dir_template;
+  std::vector<std::string> paths;
+  for (int d = 0; d < dirs; ++d) {
+    const auto dir = root + "/d" + std::to_string(d);
+    std::filesystem::create_directory(dir);
+    for (int f = d; f < files; f += dirs) {
+      paths.push_back(dir + "/f" + std::to_string(f));
+    }
+  }
+  const std::string late_dir = root + "/late";
+
+  boost::asio::io_context ctx;
+  services::file_monitor monitor(ctx);
+  monitor.add_file(root, options);
+  stats s;
+  monitor.async_monitor([&](const boost::system::error_code& ec,
+                            std::span<const services::event> batch) {
+    if (ec) return;
+    ++s.batches;
+    s.events += batch.size();
+    for (const auto& e : batch) {
+      if (e.t == services::event::type::modify) ++s.modifies;
+      if (e.filename.starts_with(late_dir)) ++s.late;
+    }
+  });
+
+  double cpu = 0;
+  std::thread monitor_thread([&] {
+    const double cpu0 = thread_cpu_seconds();
+    ctx.run();
+    cpu = thread_cpu_seconds() - cpu0;
+  });
+
+  std::vector<int> fds;
+  for (const auto& path : paths) {
+    fds.push_back(::open(path.c_str(), O_CREAT | O_WRONLY | O_APPEND, 0644));
+  }
+  const char line[64] = "storm storm storm storm storm storm storm storm storm\n";
+  std::uint64_t writes = 0;
+  bool late_created = false;
+  const auto start = Clock::now();
+  const auto end = start + std::chrono::seconds(seconds);
+  for (std::size_t i = 0; Clock::now() < end; ++i) {
+    if (!late_created && Clock::now() - start > std::chrono::milliseconds(100)) {
+      // a new directory appears during the storm
+      std::filesystem::create_directory(late_dir);
+      paths.push_back(late_dir + "/f");
+      fds.push_back(
+          ::open(paths.back().c_str(), O_CREAT | O_WRONLY | O_APPEND, 0644));
+      late_created = true;
+    }
+    const std::size_t f = i % fds.size();
+    if (::write(fds[f], line, sizeof(line)) > 0) ++writes;
+    if (i % 64 == 0) {
+      ::close(fds[f]);
+      fds[f] = ::open(paths[f].c_str(), O_WRONLY | O_APPEND);
+    }
+  }
+  const double elapsed =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  for (int fd : fds) ::close(fd);
+
+  // let the monitor drain and flush held back modifies
+  std::this_thread::sleep_for(options.coalesce + std::chrono::milliseconds(300));
+  ctx.stop();
+  monitor_thread.join();
+
+  std::printf("%-12s %9.0f %10llu %8llu %9llu %6llu %8.0f\n", name,
+              writes / elapsed, static_cast<unsigned long long>(s.events),
+              static_cast<unsigned long long>(s.batches),
+              static_cast<unsigned long long>(s.modifies),
+              static_cast<unsigned long long>(s.late), cpu * 1e3);
+
+  std::filesystem::remove_all(root);
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int seconds = argc > 1 ? std::atoi(argv[1]) : 3;
+  const int files = argc > 2 ? std::atoi(argv[2]) : 256;
+  const int dirs = argc > 3 ? std::atoi(argv[3]) : 8;
+  std::printf("%d files in %d directories, %ds per configuration\n", files,
+              dirs, seconds);
+  std::printf("%-12s %9s %10s %8s %9s %6s %8s\n", "config", "writes/s",
+              "events", "batches", "modifies", "late", "cpu(ms)");
+
+  services::watch_options all;
+  all.recursive = true;
+  run("all events", all, seconds, files, dirs);
+
+  services::watch_options narrow;
+  narrow.mask = IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE;
+  narrow.recursive = true;
+  run("narrow", narrow, seconds, files, dirs);
+
+  services::watch_options coalesced = narrow;
+  coalesced.coalesce = std::chrono::milliseconds(50);
+  run("coalesced", coalesced, seconds, files, dirs);
+  return 0;
+}
@@ -0,0 +1,242 @@
+// Timers and strands from snippets.cpp, at scale.
+//
+// snippets.cpp shows two deadline_timers and a strand on two run() threads.
+// This puts millions of handlers through the same machinery on N threads:
+//
+// dispatch   `chains` handler chains, each handler posting the next one,
+//            until `handlers` handlers ran:
+//              post        post(ctx, h)
+//              1 strand    every chain posts through the same strand
+//              S strands   chain i posts through strand i % S
+//            Reported: handlers/s and ns per handler. The strand rows minus
+//            the post row are the cost of serializing.
+//
+// timers     `timers` timers due at random points 200ms..1200ms from now,
+//            armed from the main thread while the N threads already run:
+//              deadline_timer         (posix_time, heap of the io_context)
+//              steady_timer           (steady_clock, same heap)
+//              timer_wheel_service    (timer_wheel_service.h, 1ms ticks)
+//            Reported: arm cost per timer, firing skew (handler time minus
+//            due time) p50/p99/max, and how long after the last possible due
+//            time the last handler ran.
+//
+// usage: timer_bench [threads] [timers] [handlers] [strands]
+
+#include <algorithm>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "latency_histogram.h"
+#include "timer_wheel_service.h"
+
+using namespace boost;
+using Clock = std::chrono::steady_clock;
+using cppcon_2016_asio_talks::timer_wheel_service;
+
+namespace {
+constexpr int kChains = 64;
+constexpr auto kLead = std::chrono::milliseconds(200);
+constexpr auto kWindow = std::chrono::milliseconds(1000);
+
+thread_local int t_index = 0;  // which run() thread this is
+
+// Runs `ctx` on `threads` threads until join().
+class runner {
+ public:
+  runner(asio::io_context& ctx, int threads)
+      : ctx_(ctx), work_(asio::make_work_guard(ctx)) {
+    for (int i = 0; i < threads; ++i) {
+      threads_.emplace_back([this, i] {
+        t_index = i;
+        ctx_.run();
+      });
+    }
+  }
+
+  void join() {
+    work_.reset();
+    for (auto& t : threads_) t.join();
+  }
+
+ private:
+  asio::io_context& ctx_;
+  asio::executor_work_guard<asio::io_context::executor_type> work_;
+  std::vector<std::thread> threads_;
+};
+
+template <typename Executor>
+struct hop {
+  Executor ex;
+  std::uint64_t left;
+  std::atomic<int>* chains_done;
+
+  void operator()() {
+    if (--left == 0) {
+      ++*chains_done;
+      return;
+    }
+    asio::post(ex, std::move(*this));
+  }
+};
+
+template <typename Executor>
+void start_chain(Executor ex, std::uint64_t hops,
+                 std::atomic<int>& chains_done) {
+  asio::post(ex, hop<Executor>{ex, hops, &chains_done});
+}
+
+// `strands` == 0: plain post
+void dispatch(const char* name, int threads, std::uint64_t handlers,
+              int strands) {
+  asio::io_context ctx(threads);
+  std::vector<asio::strand<asio::io_context::executor_type>> pool;
+  for (int i = 0; i < strands; ++i) pool.push_back(asio::make_strand(ctx));
+  std::atomic<int> chains_done{0};
+  const std::uint64_t hops = std::max<std::uint64_t>(1, handlers / kChains);
+
+  const auto start = Clock::now();
+  runner r(ctx, threads);
+  for (int i = 0; i < kChains; ++i) {
+    if (strands == 0) {
+      start_chain(ctx.get_executor(), hops, chains_done);
+    } else {
+      start_chain(pool[i % strands], hops, chains_done);
+    }
+  }
+  while (chains_done < kChains) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  const double elapsed =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  r.join();
+
+  const double total = static_cast<double>(hops) * kChains;
+  std::printf("%-22s %12.0f %10.1f\n", name, total / elapsed,
+              elapsed * 1e9 / total);
+}
+
+struct timer_run {
+  explicit timer_run(int threads) : skew(threads) {}
+
+  void fired(std::chrono::nanoseconds late) {
+    skew[t_index].record(late);
+    ++count;
+  }
+
+  asio::io_context ctx;
+  std::vector<LatencyHistogram> skew;  // one per run() thread
+  std::atomic<int> count{0};
+};
+
+// `arm(run, delays)` arms one timer per delay and returns what has to stay
+// alive until they fired.
+template <typename Arm>
+void timers(const char* name, int threads,
+            const std::vector<Clock::duration>& delays, Arm arm) {
+  timer_run run(threads);
+  runner r(run.ctx, threads);
+
+  const auto start = Clock::now();
+  auto keep_alive = arm(run, delays);
+  const auto armed = Clock::now();
+
+  const int count = static_cast<int>(delays.size());
+  const auto give_up = start + kLead + kWindow + std::chrono::seconds(60);
+  while (run.count < count && Clock::now() < give_up) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  const auto done = Clock::now();
+  r.join();
+
+  LatencyHistogram skew;
+  for (const auto& h : run.skew) skew.merge(h);
+  // every timer is due by the time the last one was armed plus the delay
+  const auto lag = std::chrono::duration_cast<std::chrono::milliseconds>(
+      done - (armed + kLead + kWindow));
+  std::printf("%-22s %9.0f %8lld %8lld %8lld %8lld%s\n", name,
+              std::chrono::duration<double, std::nano>(armed - start).count() /
+                  count,
+              static_cast<long long>(skew.percentile(0.5).count()),
+              static_cast<long long>(skew.percentile(0.99).count()),
+              static_cast<long long>(skew.max().count()),
+              static_cast<long long>(lag.count()),
+              run.count < count ? "  (timed out)" : "");
+}
+
+std::shared_ptr<void> arm_deadline_timers(
+    timer_run& run, const std::vector<Clock::duration>& delays) {
+  auto timers = std::make_shared<std::vector<asio::deadline_timer>>();
+  timers->reserve(delays.size());
+  for (auto delay : delays) {
+    auto& t = timers->emplace_back(run.ctx);
+    t.expires_from_now(posix_time::microseconds(
+        std::chrono::duration_cast<std::chrono::microseconds>(delay).count()));
+    t.async_wait([&run, &t](const system::error_code&) {
+      const auto late =
+          asio::deadline_timer::traits_type::now() - t.expires_at();
+      run.fired(std::chrono::microseconds(late.total_microseconds()));
+    });
+  }
+  return timers;
+}
+
+std::shared_ptr<void> arm_steady_timers(
+    timer_run& run, const std::vector<Clock::duration>& delays) {
+  auto timers = std::make_shared<std::vector<asio::steady_timer>>();
+  timers->reserve(delays.size());
+  for (auto delay : delays) {
+    auto& t = timers->emplace_back(run.ctx, delay);
+    t.async_wait([&run, &t](const system::error_code&) {
+      run.fired(Clock::now() - t.expiry());
+    });
+  }
+  return timers;
+}
+
+std::shared_ptr<void> arm_wheel_timers(
+    timer_run& run, const std::vector<Clock::duration>& delays) {
+  auto& wheel = asio::use_service<timer_wheel_service>(run.ctx);
+  for (auto delay : delays) {
+    const auto due = Clock::now() + delay;
+    wheel.async_wait(delay, [&run, due] { run.fired(Clock::now() - due); });
+  }
+  return nullptr;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int threads = argc > 1 ? std::atoi(argv[1])
+                                : static_cast<int>(std::max(
+                                      2u, std::thread::hardware_concurrency()));
+  const int timer_count = argc > 2 ? std::atoi(argv[2]) : 1000000;
+  const std::uint64_t handlers = argc > 3 ? std::atoll(argv[3]) : 4000000;
+  const int strands = argc > 4 ? std::atoi(argv[4]) : 16;
+  std::printf("%d run() threads\n\n", threads);
+
+  std::printf("%-22s %12s %10s\n", "dispatch", "handlers/s", "ns/handler");
+  dispatch("post", threads, handlers, 0);
+  dispatch("1 strand", threads, handlers, 1);
+  const auto many = std::to_string(strands) + " strands";
+  dispatch(many.c_str(), threads, handlers, strands);
+
+  // the same random due times for every kind of timer
+  std::minstd_rand rng(42);
+  std::uniform_int_distribution<long> offset(
+      0, kWindow / std::chrono::microseconds(1));
+  std::vector<Clock::duration> delays(timer_count);
+  for (auto& d : delays) d = kLead + std::chrono::microseconds(offset(rng));
+
+  std::printf("\n%-22s %9s %8s %8s %8s %8s\n", "timers", "arm(ns)",
+              "p50(us)", "p99(us)", "max(us)", "lag(ms)");
+  timers("deadline_timer", threads, delays, arm_deadline_timers);
+  timers("steady_timer", threads, delays, arm_steady_timers);
+  timers("timer_wheel_service", threads, delays, arm_wheel_timers);
+  return 0;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace cppcon_2016_asio_talks {
+
+// A hashed timing wheel as an io_context service, for very many timers of
+// coarse resolution (one tick, 1ms).
+//
+// deadline_timer and steady_timer keep every pending wait in one heap per
+// io_context behind the scheduler's mutex: arming is O(log n) under that
+// lock, and every expiry is a completion of its own. The wheel hashes a wait
+// into the slot of its expiry tick in O(1), and a single steady_timer wakes
+// up once per tick, collects the slot and posts the expired handlers in
+// batches of kBatch.
+//
+// There are no timer objects and no cancellation, only
+//
+//   use_service<timer_wheel_service>(ctx).async_wait(after, handler);
+//
+// The handler runs on its associated executor, so bind_executor(strand, ...)
+// works as with the asio timers. Handlers are stored in a std::function, so
+// they must be copyable.
+class timer_wheel_service : public boost::asio::io_context::service {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  static inline boost::asio::io_context::id id;
+
+  static constexpr clock::duration kTick = std::chrono::milliseconds(1);
+  static constexpr std::size_t kSlots = 1024;
+  static constexpr std::size_t kBatch = 64;
+
+  explicit timer_wheel_service(boost::asio::io_context& ctx)
+      : boost::asio::io_context::service(ctx),
+        ctx_(ctx),
+        timer_(ctx),
+        start_(clock::now()),
+        slots_(kSlots) {}
+
+  // Calls `handler()` once `after` has passed, rounded up to whole ticks.
+  // Thread safe.
+  template <typename Handler>
+  void async_wait(clock::duration after, Handler handler) {
+    std::function<void()> fn = [h = std::move(handler)]() mutable {
+      boost::asio::dispatch(std::move(h));
+    };
+    const auto due = clock::now() + after - start_;
+    const auto tick =
+        static_cast<std::uint64_t>((due + kTick - clock::duration(1)) / kTick);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_ == 0) {
+      // The wheel is empty and no tick wait is outstanding: skip the ticks
+      // that passed while idle, or the next on_tick() walks every one of them.
+      processed_ = std::max(processed_, current_tick());
+    }
+    const auto at = std::max(tick, processed_ + 1);
+    slots_[at % kSlots].push_back(entry{at, std::move(fn)});
+    if (pending_++ == 0) schedule();
+  }
+
+ private:
+  struct entry {
+    std::uint64_t tick;
+    std::function<void()> fn;
+  };
+
+  void shutdown() override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& slot : slots_) slot.clear();
+    pending_ = 0;
+  }
+
+  // The last tick that has fully passed.
+  std::uint64_t current_tick() const {
+    return static_cast<std::uint64_t>((clock::now() - start_) / kTick);
+  }
+
+  // Called with mutex_ held. The pending tick wait is the service's
+  // outstanding work, so run() does not return while waits are pending.
+  void schedule() {
+    timer_.expires_at(start_ + kTick * (processed_ + 1));
+    timer_.async_wait([this](const boost::system::error_code& ec) {
+      if (!ec) on_tick();
+    });
+  }
+
+  void on_tick() {
+    std::vector<std::function<void()>> batch;
+    std::vector<std::vector<std::function<void()>>> batches;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto now = current_tick();
+      for (; processed_ < now; ++processed_) {
+        const auto t = processed_ + 1;
+        auto& slot = slots_[t % kSlots];
+        // entries for later laps of the wheel stay
+        for (std::size_t i = 0; i < slot.size();) {
+          if (slot[i].tick > t) {
+            ++i;
+            continue;
+          }
+          batch.push_back(std::move(slot[i].fn));
+          slot[i] = std::move(slot.back());
+          slot.pop_back();
+          if (batch.size() == kBatch) {
+            batches.push_back(std::move(batch));
+            batch.clear();
+          }
+        }
+      }
+      if (!batch.empty()) batches.push_back(std::move(batch));
+      for (const auto& b : batches) pending_ -= b.size();
+      if (pending_ > 0) schedule();
+    }
+    for (auto& b : batches) {
+      boost::asio::post(ctx_, [b = std::move(b)]() mutable {
+        for (auto& fn : b) fn();
+      });
+    }
+  }
+
+  boost::asio::io_context& ctx_;
+  std::mutex mutex_;
+  boost::asio::steady_timer timer_;
+  const clock::time_point start_;
+  std::vector<std::vector<entry>> slots_;
+  std::uint64_t processed_ = 0;  // ticks up to this one have been collected
+  std::size_t pending_ = 0;
+};
+
+}  // namespace cppcon_2016_asio_talks
@@ -0,0 +1,108 @@
+#ifndef BOOST_ASIO_TALK_ASYNC_EP1_BENCH_UTIL_H
+#define BOOST_ASIO_TALK_ASYNC_EP1_BENCH_UTIL_H
+
+#include <pthread.h>
+#include <time.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+// awaitable.hpp in boost 1.74 uses std::exchange without including <utility>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "latency_histogram.h"
+
+// Pieces shared by the proxy benchmarks: an echo target and a ping-pong
+// client. They use redirect_error instead of as_tuple so they also build with
+// Boost releases that predate as_tuple.
+
+namespace bench {
+
+using boost::asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+inline boost::asio::awaitable<void> echo(tcp::socket socket) {
+  std::vector<char> data(64 * 1024);
+  boost::system::error_code ec;
+  // only the proxy under test should be subject to Nagle
+  socket.set_option(tcp::no_delay(true), ec);
+  for (;;) {
+    auto n = co_await socket.async_read_some(
+        boost::asio::buffer(data),
+        boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    if (ec) co_return;
+    co_await boost::asio::async_write(
+        socket, boost::asio::buffer(data, n),
+        boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    if (ec) co_return;
+  }
+}
+
+inline boost::asio::awaitable<void> echo_listen(tcp::acceptor& acceptor) {
+  for (;;) {
+    auto socket = co_await acceptor.async_accept(boost::asio::use_awaitable);
+    auto ex = socket.get_executor();
+    boost::asio::co_spawn(ex, echo(std::move(socket)), boost::asio::detached);
+  }
+}
+
+struct ping_stats {
+  LatencyHistogram latency;
+  std::uint64_t round_trips = 0;
+  std::uint64_t errors = 0;
+};
+
+// One connection sending `size` byte messages and waiting for each echo,
+// until `end`.
+inline boost::asio::awaitable<void> ping(tcp::endpoint endpoint,
+                                         std::size_t size,
+                                         Clock::time_point end,
+                                         ping_stats& stats) {
+  tcp::socket socket(co_await boost::asio::this_coro::executor);
+  boost::system::error_code ec;
+  co_await socket.async_connect(
+      endpoint, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+  if (ec) {
+    ++stats.errors;
+    co_return;
+  }
+  socket.set_option(tcp::no_delay(true));
+  const std::string request(size, 'p');
+  std::string reply(size, '\0');
+  while (Clock::now() < end) {
+    const auto start = Clock::now();
+    co_await boost::asio::async_write(
+        socket, boost::asio::buffer(request),
+        boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    if (!ec) {
+      co_await boost::asio::async_read(
+          socket, boost::asio::buffer(reply),
+          boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    }
+    if (ec) {
+      ++stats.errors;
+      co_return;
+    }
+    stats.latency.record(Clock::now() - start);
+    ++stats.round_trips;
+  }
+}
+
+// CPU time consumed so far by `thread`.
+inline double thread_cpu_seconds(pthread_t thread) {
+  clockid_t clock;
+  timespec ts{};
+  if (pthread_getcpuclockid(thread, &clock) != 0 ||
+      clock_gettime(clock, &ts) != 0) {
+    return 0;
+  }
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+}  // namespace bench
+
+#endif
@@ -17,4 +17,25 @@ std::optional<std::pair<EndPoint, EndPoint>> ParseArguments(
       *boost::asio::ip::tcp::resolver(ctx).resolve(argv[3], argv[4]);
   return std::optional(
       std::make_pair(std::move(listen_endpoint), std::move(target_endpoint)));
-}
\ No newline at end of file
+}
+
+std::optional<std::pair<EndPoint, std::vector<EndPoint>>> ParseProxyArguments(
+    int argc, char* argv[], boost::asio::io_context& ctx) {
+  if (argc < 5 || argc % 2 == 0) {
+    std::cerr << "Usage: proxy";
+    std::cerr << " <listen_address> <listen_port>";
+    std::cerr << " <target_address> <target_port>";
+    std::cerr << " [<target_address> <target_port> ...]\n";
+    return {};
+  }
+  auto listen_endpoint = *boost::asio::ip::tcp::resolver(ctx).resolve(
+      argv[1], argv[2], boost::asio::ip::tcp::tcp::resolver::passive);
+
+  std::vector<EndPoint> target_endpoints;
+  for (int i = 3; i + 1 < argc; i += 2) {
+    target_endpoints.push_back(
+        *boost::asio::ip::tcp::resolver(ctx).resolve(argv[i], argv[i + 1]));
+  }
+  return std::optional(std::make_pair(std::move(listen_endpoint),
+                                      std::move(target_endpoints)));
+}
@@ -5,10 +5,15 @@
 #include <boost/asio/ip/basic_resolver.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <optional>
+#include <vector>
 
 using EndPoint = boost::asio::ip::basic_resolver_entry<boost::asio::ip::tcp>;
 
 std::optional<std::pair<EndPoint, EndPoint>> ParseArguments(
     int argc, char* argv[], boost::asio::io_context& ctx);
 
+// Like ParseArguments, but accepts one or more target address/port pairs.
+std::optional<std::pair<EndPoint, std::vector<EndPoint>>> ParseProxyArguments(
+    int argc, char* argv[], boost::asio::io_context& ctx);
+
 #endif
@@ -0,0 +1,180 @@
+#ifndef BOOST_ASIO_TALK_ASYNC_EP1_TIMING_WHEEL_H
+#define BOOST_ASIO_TALK_ASYNC_EP1_TIMING_WHEEL_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+// Coarse timeouts for many connections from one timer.
+//
+// step_7 raced every read and write against a fresh steady_timer: a timer
+// object, a coroutine frame and a timer-queue insert/cancel per I/O. step_5
+// avoided that with one deadline per connection that transfers only bump and
+// a watchdog re-arms lazily, but that deadline can only move later, so it
+// cannot express "5s to read, then 1s to write".
+//
+// timing_wheel generalizes step_5's deadline. There is one steady_timer per
+// wheel (per thread) ticking every `tick`, and a ring of slots, each an
+// intrusive list of entries. An entry is one deadline of a connection:
+//
+//   - expires_after(d) stores the expiry tick. Moving it later just writes a
+//     number (lazy: the entry stays in its old slot and is relinked when that
+//     slot comes round). Moving it earlier relinks it: a few pointer writes.
+//   - so there is no allocation, syscall or timer-queue work per I/O
+//   - when an entry's slot comes round and its expiry has been reached, its
+//     callback runs (typically: close the sockets, so the pending operations
+//     complete with an error)
+//
+// Timeouts are accurate to one tick. Single-threaded: the wheel and its
+// entries must be used from the wheel's executor.
+
+class timing_wheel {
+  struct node {
+    node* prev = nullptr;
+    node* next = nullptr;
+
+    bool linked() const { return prev != nullptr; }
+
+    void unlink() {
+      if (!linked()) return;
+      prev->next = next;
+      if (next) next->prev = prev;
+      prev = next = nullptr;
+    }
+
+    void push_front(node& n) {
+      n.prev = this;
+      n.next = next;
+      if (next) next->prev = &n;
+      next = &n;
+    }
+  };
+
+ public:
+  using clock = std::chrono::steady_clock;
+
+  class entry : private node {
+   public:
+    entry(timing_wheel& wheel, std::function<void()> on_expire)
+        : wheel_(wheel), on_expire_(std::move(on_expire)) {}
+
+    entry(const entry&) = delete;
+    entry& operator=(const entry&) = delete;
+
+    ~entry() { unlink(); }
+
+    // Fire `timeout` from now (rounded up to whole ticks) unless re-armed or
+    // cancelled before.
+    void expires_after(clock::duration timeout) {
+      const auto ticks = std::max<clock::rep>(
+          1, (timeout + wheel_.tick_ - clock::duration(1)) / wheel_.tick_);
+      expiry_ = wheel_.now_ + static_cast<std::uint64_t>(ticks);
+      // relink if idle, if moving earlier, or if currently firing
+      if (!linked() || expiry_ < slot_ || slot_ <= wheel_.now_) {
+        unlink();
+        wheel_.link(*this, expiry_);
+      }
+    }
+
+    void cancel() { unlink(); }
+
+    bool armed() const { return linked(); }
+
+   private:
+    friend class timing_wheel;
+
+    timing_wheel& wheel_;
+    std::function<void()> on_expire_;
+    std::uint64_t expiry_ = 0;  // tick at which the entry fires
+    std::uint64_t slot_ = 0;    // tick of the slot it is linked into
+  };
+
+  explicit timing_wheel(boost::asio::any_io_executor ex,
+                        clock::duration tick = std::chrono::milliseconds(100),
+                        std::size_t slots = 256)
+      : timer_(std::move(ex)), tick_(tick), slots_(slots) {}
+
+  timing_wheel(const timing_wheel&) = delete;
+  timing_wheel& operator=(const timing_wheel&) = delete;
+
+  // Entries that outlive the wheel (e.g. in coroutine frames destroyed with
+  // the io_context) become unarmed instead of pointing into freed slots.
+  ~timing_wheel() {
+    for (auto& head : slots_) {
+      while (head.next) head.next->unlink();
+    }
+  }
+
+  void start() {
+    stopped_ = false;
+    next_tick_ = clock::now() + tick_;
+    schedule();
+  }
+
+  void stop() {
+    stopped_ = true;
+    timer_.cancel();
+  }
+
+  clock::duration tick() const { return tick_; }
+
+ private:
+  void link(entry& e, std::uint64_t at) {
+    slots_[at % slots_.size()].push_front(e);
+    e.slot_ = at;
+  }
+
+  void schedule() {
+    timer_.expires_at(next_tick_);
+    timer_.async_wait([this](const boost::system::error_code& ec) {
+      if (ec || stopped_) return;
+      // catch up if the thread was busy for more than one tick
+      const auto now = clock::now();
+      while (next_tick_ <= now) {
+        ++now_;
+        next_tick_ += tick_;
+        advance();
+      }
+      schedule();
+    });
+  }
+
+  // Process the slot of tick now_.
+  void advance() {
+    node& head = slots_[now_ % slots_.size()];
+    for (node* n = head.next; n;) {
+      auto* e = static_cast<entry*>(n);
+      n = n->next;
+      if (e->slot_ != now_) continue;  // a later lap of the wheel
+      e->unlink();
+      if (e->expiry_ > now_) {
+        link(*e, e->expiry_);  // moved later since it was linked
+      } else {
+        firing_.push_front(*e);
+      }
+    }
+    // A callback may cancel, re-arm or destroy other firing entries; each of
+    // those unlinks the entry from firing_, so pop one at a time.
+    while (firing_.next) {
+      auto* e = static_cast<entry*>(firing_.next);
+      e->unlink();
+      e->on_expire_();
+    }
+  }
+
+  boost::asio::steady_timer timer_;
+  clock::duration tick_;
+  std::vector<node> slots_;
+  node firing_;
+  std::uint64_t now_ = 0;
+  clock::time_point next_tick_{};
+  bool stopped_ = false;
+};
+
+#endif
@@ -0,0 +1,315 @@
+#ifndef BOOST_ASIO_TALK_ASYNC_EP1_UPSTREAM_POOL_H
+#define BOOST_ASIO_TALK_ASYNC_EP1_UPSTREAM_POOL_H
+
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+// Warm upstream connections for the proxy.
+//
+// A TCP proxy cannot give a used upstream connection to the next client (the
+// byte stream belongs to one session), so reuse here means connecting ahead of
+// time: the pool keeps `spares` connected sockets per target, hands one out per
+// accepted client and connects a replacement in the background. A client no
+// longer waits for a TCP handshake with the target before its first byte is
+// forwarded.
+//
+// Health checking: every idle spare has an async_wait(wait_read) outstanding.
+// An idle upstream should never become readable, so a completion means the
+// target closed it (or sent something unexpected) and the spare is dropped.
+// acquire() also peeks the socket before handing it out. Spares idle for
+// longer than idle_timeout are closed and replaced, so the target's own idle
+// timeout never races with a client. A failed connect marks the target down
+// for retry_backoff.
+//
+// Balancing: with several targets, acquire() picks the target that is up and
+// has the fewest leases outstanding (ties rotate).
+//
+// Single-threaded: all members must be used from the pool's executor.
+
+struct upstream_pool_options {
+  // Connected spares kept per target; 0 means connect on demand only.
+  std::size_t spares = 4;
+  std::chrono::steady_clock::duration idle_timeout = std::chrono::seconds(30);
+  std::chrono::steady_clock::duration retry_backoff = std::chrono::seconds(1);
+};
+
+class upstream_pool : public std::enable_shared_from_this<upstream_pool> {
+  using tcp = boost::asio::ip::tcp;
+  using steady_clock = std::chrono::steady_clock;
+
+  struct spare {
+    explicit spare(tcp::socket s)
+        : socket(std::move(s)), connected_at(steady_clock::now()) {}
+
+    tcp::socket socket;
+    steady_clock::time_point connected_at;
+    bool taken = false;  // handed out or swept; the watcher must ignore it
+  };
+
+  struct target {
+    explicit target(tcp::endpoint e) : endpoint(std::move(e)) {}
+
+    tcp::endpoint endpoint;
+    std::list<std::shared_ptr<spare>> spares;
+    std::size_t connecting = 0;
+    std::size_t outstanding = 0;
+    std::uint64_t leases = 0;
+    steady_clock::time_point down_until{};
+  };
+
+ public:
+  // An upstream connection handed to one client session. Keeps the target's
+  // outstanding count up while alive.
+  class lease {
+   public:
+    lease(tcp::socket socket, std::shared_ptr<target> t, bool warm)
+        : socket_(std::move(socket)), target_(std::move(t)), warm_(warm) {}
+
+    lease(lease&& other) noexcept = default;
+    lease& operator=(lease&&) = delete;
+
+    ~lease() {
+      if (target_) --target_->outstanding;
+    }
+
+    tcp::socket& socket() { return socket_; }
+    const tcp::endpoint& endpoint() const { return target_->endpoint; }
+    // true when the connection came from the pool, false when connected
+    // on demand
+    bool warm() const { return warm_; }
+
+   private:
+    tcp::socket socket_;
+    std::shared_ptr<target> target_;
+    bool warm_ = false;
+  };
+
+  upstream_pool(boost::asio::any_io_executor ex,
+                const std::vector<tcp::endpoint>& endpoints,
+                upstream_pool_options options = {})
+      : ex_(std::move(ex)), options_(options), sweep_timer_(ex_) {
+    for (const auto& e : endpoints) {
+      targets_.push_back(std::make_shared<target>(e));
+    }
+  }
+
+  // Fill every target's spares and start the idle sweeper.
+  void start() {
+    for (auto& t : targets_) fill(t);
+    if (options_.spares > 0) sweep();
+  }
+
+  // Close the idle spares; leases already handed out are not affected.
+  void stop() {
+    stopped_ = true;
+    sweep_timer_.cancel();
+    for (auto& t : targets_) {
+      for (auto& s : t->spares) close(*s);
+      t->spares.clear();
+    }
+  }
+
+  // An upstream connection to the least loaded target, or nullopt if none
+  // could be connected.
+  boost::asio::awaitable<std::optional<lease>> acquire() {
+    auto self = shared_from_this();
+    auto t = pick();
+    if (!t) co_return std::nullopt;
+    ++t->outstanding;
+
+    while (!t->spares.empty()) {
+      auto s = std::move(t->spares.front());
+      t->spares.pop_front();
+      s->taken = true;
+      boost::system::error_code ignored;
+      s->socket.cancel(ignored);
+      if (expired(*s) || !idle_and_open(s->socket)) {
+        close(*s);
+        ++discarded_;
+        continue;
+      }
+      ++warm_hits_;
+      ++t->leases;
+      fill(t);
+      co_return lease(std::move(s->socket), t, true);
+    }
+
+    fill(t);
+    ++cold_connects_;
+    tcp::socket socket(ex_);
+    boost::system::error_code ec;
+    co_await socket.async_connect(
+        t->endpoint,
+        boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    if (ec) {
+      --t->outstanding;
+      mark_down(*t);
+      co_return std::nullopt;
+    }
+    ++t->leases;
+    co_return lease(std::move(socket), t, false);
+  }
+
+  std::uint64_t warm_hits() const { return warm_hits_; }
+  std::uint64_t cold_connects() const { return cold_connects_; }
+  std::uint64_t connect_failures() const { return connect_failures_; }
+  // spares dropped by the health check or the idle timeout
+  std::uint64_t discarded() const { return discarded_; }
+
+  // Leases handed out per target, in constructor order.
+  std::vector<std::uint64_t> leases_per_target() const {
+    std::vector<std::uint64_t> result;
+    for (const auto& t : targets_) result.push_back(t->leases);
+    return result;
+  }
+
+ private:
+  std::shared_ptr<target> pick() {
+    if (targets_.empty()) return nullptr;
+    const auto now = steady_clock::now();
+    std::shared_ptr<target> best;
+    bool best_up = false;
+    for (std::size_t i = 0; i < targets_.size(); ++i) {
+      auto& t = targets_[(next_ + i) % targets_.size()];
+      const bool up = t->down_until <= now;
+      if (!best || (up && !best_up) ||
+          (up == best_up && t->outstanding < best->outstanding)) {
+        best = t;
+        best_up = up;
+      }
+    }
+    next_ = (next_ + 1) % targets_.size();
+    return best;
+  }
+
+  void fill(const std::shared_ptr<target>& t) {
+    while (!stopped_ && t->spares.size() + t->connecting < options_.spares &&
+           t->down_until <= steady_clock::now()) {
+      ++t->connecting;
+      boost::asio::co_spawn(ex_, connect_spare(t), boost::asio::detached);
+    }
+  }
+
+  boost::asio::awaitable<void> connect_spare(std::shared_ptr<target> t) {
+    auto self = shared_from_this();
+    tcp::socket socket(ex_);
+    boost::system::error_code ec;
+    co_await socket.async_connect(
+        t->endpoint,
+        boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+
+    --t->connecting;
+    if (ec) {
+      mark_down(*t);
+      retry_later(t);
+      co_return;
+    }
+    if (stopped_) co_return;
+
+    auto s = std::make_shared<spare>(std::move(socket));
+    t->spares.push_back(s);
+    watch(t, s);
+  }
+
+  // Refill `t` after retry_backoff. Counts as a connect in progress
+  // meanwhile, so fill() does not hammer a target that is down.
+  void retry_later(std::shared_ptr<target> t) {
+    if (stopped_) return;
+    ++t->connecting;
+    auto timer = std::make_shared<boost::asio::steady_timer>(
+        ex_, options_.retry_backoff);
+    timer->async_wait([self = shared_from_this(), t = std::move(t),
+                       timer](const boost::system::error_code&) {
+      --t->connecting;
+      self->fill(t);
+    });
+  }
+
+  void watch(std::shared_ptr<target> t, std::shared_ptr<spare> s) {
+    s->socket.async_wait(
+        tcp::socket::wait_read,
+        [self = shared_from_this(), t = std::move(t),
+         s](const boost::system::error_code&) {
+          if (s->taken || self->stopped_) return;
+          // readable while idle: closed by the target, drop it
+          s->taken = true;
+          self->close(*s);
+          t->spares.remove(s);
+          ++self->discarded_;
+          if (steady_clock::now() - s->connected_at <
+              self->options_.retry_backoff) {
+            // closed right away: treat it like a refused connect
+            self->mark_down(*t);
+            self->retry_later(t);
+          } else {
+            self->fill(t);
+          }
+        });
+  }
+
+  void sweep() {
+    sweep_timer_.expires_after(std::max<steady_clock::duration>(
+        options_.idle_timeout / 4, std::chrono::milliseconds(10)));
+    sweep_timer_.async_wait(
+        [self = shared_from_this()](const boost::system::error_code& ec) {
+          if (ec || self->stopped_) return;
+          for (auto& t : self->targets_) {
+            t->spares.remove_if([&self](const std::shared_ptr<spare>& s) {
+              if (!self->expired(*s)) return false;
+              s->taken = true;
+              self->close(*s);
+              ++self->discarded_;
+              return true;
+            });
+            self->fill(t);
+          }
+          self->sweep();
+        });
+  }
+
+  bool expired(const spare& s) const {
+    return steady_clock::now() - s.connected_at >= options_.idle_timeout;
+  }
+
+  // Nothing to read and not at EOF, i.e. still a usable idle connection.
+  static bool idle_and_open(tcp::socket& socket) {
+    char c;
+    const auto n =
+        ::recv(socket.native_handle(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+  }
+
+  void mark_down(target& t) {
+    ++connect_failures_;
+    t.down_until = steady_clock::now() + options_.retry_backoff;
+  }
+
+  static void close(spare& s) {
+    boost::system::error_code ignored;
+    s.socket.close(ignored);
+  }
+
+  boost::asio::any_io_executor ex_;
+  upstream_pool_options options_;
+  std::vector<std::shared_ptr<target>> targets_;
+  boost::asio::steady_timer sweep_timer_;
+  std::size_t next_ = 0;
+  bool stopped_ = false;
+  std::uint64_t warm_hits_ = 0;
+  std::uint64_t cold_connects_ = 0;
+  std::uint64_t connect_failures_ = 0;
+  std::uint64_t discarded_ = 0;
+};
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef BOOST_ASIO_TALK_ASYNC_EP1_ZERO_COPY_H
+#define BOOST_ASIO_TALK_ASYNC_EP1_ZERO_COPY_H
+
+#include <algorithm>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/system/error_code.hpp>
+#include <cerrno>
+#include <cstddef>
+#include <memory>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#define TALK_ASYNC_HAS_SPLICE 1
+#endif
+
+// Two ways to forward bytes faster than the 1KB std::array copy loop.
+//
+// splice_pipe (Linux): splice() moves data socket -> pipe -> socket inside
+// the kernel, so the payload is never copied into user space. The caller
+// waits for readiness with async_wait and then calls fill()/drain(); both
+// sockets must be in non-blocking mode.
+//
+// adaptive_buffer: the portable fallback. Starts small and doubles every time
+// a read fills it completely (a bulk transfer), halves again after a run of
+// short reads (interactive traffic), so idle connections stay cheap and busy
+// ones make fewer, larger syscalls.
+
+#ifdef TALK_ASYNC_HAS_SPLICE
+class splice_pipe {
+ public:
+  // 1MB of pipe capacity is requested; the kernel may clamp it to
+  // /proc/sys/fs/pipe-max-size.
+  static constexpr int kPipeSize = 1 << 20;
+
+  splice_pipe() {
+    if (::pipe2(fds_, O_NONBLOCK | O_CLOEXEC) != 0) {
+      fds_[0] = fds_[1] = -1;
+      return;
+    }
+    ::fcntl(fds_[1], F_SETPIPE_SZ, kPipeSize);
+  }
+
+  splice_pipe(const splice_pipe&) = delete;
+  splice_pipe& operator=(const splice_pipe&) = delete;
+
+  ~splice_pipe() {
+    if (valid()) {
+      ::close(fds_[0]);
+      ::close(fds_[1]);
+    }
+  }
+
+  bool valid() const { return fds_[0] >= 0; }
+
+  // Bytes sitting in the pipe, i.e. read from the source but not yet written.
+  std::size_t size() const { return buffered_; }
+
+  // Move what is readable on `fd` into the pipe. Returns the byte count, 0
+  // with no error meaning EOF. ec is would_block when nothing was readable.
+  std::size_t fill(int fd, boost::system::error_code& ec) {
+    return move(fd, fds_[1], ec, true);
+  }
+
+  // Move as much of the pipe as `fd` accepts. ec is would_block when the
+  // socket's send buffer is full.
+  std::size_t drain(int fd, boost::system::error_code& ec) {
+    return move(fds_[0], fd, ec, false);
+  }
+
+ private:
+  std::size_t move(int in, int out, boost::system::error_code& ec,
+                   bool into_pipe) {
+    ec.clear();
+    const std::size_t len = into_pipe ? kPipeSize : buffered_;
+    for (;;) {
+      const ssize_t n = ::splice(in, nullptr, out, nullptr, len,
+                                 SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (n >= 0) {
+        const auto moved = static_cast<std::size_t>(n);
+        buffered_ = into_pipe ? buffered_ + moved : buffered_ - moved;
+        return moved;
+      }
+      if (errno == EINTR) continue;
+      ec = errno == EAGAIN ? boost::asio::error::would_block
+                           : boost::system::error_code(
+                                 errno, boost::system::system_category());
+      return 0;
+    }
+  }
+
+  int fds_[2] = {-1, -1};
+  std::size_t buffered_ = 0;
+};
+#endif
+
+class adaptive_buffer {
+ public:
+  static constexpr std::size_t kMinSize = 4 * 1024;
+  static constexpr std::size_t kMaxSize = 256 * 1024;
+  // This many consecutive reads under a quarter of the buffer shrink it.
+  static constexpr int kShrinkAfter = 8;
+
+  boost::asio::mutable_buffer prepare() {
+    if (!data_ || capacity_ != size_) {
+      data_ = std::make_unique_for_overwrite<char[]>(size_);
+      capacity_ = size_;
+    }
+    return boost::asio::buffer(data_.get(), size_);
+  }
+
+  boost::asio::const_buffer data(std::size_t n) const {
+    return boost::asio::buffer(data_.get(), n);
+  }
+
+  // Record a read of n bytes into prepare()'s buffer; resizes for the next
+  // read, the current data stays valid until the next prepare().
+  void commit(std::size_t n) {
+    if (n == size_) {
+      size_ = std::min(size_ * 2, kMaxSize);
+      small_reads_ = 0;
+    } else if (n < size_ / 4 && ++small_reads_ >= kShrinkAfter) {
+      size_ = std::max(size_ / 2, kMinSize);
+      small_reads_ = 0;
+    }
+  }
+
+  std::size_t size() const { return size_; }
+
+ private:
+  std::unique_ptr<char[]> data_;
+  std::size_t capacity_ = 0;
+  std::size_t size_ = kMinSize;
+  int small_reads_ = 0;
+};
+
+#endif
@@ -0,0 +1,222 @@
+// Connection setup cost of the proxy: connect-per-client vs upstream_pool.
+//
+// Everything runs in one process on loopback:
+//
+//   clients --> proxy --> 2 echo targets
+//
+// Each client loops over short-lived sessions: connect to the proxy, send one
+// 32 byte request, read the echo, close. The proxy takes its upstream from an
+// upstream_pool, once with spares = 0 (an async_connect per client, what
+// step_7 used to do) and once with warm spares.
+//
+// Reported per configuration: sessions/sec, the time the proxy spent getting
+// an upstream (acquire), the client-observed session latency, and how the
+// sessions were spread over the two targets.
+//
+// On loopback a handshake costs tens of microseconds; against a remote target
+// the saving is a full round trip per session.
+//
+// usage: pool_bench [clients] [seconds] [spares]
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+// awaitable.hpp in boost 1.74 uses std::exchange without including <utility>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "common/upstream_pool.h"
+#include "latency_histogram.h"
+
+using boost::asio::awaitable;
+using boost::asio::buffer;
+using boost::asio::co_spawn;
+using boost::asio::detached;
+using boost::asio::redirect_error;
+using boost::asio::use_awaitable;
+using boost::asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+awaitable<void> echo(tcp::socket socket) {
+  std::array<char, 1024> data;
+  boost::system::error_code ec;
+  for (;;) {
+    auto n = co_await socket.async_read_some(buffer(data),
+                                             redirect_error(use_awaitable, ec));
+    if (ec) co_return;
+    co_await async_write(socket, buffer(data, n),
+                         redirect_error(use_awaitable, ec));
+    if (ec) co_return;
+  }
+}
+
+awaitable<void> echo_listen(tcp::acceptor& acceptor) {
+  for (;;) {
+    auto socket = co_await acceptor.async_accept(use_awaitable);
+    auto ex = socket.get_executor();
+    co_spawn(ex, echo(std::move(socket)), detached);
+  }
+}
+
+struct session {
+  session(tcp::socket c, upstream_pool::lease l)
+      : client(std::move(c)), upstream(std::move(l)) {}
+
+  void close() {
+    boost::system::error_code ignored;
+    client.close(ignored);
+    upstream.socket().close(ignored);
+  }
+
+  tcp::socket client;
+  upstream_pool::lease upstream;
+};
+
+awaitable<void> transfer(std::shared_ptr<session> s, bool to_upstream) {
+  auto& from = to_upstream ? s->client : s->upstream.socket();
+  auto& to = to_upstream ? s->upstream.socket() : s->client;
+  std::array<char, 1024> data;
+  boost::system::error_code ec;
+  for (;;) {
+    auto n = co_await from.async_read_some(buffer(data),
+                                           redirect_error(use_awaitable, ec));
+    if (ec) break;
+    co_await async_write(to, buffer(data, n),
+                         redirect_error(use_awaitable, ec));
+    if (ec) break;
+  }
+  s->close();
+}
+
+awaitable<void> proxy(tcp::socket client, std::shared_ptr<upstream_pool> pool,
+                      LatencyHistogram& acquire_latency) {
+  const auto start = Clock::now();
+  auto upstream = co_await pool->acquire();
+  acquire_latency.record(Clock::now() - start);
+  if (!upstream) co_return;
+
+  auto s = std::make_shared<session>(std::move(client), std::move(*upstream));
+  auto ex = s->client.get_executor();
+  co_spawn(ex, transfer(s, true), detached);
+  co_spawn(ex, transfer(s, false), detached);
+}
+
+awaitable<void> proxy_listen(tcp::acceptor& acceptor,
+                             std::shared_ptr<upstream_pool> pool,
+                             LatencyHistogram& acquire_latency) {
+  for (;;) {
+    auto client = co_await acceptor.async_accept(use_awaitable);
+    auto ex = client.get_executor();
+    co_spawn(ex, proxy(std::move(client), pool, acquire_latency), detached);
+  }
+}
+
+awaitable<void> client_loop(tcp::endpoint proxy_endpoint,
+                            Clock::time_point end, LatencyHistogram& latency,
+                            std::uint64_t& sessions) {
+  auto ex = co_await boost::asio::this_coro::executor;
+  const std::string request(32, 'r');
+  std::array<char, 32> reply;
+  boost::system::error_code ec;
+  while (Clock::now() < end) {
+    const auto start = Clock::now();
+    tcp::socket socket(ex);
+    co_await socket.async_connect(proxy_endpoint,
+                                  redirect_error(use_awaitable, ec));
+    if (ec) continue;
+    socket.set_option(tcp::no_delay(true));
+    co_await async_write(socket, buffer(request),
+                         redirect_error(use_awaitable, ec));
+    if (ec) continue;
+    co_await async_read(socket, buffer(reply),
+                        redirect_error(use_awaitable, ec));
+    if (ec) continue;
+    latency.record(Clock::now() - start);
+    ++sessions;
+  }
+}
+
+void run(const char* name, std::size_t spares, int clients, int seconds) {
+  const auto loopback = boost::asio::ip::address_v4::loopback();
+
+  boost::asio::io_context backend_ctx(1);
+  tcp::acceptor backend1(backend_ctx, tcp::endpoint(loopback, 0));
+  tcp::acceptor backend2(backend_ctx, tcp::endpoint(loopback, 0));
+  co_spawn(backend_ctx, echo_listen(backend1), detached);
+  co_spawn(backend_ctx, echo_listen(backend2), detached);
+  std::thread backend_thread([&backend_ctx] { backend_ctx.run(); });
+
+  boost::asio::io_context proxy_ctx(1);
+  tcp::acceptor proxy_acceptor(proxy_ctx, tcp::endpoint(loopback, 0));
+  upstream_pool_options options;
+  options.spares = spares;
+  auto pool = std::make_shared<upstream_pool>(
+      proxy_ctx.get_executor(),
+      std::vector<tcp::endpoint>{backend1.local_endpoint(),
+                                 backend2.local_endpoint()},
+      options);
+  LatencyHistogram acquire_latency;
+  pool->start();
+  co_spawn(proxy_ctx, proxy_listen(proxy_acceptor, pool, acquire_latency),
+           detached);
+  std::thread proxy_thread([&proxy_ctx] { proxy_ctx.run(); });
+
+  boost::asio::io_context client_ctx(1);
+  LatencyHistogram session_latency;
+  std::uint64_t sessions = 0;
+  const auto start = Clock::now();
+  const auto end = start + std::chrono::seconds(seconds);
+  for (int i = 0; i < clients; ++i) {
+    co_spawn(client_ctx,
+             client_loop(proxy_acceptor.local_endpoint(), end, session_latency,
+                         sessions),
+             detached);
+  }
+  client_ctx.run();
+  const double elapsed =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  // read the pool's counters on its own thread, then shut everything down
+  std::promise<std::vector<std::uint64_t>> per_target;
+  boost::asio::post(proxy_ctx, [&] {
+    pool->stop();
+    per_target.set_value(pool->leases_per_target());
+  });
+  const auto leases = per_target.get_future().get();
+  proxy_ctx.stop();
+  backend_ctx.stop();
+  proxy_thread.join();
+  backend_thread.join();
+
+  std::printf("%s: %.0f sessions/s, warm=%llu cold=%llu, "
+              "per target %llu/%llu\n",
+              name, sessions / elapsed,
+              static_cast<unsigned long long>(pool->warm_hits()),
+              static_cast<unsigned long long>(pool->cold_connects()),
+              static_cast<unsigned long long>(leases[0]),
+              static_cast<unsigned long long>(leases[1]));
+  acquire_latency.print("  upstream acquire");
+  session_latency.print("  client session  ");
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int clients = argc > 1 ? std::atoi(argv[1]) : 8;
+  const int seconds = argc > 2 ? std::atoi(argv[2]) : 3;
+  const std::size_t spares =
+      argc > 3 ? static_cast<std::size_t>(std::atoi(argv[3])) : 16;
+  std::printf("%d clients, %ds per configuration\n", clients, seconds);
+
+  run("connect per client", 0, clients, seconds);
+  run("upstream pool     ", spares, clients, seconds);
+  return 0;
+}
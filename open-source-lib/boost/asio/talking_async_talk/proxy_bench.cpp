@@ -0,0 +1,306 @@
+// Benchmark harness comparing the proxy of every step.
+//
+// Each step_N.cpp is compiled into this binary inside `namespace step_N`
+// (its main() renamed to step_main() by a macro), and its own listen() serves
+// the proxy:
+//
+//   ping-pong clients --> step_N proxy --> echo target
+//
+// All three run in one process, each on its own thread. For every message
+// size and connection count, each connection sends a message and waits for
+// the echo, back to back. Reported per step:
+//
+//   MB/s         payload through the proxy, both directions
+//   p50/p99      client round-trip latency
+//   allocs/rt    heap allocations on the proxy thread per round trip (one
+//                forwarded message each way)
+//   ns/byte      proxy-thread CPU time per forwarded byte
+//
+// The steps do not set TCP_NODELAY, as in the talk. After the warm-up the
+// harness sets it on every TCP socket of the process, the proxy's included,
+// so messages larger than the steps' 1KB buffer do not wait for delayed ACKs.
+//
+// Steps 2-7 need as_tuple and the awaitable operators (Boost 1.77+). With an
+// older Boost, such as 1.74, only steps 0 and 1 are built and
+// measured; the others are reported as skipped.
+//
+// usage: proxy_bench [seconds-per-run] [connections,...] [sizes,...]
+//   e.g. proxy_bench 2 1,64 64,1024,16384
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/bench_util.h"
+#include "common/common.h"
+
+#if __has_include(<boost/asio/experimental/as_tuple.hpp>)
+#include <boost/asio/experimental/as_tuple.hpp>
+#define TALK_ASYNC_HAS_AS_TUPLE 1
+#endif
+#if __has_include(<boost/asio/experimental/awaitable_operators.hpp>)
+#include <boost/asio/experimental/awaitable_operators.hpp>
+#define TALK_ASYNC_HAS_AWAITABLE_OPERATORS 1
+#endif
+#ifdef TALK_ASYNC_HAS_AWAITABLE_OPERATORS
+#include "common/timing_wheel.h"
+#include "common/upstream_pool.h"
+#include "common/zero_copy.h"
+#endif
+
+namespace {
+thread_local bool t_count_allocs = false;
+std::atomic<std::uint64_t> g_allocs{0};
+}  // namespace
+
+void* operator new(std::size_t size) {
+  if (t_count_allocs) g_allocs.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+// Every header the steps use is included above, so their include guards keep
+// the #includes inside the namespaces below empty. Each step's main() becomes
+// an unused step_N::step_main().
+#define main step_main
+
+namespace step_0 {
+#include "step_0.cpp"
+}
+namespace step_1 {
+#include "step_1.cpp"
+}
+#ifdef TALK_ASYNC_HAS_AS_TUPLE
+namespace step_2 {
+#include "step_2.cpp"
+}
+namespace step_3 {
+#include "step_3.cpp"
+}
+#endif
+#if defined(TALK_ASYNC_HAS_AS_TUPLE) && \
+    defined(TALK_ASYNC_HAS_AWAITABLE_OPERATORS)
+#define TALK_ASYNC_HAS_STEPS_4_TO_7 1
+namespace step_4 {
+#include "step_4.cpp"
+}
+namespace step_5 {
+#include "step_5.cpp"
+}
+namespace step_6 {
+#include "step_6.cpp"
+}
+namespace step_7 {
+#include "step_7.cpp"
+}
+#endif
+#undef main
+
+using boost::asio::co_spawn;
+using boost::asio::detached;
+using boost::asio::ip::tcp;
+
+namespace {
+// Starts a step's proxy on `acceptor`; the returned object is kept alive for
+// the run (state the step's main() would own, such as step_7's pool).
+using start_fn =
+    std::function<std::shared_ptr<void>(tcp::acceptor&, tcp::endpoint)>;
+
+struct step {
+  const char* name;
+  start_fn start;  // empty: not buildable with this Boost
+};
+
+template <typename Listen>
+start_fn spawn_listen(Listen listen) {
+  return [listen](tcp::acceptor& acceptor, tcp::endpoint target) {
+    co_spawn(acceptor.get_executor(), listen(acceptor, target), detached);
+    return std::shared_ptr<void>();
+  };
+}
+
+std::vector<step> steps() {
+  std::vector<step> result;
+  result.push_back({"step_0", [](tcp::acceptor& acceptor, tcp::endpoint t) {
+                      step_0::listen(acceptor, t);
+                      return std::shared_ptr<void>();
+                    }});
+  result.push_back({"step_1", spawn_listen([](auto& a, auto t) {
+                      return step_1::listen(a, t);
+                    })});
+#ifdef TALK_ASYNC_HAS_AS_TUPLE
+  result.push_back({"step_2", spawn_listen([](auto& a, auto t) {
+                      return step_2::listen(a, t);
+                    })});
+  result.push_back({"step_3", spawn_listen([](auto& a, auto t) {
+                      return step_3::listen(a, t);
+                    })});
+#else
+  result.push_back({"step_2", {}});
+  result.push_back({"step_3", {}});
+#endif
+#ifdef TALK_ASYNC_HAS_STEPS_4_TO_7
+  result.push_back({"step_4", spawn_listen([](auto& a, auto t) {
+                      return step_4::listen(a, t);
+                    })});
+  result.push_back({"step_5", spawn_listen([](auto& a, auto t) {
+                      return step_5::listen(a, t);
+                    })});
+  result.push_back({"step_6", spawn_listen([](auto& a, auto t) {
+                      return step_6::listen(a, t);
+                    })});
+  result.push_back({"step_7", [](tcp::acceptor& acceptor, tcp::endpoint t) {
+                      struct state {
+                        std::shared_ptr<upstream_pool> pool;
+                        std::unique_ptr<timing_wheel> wheel;
+                      };
+                      auto ex = acceptor.get_executor();
+                      auto s = std::make_shared<state>();
+                      s->pool = std::make_shared<upstream_pool>(
+                          ex, std::vector<tcp::endpoint>{t});
+                      s->pool->start();
+                      s->wheel = std::make_unique<timing_wheel>(ex);
+                      s->wheel->start();
+                      co_spawn(ex, step_7::listen(acceptor, s->pool, *s->wheel),
+                               detached);
+                      return std::shared_ptr<void>(s);
+                    }});
+#else
+  for (const char* name : {"step_4", "step_5", "step_6", "step_7"}) {
+    result.push_back({name, {}});
+  }
+#endif
+  return result;
+}
+
+// Sets TCP_NODELAY on every open TCP socket of the process. The steps'
+// sockets are out of reach otherwise; all connections have done a round trip
+// by the time this runs, so both sides of every proxied connection exist.
+// Sockets opened later (step_7 replacing a spare, say) keep Nagle.
+void no_delay_everywhere() {
+  const int on = 1;
+  std::error_code ec;
+  for (const auto& entry :
+       std::filesystem::directory_iterator("/proc/self/fd", ec)) {
+    const int fd = std::atoi(entry.path().filename().c_str());
+    // fails harmlessly for anything that is not a TCP socket
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+}
+
+void run(const step& st, int connections, std::size_t size, int seconds) {
+  if (!st.start) {
+    std::printf("%-7s %6d %7zu  skipped (needs Boost 1.77+)\n", st.name,
+                connections, size);
+    return;
+  }
+  const auto loopback = boost::asio::ip::address_v4::loopback();
+
+  boost::asio::io_context backend_ctx(1);
+  tcp::acceptor backend(backend_ctx, tcp::endpoint(loopback, 0));
+  co_spawn(backend_ctx, bench::echo_listen(backend), detached);
+  std::thread backend_thread([&backend_ctx] { backend_ctx.run(); });
+
+  boost::asio::io_context proxy_ctx(1);
+  tcp::acceptor proxy_acceptor(proxy_ctx, tcp::endpoint(loopback, 0));
+  auto keep_alive = st.start(proxy_acceptor, backend.local_endpoint());
+  std::thread proxy_thread([&proxy_ctx] {
+    t_count_allocs = true;
+    proxy_ctx.run();
+    t_count_allocs = false;
+  });
+
+  boost::asio::io_context client_ctx(1);
+  std::vector<bench::ping_stats> stats(connections);
+  const auto warm = bench::Clock::now() + std::chrono::milliseconds(200);
+  const auto end = warm + std::chrono::seconds(seconds);
+  for (auto& s : stats) {
+    co_spawn(client_ctx,
+             bench::ping(proxy_acceptor.local_endpoint(), size, end, s),
+             detached);
+  }
+  client_ctx.run_until(warm);
+  no_delay_everywhere();
+  // the warm-up ran with Nagle on, keep it out of the percentiles
+  for (auto& s : stats) s.latency = LatencyHistogram();
+  std::uint64_t round_trips0 = 0;
+  for (const auto& s : stats) round_trips0 += s.round_trips;
+  const auto allocs0 = g_allocs.load();
+  const auto cpu0 = bench::thread_cpu_seconds(proxy_thread.native_handle());
+  const auto start = bench::Clock::now();
+
+  client_ctx.run();
+
+  const double elapsed =
+      std::chrono::duration<double>(bench::Clock::now() - start).count();
+  const double cpu =
+      bench::thread_cpu_seconds(proxy_thread.native_handle()) - cpu0;
+  const auto allocs = g_allocs.load() - allocs0;
+  proxy_ctx.stop();
+  backend_ctx.stop();
+  proxy_thread.join();
+  backend_thread.join();
+
+  LatencyHistogram latency;
+  std::uint64_t round_trips = 0;
+  for (const auto& s : stats) {
+    latency.merge(s.latency);
+    round_trips += s.round_trips;
+  }
+  round_trips -= round_trips0;
+  const double bytes = 2.0 * static_cast<double>(size) * round_trips;
+
+  std::printf("%-7s %6d %7zu %9.1f %8lld %8lld %10.2f %9.2f\n", st.name,
+              connections, size, bytes / elapsed / 1e6,
+              static_cast<long long>(latency.percentile(0.5).count()),
+              static_cast<long long>(latency.percentile(0.99).count()),
+              round_trips ? static_cast<double>(allocs) / round_trips : 0.0,
+              bytes > 0 ? cpu * 1e9 / bytes : 0.0);
+}
+
+std::vector<long> parse_list(const char* arg) {
+  std::vector<long> values;
+  std::stringstream in(arg);
+  for (std::string item; std::getline(in, item, ',');) {
+    values.push_back(std::atol(item.c_str()));
+  }
+  return values;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int seconds = argc > 1 ? std::atoi(argv[1]) : 1;
+  const auto connection_counts = parse_list(argc > 2 ? argv[2] : "1,32");
+  const auto sizes = parse_list(argc > 3 ? argv[3] : "64,1024,16384");
+
+  std::printf("%ds per run (after 200ms warm-up)\n", seconds);
+  std::printf("%-7s %6s %7s %9s %8s %8s %10s %9s\n", "step", "conns", "bytes",
+              "MB/s", "p50(us)", "p99(us)", "allocs/rt", "ns/byte");
+  for (long connections : connection_counts) {
+    for (long size : sizes) {
+      for (const auto& st : steps()) {
+        run(st, static_cast<int>(connections), static_cast<std::size_t>(size),
+            seconds);
+      }
+    }
+  }
+  return 0;
+}
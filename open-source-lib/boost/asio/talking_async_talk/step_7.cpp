@@ -1,70 +1,126 @@
-#include <array>
 #include <boost/asio.hpp>
 #include <boost/asio/experimental/as_tuple.hpp>
 #include <boost/asio/experimental/awaitable_operators.hpp>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 #include "common/common.h"
+#include "common/timing_wheel.h"
+#include "common/upstream_pool.h"
+#include "common/zero_copy.h"
 using boost::asio::awaitable;
 using boost::asio::buffer;
 using boost::asio::co_spawn;
 using boost::asio::detached;
 using boost::asio::ip::tcp;
-namespace this_coro = boost::asio::this_coro;
 using namespace boost::asio::experimental::awaitable_operators;
-using std::chrono::steady_clock;
 using namespace std::literals::chrono_literals;
 
 constexpr auto use_nothrow_awaitable =
     boost::asio::experimental::as_tuple(boost::asio::use_awaitable);
 
-awaitable<void> timeout(steady_clock::duration duration) {
-  boost::asio::steady_timer timer(co_await this_coro::executor);
-  timer.expires_after(duration);
-  co_await timer.async_wait(use_nothrow_awaitable);
-}
+// Read and write timeouts (5s for the peer to send something, 1s for a
+// write to drain) are deadlines on the thread's timing_wheel rather than a
+// new steady_timer raced against every operation: re-arming one is a couple
+// of stores, see common/timing_wheel.h. On expiry both sockets are closed,
+// which makes the pending operation fail and the transfer return.
 
-awaitable<void> transfer(tcp::socket& from, tcp::socket& to) {
-  std::array<char, 1024> data;
+// Portable path: read into an adaptive_buffer (4KB..256KB) and write it out.
+awaitable<void> copy_transfer(tcp::socket& from, tcp::socket& to,
+                              timing_wheel::entry& deadline) {
+  adaptive_buffer data;
 
   for (;;) {
-    auto result1 =
-        co_await (from.async_read_some(buffer(data), use_nothrow_awaitable) ||
-                  timeout(5s));
-
-    if (result1.index() == 1) co_return;  // timed out
-
-    auto [e1, n1] = std::get<0>(result1);
+    deadline.expires_after(5s);
+    auto [e1, n1] =
+        co_await from.async_read_some(data.prepare(), use_nothrow_awaitable);
     if (e1) break;
+    data.commit(n1);
 
-    auto result2 =
-        co_await (async_write(to, buffer(data, n1), use_nothrow_awaitable) ||
-                  timeout(1s));
-
-    if (result2.index() == 1) co_return;  // timed out
-
-    auto [e2, n2] = std::get<0>(result2);
+    deadline.expires_after(1s);
+    auto [e2, n2] =
+        co_await async_write(to, data.data(n1), use_nothrow_awaitable);
     if (e2) break;
   }
 }
 
-awaitable<void> proxy(tcp::socket client, tcp::endpoint target) {
-  tcp::socket server(client.get_executor());
+#ifdef TALK_ASYNC_HAS_SPLICE
+// Linux fast path: wait for readiness, then splice() socket -> pipe ->
+// socket so the payload never enters user space. Same timeouts as the copy
+// path. Returns false if the kernel refuses to splice these sockets, in which
+// case nothing has been read and the caller falls back to copy_transfer.
+awaitable<bool> splice_transfer(tcp::socket& from, tcp::socket& to,
+                                splice_pipe& pipe,
+                                timing_wheel::entry& deadline) {
+  from.non_blocking(true);
+  to.non_blocking(true);
+
+  for (;;) {
+    deadline.expires_after(5s);
+    auto [e1] = co_await from.async_wait(tcp::socket::wait_read,
+                                         use_nothrow_awaitable);
+    if (e1) co_return true;
+
+    boost::system::error_code ec;
+    const auto n = pipe.fill(from.native_handle(), ec);
+    if (ec == boost::asio::error::would_block) continue;
+    if (ec == boost::asio::error::invalid_argument) co_return false;
+    if (ec || n == 0) co_return true;  // error or EOF
+
+    deadline.expires_after(1s);
+    while (pipe.size() > 0) {
+      pipe.drain(to.native_handle(), ec);
+      if (ec == boost::asio::error::would_block) {
+        auto [e2] = co_await to.async_wait(tcp::socket::wait_write,
+                                           use_nothrow_awaitable);
+        if (e2) co_return true;
+      } else if (ec) {
+        co_return true;
+      }
+    }
+  }
+}
+#endif
+
+awaitable<void> transfer(tcp::socket& from, tcp::socket& to,
+                         timing_wheel& wheel) {
+  timing_wheel::entry deadline(wheel, [&from, &to] {
+    boost::system::error_code ignored;
+    from.close(ignored);
+    to.close(ignored);
+  });
+#ifdef TALK_ASYNC_HAS_SPLICE
+  splice_pipe pipe;
+  if (pipe.valid() && co_await splice_transfer(from, to, pipe, deadline)) {
+    co_return;
+  }
+#endif
+  co_await copy_transfer(from, to, deadline);
+}
 
-  auto [e] = co_await server.async_connect(target, use_nothrow_awaitable);
-  if (!e) {
-    co_await (transfer(client, server) || transfer(server, client));
+// The upstream comes from a pool of pre-connected sockets (spread over all
+// targets, least outstanding first), so the client does not wait for a
+// handshake with the target.
+awaitable<void> proxy(tcp::socket client, std::shared_ptr<upstream_pool> pool,
+                      timing_wheel& wheel) {
+  auto upstream = co_await pool->acquire();
+  if (upstream) {
+    auto& server = upstream->socket();
+    co_await (transfer(client, server, wheel) ||
+              transfer(server, client, wheel));
   }
 }
 
-awaitable<void> listen(tcp::acceptor& acceptor, tcp::endpoint target) {
+awaitable<void> listen(tcp::acceptor& acceptor,
+                       std::shared_ptr<upstream_pool> pool,
+                       timing_wheel& wheel) {
   for (;;) {
     auto [e, client] = co_await acceptor.async_accept(use_nothrow_awaitable);
     if (e) break;
 
     auto ex = client.get_executor();
-    co_spawn(ex, proxy(std::move(client), target), detached);
+    co_spawn(ex, proxy(std::move(client), pool, wheel), detached);
   }
 }
 
@@ -72,16 +128,24 @@ int main(int argc, char* argv[]) {
   try {
     boost::asio::io_context ctx;
 
-    auto res = ParseArguments(argc, argv, ctx);
+    auto res = ParseProxyArguments(argc, argv, ctx);
     if (!res) {
       return 1;
     }
 
-    auto& [listen_endpoint, target_endpoint] = res.value();
+    auto& [listen_endpoint, target_endpoints] = res.value();
 
     tcp::acceptor acceptor(ctx, listen_endpoint);
 
-    co_spawn(ctx, listen(acceptor, target_endpoint), detached);
+    std::vector<tcp::endpoint> targets(target_endpoints.begin(),
+                                       target_endpoints.end());
+    auto pool = std::make_shared<upstream_pool>(ctx.get_executor(), targets);
+    pool->start();
+
+    timing_wheel wheel(ctx.get_executor());
+    wheel.start();
+
+    co_spawn(ctx, listen(acceptor, pool, wheel), detached);
 
     ctx.run();
   } catch (std::exception& e) {
@@ -0,0 +1,305 @@
+// Cost of the timeout handling styles of steps 5-7 vs timing_wheel.
+//
+// Everything runs in one process on loopback:
+//
+//   ping-pong clients --> proxy --> echo target
+//
+// The proxy is this file's own 1KB copy loop, not the steps' listen(), with
+// one of these timeout styles:
+//
+//   model-5  one deadline per connection, bumped by both transfers, and one
+//            watchdog timer re-armed lazily (the style of step_5)
+//   model-6  the same per direction (two deadlines, two watchdogs; step_6)
+//   model-7  a new steady_timer per read/write (5s/1s) raced against the
+//            operation (step_7 before the wheel)
+//   wheel    a timing_wheel::entry per direction (5s/1s) on one shared
+//            wheel, as step_7 does now
+//
+// The model-N rows are hand-written emulations, so they are a model of the
+// steps' cost, not a measurement of them. Boost 1.74 has no awaitable
+// operators, so the `||` of steps 5-7 is replaced by co_spawn plus closing
+// the sockets, and model-7's per-operation race by a co_spawned timeout
+// coroutine on a heap timer that the transfer cancels. The real `||` also
+// allocates a parallel-group state per race, so model-7's numbers are a lower
+// bound. proxy_bench drives the real step_N::listen() where Boost allows it.
+//
+// Reported per style: forwarded chunks per second (one chunk = one read +
+// write in the proxy) and heap allocations per chunk on the proxy thread.
+//
+// usage: timeout_bench [connections] [seconds] [message-size]
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <thread>
+
+#include "common/bench_util.h"
+#include "common/timing_wheel.h"
+
+using boost::asio::awaitable;
+using boost::asio::buffer;
+using boost::asio::co_spawn;
+using boost::asio::detached;
+using boost::asio::redirect_error;
+using boost::asio::use_awaitable;
+using boost::asio::ip::tcp;
+using std::chrono::steady_clock;
+using namespace std::literals::chrono_literals;
+
+namespace {
+thread_local bool t_count_allocs = false;
+std::atomic<std::uint64_t> g_allocs{0};
+std::atomic<std::uint64_t> g_chunks{0};
+}  // namespace
+
+void* operator new(std::size_t size) {
+  if (t_count_allocs) g_allocs.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+enum class style { step_5, step_6, step_7, wheel };
+
+const char* style_name(style s) {
+  switch (s) {
+    case style::step_5:
+      return "model-5";
+    case style::step_6:
+      return "model-6";
+    case style::step_7:
+      return "model-7";
+    case style::wheel:
+      return "wheel";
+  }
+  return "?";
+}
+
+struct session {
+  session(tcp::socket c, tcp::socket s, timing_wheel& wheel)
+      : client(std::move(c)),
+        server(std::move(s)),
+        timer1(client.get_executor()),
+        timer2(client.get_executor()),
+        deadline1(wheel, [this] { close(); }),
+        deadline2(wheel, [this] { close(); }) {}
+
+  void close() {
+    closed = true;
+    boost::system::error_code ignored;
+    client.close(ignored);
+    server.close(ignored);
+    timer1.cancel();
+    timer2.cancel();
+  }
+
+  tcp::socket client;
+  tcp::socket server;
+  // step-5/6 deadlines and their watchdog timers
+  steady_clock::time_point time1{};
+  steady_clock::time_point time2{};
+  boost::asio::steady_timer timer1;
+  boost::asio::steady_timer timer2;
+  // wheel deadlines, one per direction
+  timing_wheel::entry deadline1;
+  timing_wheel::entry deadline2;
+  bool closed = false;
+};
+
+using session_ptr = std::shared_ptr<session>;
+
+awaitable<void> watchdog(session_ptr s, steady_clock::time_point& deadline,
+                         boost::asio::steady_timer& timer) {
+  boost::system::error_code ec;
+  auto now = steady_clock::now();
+  while (!s->closed && deadline > now) {
+    timer.expires_at(deadline);
+    co_await timer.async_wait(redirect_error(use_awaitable, ec));
+    now = steady_clock::now();
+  }
+  s->close();
+}
+
+// step_5 / step_6: bump a deadline, the watchdog does the rest
+awaitable<void> deadline_transfer(session_ptr s, tcp::socket& from,
+                                  tcp::socket& to,
+                                  steady_clock::time_point& deadline) {
+  std::array<char, 1024> data;
+  boost::system::error_code ec;
+  for (;;) {
+    deadline = std::max(deadline, steady_clock::now() + 5s);
+    auto n = co_await from.async_read_some(buffer(data),
+                                           redirect_error(use_awaitable, ec));
+    if (ec) break;
+    co_await async_write(to, buffer(data, n),
+                         redirect_error(use_awaitable, ec));
+    if (ec) break;
+    g_chunks.fetch_add(1, std::memory_order_relaxed);
+  }
+  s->close();
+}
+
+awaitable<void> expire(session_ptr s,
+                       std::shared_ptr<boost::asio::steady_timer> timer) {
+  boost::system::error_code ec;
+  co_await timer->async_wait(redirect_error(use_awaitable, ec));
+  if (!ec) s->close();
+}
+
+// step_7: a fresh timer raced against every operation
+awaitable<void> timer_per_op_transfer(session_ptr s, tcp::socket& from,
+                                      tcp::socket& to) {
+  auto ex = from.get_executor();
+  std::array<char, 1024> data;
+  boost::system::error_code ec;
+  for (;;) {
+    auto read_timer = std::make_shared<boost::asio::steady_timer>(ex, 5s);
+    co_spawn(ex, expire(s, read_timer), detached);
+    auto n = co_await from.async_read_some(buffer(data),
+                                           redirect_error(use_awaitable, ec));
+    read_timer->cancel();
+    if (ec) break;
+
+    auto write_timer = std::make_shared<boost::asio::steady_timer>(ex, 1s);
+    co_spawn(ex, expire(s, write_timer), detached);
+    co_await async_write(to, buffer(data, n),
+                         redirect_error(use_awaitable, ec));
+    write_timer->cancel();
+    if (ec) break;
+    g_chunks.fetch_add(1, std::memory_order_relaxed);
+  }
+  s->close();
+}
+
+// step_7 now: deadlines on the shared timing wheel
+awaitable<void> wheel_transfer(session_ptr s, tcp::socket& from,
+                               tcp::socket& to, timing_wheel::entry& deadline) {
+  std::array<char, 1024> data;
+  boost::system::error_code ec;
+  for (;;) {
+    deadline.expires_after(5s);
+    auto n = co_await from.async_read_some(buffer(data),
+                                           redirect_error(use_awaitable, ec));
+    if (ec) break;
+    deadline.expires_after(1s);
+    co_await async_write(to, buffer(data, n),
+                         redirect_error(use_awaitable, ec));
+    if (ec) break;
+    g_chunks.fetch_add(1, std::memory_order_relaxed);
+  }
+  deadline.cancel();
+  s->close();
+}
+
+void start_session(style st, session_ptr s) {
+  auto ex = s->client.get_executor();
+  auto& c = s->client;
+  auto& t = s->server;
+  switch (st) {
+    case style::step_5:
+      co_spawn(ex, deadline_transfer(s, c, t, s->time1), detached);
+      co_spawn(ex, deadline_transfer(s, t, c, s->time1), detached);
+      co_spawn(ex, watchdog(s, s->time1, s->timer1), detached);
+      break;
+    case style::step_6:
+      co_spawn(ex, deadline_transfer(s, c, t, s->time1), detached);
+      co_spawn(ex, watchdog(s, s->time1, s->timer1), detached);
+      co_spawn(ex, deadline_transfer(s, t, c, s->time2), detached);
+      co_spawn(ex, watchdog(s, s->time2, s->timer2), detached);
+      break;
+    case style::step_7:
+      co_spawn(ex, timer_per_op_transfer(s, c, t), detached);
+      co_spawn(ex, timer_per_op_transfer(s, t, c), detached);
+      break;
+    case style::wheel:
+      co_spawn(ex, wheel_transfer(s, c, t, s->deadline1), detached);
+      co_spawn(ex, wheel_transfer(s, t, c, s->deadline2), detached);
+      break;
+  }
+}
+
+awaitable<void> proxy_listen(tcp::acceptor& acceptor, tcp::endpoint target,
+                             style st, timing_wheel& wheel) {
+  for (;;) {
+    auto client = co_await acceptor.async_accept(use_awaitable);
+    tcp::socket server(client.get_executor());
+    co_await server.async_connect(target, use_awaitable);
+    start_session(st, std::make_shared<session>(std::move(client),
+                                                std::move(server), wheel));
+  }
+}
+
+void run(style st, int connections, int seconds, std::size_t size) {
+  const auto loopback = boost::asio::ip::address_v4::loopback();
+
+  boost::asio::io_context backend_ctx(1);
+  tcp::acceptor backend(backend_ctx, tcp::endpoint(loopback, 0));
+  co_spawn(backend_ctx, bench::echo_listen(backend), detached);
+  std::thread backend_thread([&backend_ctx] { backend_ctx.run(); });
+
+  boost::asio::io_context proxy_ctx(1);
+  tcp::acceptor proxy_acceptor(proxy_ctx, tcp::endpoint(loopback, 0));
+  timing_wheel wheel(proxy_ctx.get_executor());
+  wheel.start();
+  co_spawn(proxy_ctx,
+           proxy_listen(proxy_acceptor, backend.local_endpoint(), st, wheel),
+           detached);
+  std::thread proxy_thread([&proxy_ctx] {
+    t_count_allocs = true;
+    proxy_ctx.run();
+    t_count_allocs = false;
+  });
+
+  boost::asio::io_context client_ctx(1);
+  bench::ping_stats stats;
+  // warm up for 200ms, then measure
+  const auto warm = bench::Clock::now() + 200ms;
+  const auto end = warm + std::chrono::seconds(seconds);
+  for (int i = 0; i < connections; ++i) {
+    co_spawn(client_ctx,
+             bench::ping(proxy_acceptor.local_endpoint(), size, end, stats),
+             detached);
+  }
+  client_ctx.run_until(warm);
+  const auto allocs0 = g_allocs.load();
+  const auto chunks0 = g_chunks.load();
+  const auto start = bench::Clock::now();
+  client_ctx.run();
+  const double elapsed =
+      std::chrono::duration<double>(bench::Clock::now() - start).count();
+  const auto allocs = g_allocs.load() - allocs0;
+  const auto chunks = g_chunks.load() - chunks0;
+
+  proxy_ctx.stop();
+  backend_ctx.stop();
+  proxy_thread.join();
+  backend_thread.join();
+
+  std::printf("%-8s %10.0f chunks/s %8.2f allocs/chunk\n", style_name(st),
+              chunks / elapsed,
+              chunks ? static_cast<double>(allocs) / chunks : 0.0);
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int connections = argc > 1 ? std::atoi(argv[1]) : 64;
+  const int seconds = argc > 2 ? std::atoi(argv[2]) : 3;
+  const std::size_t size =
+      argc > 3 ? static_cast<std::size_t>(std::atoi(argv[3])) : 64;
+  std::printf("%d connections, %zu byte messages, %ds per style\n",
+              connections, size, seconds);
+  std::printf("model-N: emulated timeout style of step_N, not the step\n");
+
+  for (auto st : {style::step_5, style::step_6, style::step_7, style::wheel}) {
+    run(st, connections, seconds, size);
+  }
+  return 0;
+}
@@ -0,0 +1,257 @@
+// Forwarding throughput and CPU cost of the proxy's transfer loop.
+//
+// Everything runs in one process on loopback:
+//
+//   clients --> proxy --> sink
+//
+// The clients (main thread) write 64KB chunks as fast as they can, the sink
+// (its own thread) reads and discards, and the proxy (its own thread) runs
+// one transfer coroutine per direction using one of:
+//
+//   copy-1k   the original std::array<char, 1024> read/write loop
+//   adaptive  adaptive_buffer, 4KB growing to 256KB under bulk load
+//   splice    splice_pipe, socket -> pipe -> socket without user-space copies
+//
+// Reported per mode: forwarded MB/s and proxy-thread CPU time per GB
+// forwarded (CLOCK_THREAD_CPUTIME_ID of the proxy thread). Timeouts are left
+// out on purpose; they cost the same in every mode.
+//
+// usage: zero_copy_bench [connections] [seconds-per-mode]
+
+#include <pthread.h>
+#include <time.h>
+
+#include <array>
+#include <atomic>
+// awaitable.hpp in boost 1.74 uses std::exchange without including <utility>
+#include <utility>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/zero_copy.h"
+
+using boost::asio::awaitable;
+using boost::asio::buffer;
+using boost::asio::co_spawn;
+using boost::asio::detached;
+using boost::asio::redirect_error;
+using boost::asio::use_awaitable;
+using boost::asio::ip::tcp;
+
+namespace {
+enum class mode { copy_1k, adaptive, splice };
+
+const char* mode_name(mode m) {
+  switch (m) {
+    case mode::copy_1k:
+      return "copy-1k";
+    case mode::adaptive:
+      return "adaptive";
+    case mode::splice:
+      return "splice";
+  }
+  return "?";
+}
+
+awaitable<void> copy_1k_transfer(tcp::socket& from, tcp::socket& to) {
+  std::array<char, 1024> data;
+  boost::system::error_code ec;
+
+  for (;;) {
+    auto n = co_await from.async_read_some(buffer(data),
+                                           redirect_error(use_awaitable, ec));
+    if (ec) co_return;
+
+    co_await async_write(to, buffer(data, n),
+                         redirect_error(use_awaitable, ec));
+    if (ec) co_return;
+  }
+}
+
+awaitable<void> adaptive_transfer(tcp::socket& from, tcp::socket& to) {
+  adaptive_buffer data;
+  boost::system::error_code ec;
+
+  for (;;) {
+    auto n = co_await from.async_read_some(data.prepare(),
+                                           redirect_error(use_awaitable, ec));
+    if (ec) co_return;
+    data.commit(n);
+
+    co_await async_write(to, data.data(n), redirect_error(use_awaitable, ec));
+    if (ec) co_return;
+  }
+}
+
+#ifdef TALK_ASYNC_HAS_SPLICE
+awaitable<void> splice_transfer(tcp::socket& from, tcp::socket& to) {
+  splice_pipe pipe;
+  if (!pipe.valid()) co_return;
+  from.non_blocking(true);
+  to.non_blocking(true);
+  boost::system::error_code ec;
+
+  for (;;) {
+    co_await from.async_wait(tcp::socket::wait_read,
+                             redirect_error(use_awaitable, ec));
+    if (ec) co_return;
+
+    const auto n = pipe.fill(from.native_handle(), ec);
+    if (ec == boost::asio::error::would_block) continue;
+    if (ec || n == 0) co_return;
+
+    while (pipe.size() > 0) {
+      pipe.drain(to.native_handle(), ec);
+      if (ec == boost::asio::error::would_block) {
+        co_await to.async_wait(tcp::socket::wait_write,
+                               redirect_error(use_awaitable, ec));
+      }
+      if (ec) co_return;
+    }
+  }
+}
+#endif
+
+awaitable<void> transfer(mode m, std::shared_ptr<tcp::socket> from,
+                         std::shared_ptr<tcp::socket> to) {
+  switch (m) {
+    case mode::copy_1k:
+      co_await copy_1k_transfer(*from, *to);
+      break;
+    case mode::adaptive:
+      co_await adaptive_transfer(*from, *to);
+      break;
+    case mode::splice:
+#ifdef TALK_ASYNC_HAS_SPLICE
+      co_await splice_transfer(*from, *to);
+#endif
+      break;
+  }
+  boost::system::error_code ignored;
+  from->close(ignored);
+  to->close(ignored);
+}
+
+awaitable<void> proxy_listen(tcp::acceptor& acceptor, tcp::endpoint target,
+                             mode m) {
+  for (;;) {
+    auto client = std::make_shared<tcp::socket>(
+        co_await acceptor.async_accept(use_awaitable));
+    auto server = std::make_shared<tcp::socket>(client->get_executor());
+    co_await server->async_connect(target, use_awaitable);
+
+    auto ex = client->get_executor();
+    co_spawn(ex, transfer(m, client, server), detached);
+    co_spawn(ex, transfer(m, server, client), detached);
+  }
+}
+
+awaitable<void> sink(tcp::socket socket, std::atomic<std::uint64_t>& bytes) {
+  std::vector<char> data(256 * 1024);
+  boost::system::error_code ec;
+  for (;;) {
+    auto n = co_await socket.async_read_some(buffer(data),
+                                             redirect_error(use_awaitable, ec));
+    if (ec) co_return;
+    bytes.fetch_add(n, std::memory_order_relaxed);
+  }
+}
+
+awaitable<void> sink_listen(tcp::acceptor& acceptor,
+                            std::atomic<std::uint64_t>& bytes) {
+  for (;;) {
+    auto socket = co_await acceptor.async_accept(use_awaitable);
+    auto ex = socket.get_executor();
+    co_spawn(ex, sink(std::move(socket), bytes), detached);
+  }
+}
+
+awaitable<void> source(tcp::socket& socket, const std::vector<char>& chunk) {
+  boost::system::error_code ec;
+  for (;;) {
+    co_await async_write(socket, buffer(chunk),
+                         redirect_error(use_awaitable, ec));
+    if (ec) co_return;
+  }
+}
+
+double thread_cpu_seconds(pthread_t thread) {
+  clockid_t clock;
+  timespec ts{};
+  if (pthread_getcpuclockid(thread, &clock) != 0 ||
+      clock_gettime(clock, &ts) != 0) {
+    return 0;
+  }
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void run(mode m, int connections, int seconds) {
+  const auto loopback = boost::asio::ip::address_v4::loopback();
+  std::atomic<std::uint64_t> bytes{0};
+
+  boost::asio::io_context sink_ctx(1);
+  tcp::acceptor sink_acceptor(sink_ctx, tcp::endpoint(loopback, 0));
+  co_spawn(sink_ctx, sink_listen(sink_acceptor, bytes), detached);
+  std::thread sink_thread([&sink_ctx] { sink_ctx.run(); });
+
+  boost::asio::io_context proxy_ctx(1);
+  tcp::acceptor proxy_acceptor(proxy_ctx, tcp::endpoint(loopback, 0));
+  co_spawn(proxy_ctx,
+           proxy_listen(proxy_acceptor, sink_acceptor.local_endpoint(), m),
+           detached);
+  std::thread proxy_thread([&proxy_ctx] { proxy_ctx.run(); });
+
+  boost::asio::io_context client_ctx(1);
+  const std::vector<char> chunk(64 * 1024, 'x');
+  std::vector<tcp::socket> clients;
+  for (int i = 0; i < connections; ++i) {
+    clients.emplace_back(client_ctx);
+    clients.back().connect(proxy_acceptor.local_endpoint());
+  }
+  for (auto& c : clients) {
+    co_spawn(client_ctx, source(c, chunk), detached);
+  }
+
+  // let the connections settle before opening the measurement window
+  client_ctx.run_for(std::chrono::milliseconds(200));
+  const auto bytes0 = bytes.load();
+  const auto cpu0 = thread_cpu_seconds(proxy_thread.native_handle());
+  const auto start = std::chrono::steady_clock::now();
+
+  client_ctx.run_for(std::chrono::seconds(seconds));
+
+  const double elapsed = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  const double cpu = thread_cpu_seconds(proxy_thread.native_handle()) - cpu0;
+  const double forwarded = static_cast<double>(bytes.load() - bytes0);
+
+  proxy_ctx.stop();
+  sink_ctx.stop();
+  proxy_thread.join();
+  sink_thread.join();
+
+  std::printf("%-9s %10.0f MB/s %10.0f ms CPU/GB\n", mode_name(m),
+              forwarded / elapsed / 1e6,
+              forwarded > 0 ? cpu * 1e3 / (forwarded / 1e9) : 0.0);
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int connections = argc > 1 ? std::atoi(argv[1]) : 4;
+  const int seconds = argc > 2 ? std::atoi(argv[2]) : 3;
+  std::printf("%d connections, %ds per mode\n", connections, seconds);
+
+  run(mode::copy_1k, connections, seconds);
+  run(mode::adaptive, connections, seconds);
+#ifdef TALK_ASYNC_HAS_SPLICE
+  run(mode::splice, connections, seconds);
+#endif
+  return 0;
+}
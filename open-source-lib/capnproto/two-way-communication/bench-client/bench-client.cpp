@@ -0,0 +1,155 @@
+// Receive rate and latency of the events a simple-server publishes.
+//
+// Subscribes to FooData and BarData like simple-client, but only counts the
+// events: latency is the receive time minus the publishedAt stamp the
+// server's publish() put in, both steady_clock, so server and client must run
+// on the same host. Run the server with a RATE high enough to load it, and
+// several of these to see the fan-out.
+//
+// With SLOW_US the client plays a slow subscriber: every batch takes that
+// many microseconds per event before it returns. Run one slow and several
+// fast clients against the same server and watch the server's backlog, rss
+// and dropped columns: the slow one must not hold up the fast ones nor grow
+// the server without bound.
+//
+// Reported every second: events/s received and the publish -> receive
+// latency p50/p99/max of that second; the whole run at the end.
+//
+// The transport is the server's: compare shm:/tmp/x.sock (shared memory),
+// unix:/tmp/x.sock and localhost:12345 at the same RATE.
+//
+// usage: bench-client ADDRESS [seconds] [slow_us]
+//   ./build/simple-server/simple-server unix:tmp.sock 100000
+//   ./build/bench-client/bench-client unix:tmp.sock 10
+//   ./build/bench-client/bench-client unix:tmp.sock 10 100
+
+#include <capnp/rpc-twoparty.h>
+#include <kj/async-io.h>
+#include <kj/debug.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "latency_histogram.h"
+#include "protocol.capnp.h"
+#include "shm_stream.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct Stats {
+  void record(int64_t published_at) {
+    const auto now = Clock::now().time_since_epoch();
+    const auto latency = std::chrono::nanoseconds(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now).count() -
+        published_at);
+    interval.record(latency);
+    total.record(latency);
+  }
+
+  LatencyHistogram interval;
+  LatencyHistogram total;
+};
+
+template <typename DataT>
+class CountingHandler final : public DataSubscriberHandle<DataT>::Server,
+                              public kj::Refcounted {
+ public:
+  using RpcContext =
+      typename DataSubscriberHandle<DataT>::Server::OnSubscribedDataContext;
+  using BatchContext =
+      typename DataSubscriberHandle<DataT>::Server::OnSubscribedBatchContext;
+  CountingHandler(Stats& stats, kj::Timer& timer, kj::Duration slow)
+      : stats_(stats), timer_(timer), slow_(slow) {}
+
+  kj::Promise<void> onSubscribedData(RpcContext context) override {
+    stats_.record(context.getParams().getDataFromPublisher().getPublishedAt());
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> onSubscribedBatch(BatchContext context) override {
+    auto batch = context.getParams().getBatch();
+    for (auto event : batch) stats_.record(event.getPublishedAt());
+    if (slow_ == 0 * kj::MICROSECONDS) return kj::READY_NOW;
+    return timer_.afterDelay(slow_ * batch.size());
+  }
+
+ private:
+  Stats& stats_;
+  kj::Timer& timer_;
+  kj::Duration slow_;
+};
+
+template <typename DataT>
+void subscribe(DataProviderInterface::Client& service_handle, DataType type,
+               Stats& stats, kj::Timer& timer, kj::Duration slow,
+               kj::WaitScope& wait_scope) {
+  auto request = service_handle.makeSubscriptionRequest<DataT>();
+  request.setDataType(type);
+  request.setSubscriberHandle(typename DataSubscriberHandle<DataT>::Client(
+      kj::refcounted<CountingHandler<DataT>>(stats, timer, slow)));
+  request.send().wait(wait_scope);
+}
+
+void printRow(const char* name, double seconds, const LatencyHistogram& h) {
+  std::printf("%-8s %12.0f %9lld %9lld %9lld\n", name,
+              seconds > 0 ? h.count() / seconds : 0.0,
+              static_cast<long long>(h.percentile(0.5).count()),
+              static_cast<long long>(h.percentile(0.99).count()),
+              static_cast<long long>(h.max().count()));
+}
+
+kj::Promise<void> report(kj::Timer& timer, Stats& stats, int second,
+                         int seconds, Clock::time_point since) {
+  return timer.afterDelay(1 * kj::SECONDS)
+      .then([&timer, &stats, second, seconds, since]() -> kj::Promise<void> {
+        const auto now = Clock::now();
+        const auto name = std::to_string(second) + "s";
+        printRow(name.c_str(),
+                 std::chrono::duration<double>(now - since).count(),
+                 stats.interval);
+        stats.interval = LatencyHistogram();
+        if (second == seconds) return kj::READY_NOW;
+        return report(timer, stats, second + 1, seconds, now);
+      });
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc < 2 || argc > 4) {
+    std::cerr << "usage: " << argv[0]
+              << " HOST:PORT [SECONDS] [SLOW_US]\n"
+                 "Subscribes to a simple-server and reports how many events "
+                 "arrive and how late, for SECONDS (default 10).\n"
+                 "SLOW_US makes every event take that long to handle."
+              << std::endl;
+    return 1;
+  }
+  const int seconds = argc >= 3 ? std::atoi(argv[2]) : 10;
+  const auto slow = (argc == 4 ? std::atoi(argv[3]) : 0) * kj::MICROSECONDS;
+
+  auto io = kj::setupAsyncIo();
+  auto& waitScope = io.waitScope;
+
+  kj::Own<kj::AsyncIoStream> conn =
+      shm_transport::connect(io, argv[1]).wait(waitScope);
+  capnp::TwoPartyClient client(*conn);
+  DataProviderInterface::Client service_handle =
+      client.bootstrap().castAs<DataProviderInterface>();
+
+  Stats stats;
+  kj::Timer& timer = io.provider->getTimer();
+  subscribe<FooData>(service_handle, DataType::FOO_DATA, stats, timer, slow,
+                     waitScope);
+  subscribe<BarData>(service_handle, DataType::BAR_DATA, stats, timer, slow,
+                     waitScope);
+
+  std::printf("%-8s %12s %9s %9s %9s\n", "", "events/s", "p50(us)",
+              "p99(us)", "max(us)");
+  const auto start = Clock::now();
+  report(timer, stats, 1, seconds, start).wait(waitScope);
+  printRow("total", std::chrono::duration<double>(Clock::now() - start).count(),
+           stats.total);
+  return 0;
+}
@@ -0,0 +1,363 @@
+#include "shm_stream.h"
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <kj/debug.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+namespace shm_transport {
+namespace {
+
+constexpr std::size_t kRingBytes = 1 << 20;  // per direction
+
+// Shared by both processes, at the start of each direction's region. The
+// memfd starts out zeroed, which is the initial state.
+struct alignas(64) RingHeader {
+  std::atomic<uint64_t> head;  // bytes written so far, by the writer
+  char pad0[56];
+  std::atomic<uint64_t> tail;  // bytes read so far, by the reader
+  char pad1[56];
+  std::atomic<uint32_t> reader_waiting;  // reader sleeps until head moves
+  std::atomic<uint32_t> writer_waiting;  // writer sleeps until tail moves
+  std::atomic<uint32_t> closed;          // writer shut down
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "atomics in shared memory must be lock free");
+
+constexpr std::size_t kDirectionBytes = sizeof(RingHeader) + kRingBytes;
+constexpr std::size_t kRegionBytes = 2 * kDirectionBytes;
+
+// One direction: a single producer, single consumer byte ring.
+class Ring {
+ public:
+  explicit Ring(kj::byte* base)
+      : header_(*reinterpret_cast<RingHeader*>(base)),
+        data_(base + sizeof(RingHeader)) {}
+
+  RingHeader& header() { return header_; }
+
+  // Copies in as much of `src` as fits and returns how much that was.
+  std::size_t write(const kj::byte* src, std::size_t size) {
+    const auto head = header_.head.load(std::memory_order_relaxed);
+    const auto tail = header_.tail.load(std::memory_order_acquire);
+    size = std::min<std::size_t>(size, kRingBytes - (head - tail));
+    copy(data_, head, src, size, [](kj::byte* ring, const kj::byte* from,
+                                    std::size_t n) {
+      std::memcpy(ring, from, n);
+    });
+    // seq_cst against the load of reader_waiting that follows
+    header_.head.store(head + size, std::memory_order_seq_cst);
+    return size;
+  }
+
+  // Copies out up to `size` bytes and returns how many.
+  std::size_t read(kj::byte* dst, std::size_t size) {
+    const auto tail = header_.tail.load(std::memory_order_relaxed);
+    const auto head = header_.head.load(std::memory_order_acquire);
+    size = std::min<std::size_t>(size, head - tail);
+    copy(data_, tail, dst, size,
+         [](kj::byte* ring, kj::byte* to, std::size_t n) {
+           std::memcpy(to, ring, n);
+         });
+    header_.tail.store(tail + size, std::memory_order_seq_cst);
+    return size;
+  }
+
+  bool readable() const {
+    return header_.head.load(std::memory_order_seq_cst) !=
+           header_.tail.load(std::memory_order_relaxed);
+  }
+  bool writable() const {
+    return header_.head.load(std::memory_order_relaxed) -
+               header_.tail.load(std::memory_order_seq_cst) <
+           kRingBytes;
+  }
+  bool closed() const {
+    return header_.closed.load(std::memory_order_seq_cst) != 0;
+  }
+
+ private:
+  // Runs `op` on the one or two pieces of the ring from `position` on.
+  template <typename Bytes, typename Op>
+  static void copy(kj::byte* ring, uint64_t position, Bytes* bytes,
+                   std::size_t size, Op op) {
+    const std::size_t offset = position % kRingBytes;
+    const std::size_t first = std::min(size, kRingBytes - offset);
+    op(ring + offset, bytes, first);
+    op(ring, bytes + first, size - first);
+  }
+
+  RingHeader& header_;
+  kj::byte* data_;
+};
+
+// What the handshake hands over, from either side's point of view.
+struct Endpoint {
+  kj::Own<kj::AsyncCapabilityStream> socket;
+  kj::AutoCloseFd memfd;
+  kj::AutoCloseFd own_wake;   // the peer signals this one
+  kj::AutoCloseFd peer_wake;  // this side signals the peer's
+};
+
+class Mapping {
+ public:
+  explicit Mapping(int fd) {
+    void* base = ::mmap(nullptr, kRegionBytes, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) KJ_FAIL_SYSCALL("mmap", errno);
+    base_ = static_cast<kj::byte*>(base);
+  }
+  ~Mapping() { ::munmap(base_, kRegionBytes); }
+  KJ_DISALLOW_COPY(Mapping);
+
+  kj::byte* direction(int i) const { return base_ + i * kDirectionBytes; }
+
+ private:
+  kj::byte* base_;
+};
+
+class ShmStream final : public kj::AsyncIoStream {
+ public:
+  // Direction 0 carries server -> client, direction 1 client -> server.
+  ShmStream(kj::UnixEventPort& event_port, Endpoint endpoint, bool server)
+      : endpoint_(kj::mv(endpoint)),
+        mapping_(endpoint_.memfd),
+        out_(mapping_.direction(server ? 0 : 1)),
+        in_(mapping_.direction(server ? 1 : 0)),
+        observer_(event_port, endpoint_.own_wake,
+                  kj::UnixEventPort::FdObserver::OBSERVE_READ),
+        peer_gone_(watchPeer().fork()) {}
+
+  ~ShmStream() {
+    out_.header().closed.store(1, std::memory_order_seq_cst);
+    signalPeer();
+  }
+
+  kj::Promise<size_t> tryRead(void* buffer, size_t minBytes,
+                              size_t maxBytes) override {
+    return readBytes(static_cast<kj::byte*>(buffer), minBytes, maxBytes, 0);
+  }
+
+  kj::Promise<void> write(const void* buffer, size_t size) override {
+    return writeBytes(static_cast<const kj::byte*>(buffer), size);
+  }
+
+  kj::Promise<void> write(
+      kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>> pieces) override {
+    for (size_t i = 0; i < pieces.size(); ++i) {
+      const auto& piece = pieces[i];
+      const auto n = out_.write(piece.begin(), piece.size());
+      if (n == piece.size()) continue;
+      // the ring is full, the rest goes one wake-up at a time
+      signalIf(out_.header().reader_waiting);
+      auto rest = pieces.slice(i + 1, pieces.size());
+      return writeBytes(piece.begin() + n, piece.size() - n)
+          .then([this, rest]() { return write(rest); });
+    }
+    signalIf(out_.header().reader_waiting);
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> whenWriteDisconnected() override {
+    return peer_gone_.addBranch();
+  }
+
+  void shutdownWrite() override {
+    out_.header().closed.store(1, std::memory_order_seq_cst);
+    signalPeer();
+  }
+
+ private:
+  kj::Promise<size_t> readBytes(kj::byte* buffer, size_t min, size_t max,
+                                size_t done) {
+    const auto n = in_.read(buffer + done, max - done);
+    if (n > 0) signalIf(in_.header().writer_waiting);
+    done += n;
+    if (done >= min || (in_.closed() && !in_.readable()) || gone_) {
+      return done;  // less than `min` is end of stream
+    }
+    return waitFor([this]() { return in_.readable() || in_.closed(); },
+                   in_.header().reader_waiting)
+        .then([this, buffer, min, max, done]() {
+          return readBytes(buffer, min, max, done);
+        });
+  }
+
+  kj::Promise<void> writeBytes(const kj::byte* buffer, size_t size) {
+    const auto n = out_.write(buffer, size);
+    signalIf(out_.header().reader_waiting);
+    if (n == size) return kj::READY_NOW;
+    if (gone_) {
+      return KJ_EXCEPTION(DISCONNECTED, "shared memory peer went away");
+    }
+    return waitFor([this]() { return out_.writable(); },
+                   out_.header().writer_waiting)
+        .then([this, buffer, n, size]() {
+          return writeBytes(buffer + n, size - n);
+        });
+  }
+
+  // Announces through `waiting` that this side is about to sleep, then
+  // sleeps unless `ready()` became true meanwhile. The peer checks the flag
+  // after every change it makes and signals our eventfd if it is set.
+  template <typename Ready>
+  kj::Promise<void> waitFor(Ready ready, std::atomic<uint32_t>& waiting) {
+    waiting.store(1, std::memory_order_seq_cst);
+    auto woken = nextWake();
+    if (ready()) {
+      waiting.store(0, std::memory_order_relaxed);
+      return kj::READY_NOW;
+    }
+    return woken.exclusiveJoin(peer_gone_.addBranch())
+        .then([&waiting]() { waiting.store(0, std::memory_order_relaxed); });
+  }
+
+  // A read and a write may wait at the same time, and FdObserver takes one
+  // waiter, so they share one fork of it. The eventfd is drained before each
+  // new wait: kj's observer is edge triggered and a signal that came in while
+  // nobody was waiting would otherwise never produce another edge. Draining
+  // is safe there because every earlier waiter has been woken already and
+  // rechecks its condition.
+  kj::Promise<void> nextWake() {
+    if (wake_fired_ || wake_ == nullptr) {
+      uint64_t count;
+      while (::read(endpoint_.own_wake, &count, sizeof(count)) > 0) {
+      }
+      wake_fired_ = false;
+      wake_ = kj::heap(observer_.whenBecomesReadable()
+                           .then([this]() { wake_fired_ = true; })
+                           .fork());
+    }
+    return wake_->addBranch();
+  }
+
+  void signalIf(const std::atomic<uint32_t>& waiting) {
+    if (waiting.load(std::memory_order_seq_cst) != 0) signalPeer();
+  }
+
+  void signalPeer() {
+    const uint64_t one = 1;
+    // EAGAIN only when the counter is about to overflow, already signalled
+    (void)!::write(endpoint_.peer_wake, &one, sizeof(one));
+  }
+
+  // The socket carries nothing after the handshake, so any read completing
+  // means the peer closed it or died.
+  kj::Promise<void> watchPeer() {
+    return endpoint_.socket->tryRead(&socket_byte_, 1, 1)
+        .then([this](size_t) { gone_ = true; },
+              [this](kj::Exception&&) { gone_ = true; });
+  }
+
+  Endpoint endpoint_;
+  Mapping mapping_;
+  Ring out_;
+  Ring in_;
+  kj::UnixEventPort::FdObserver observer_;
+  kj::Own<kj::ForkedPromise<void>> wake_;
+  bool wake_fired_ = false;
+  kj::byte socket_byte_ = 0;
+  bool gone_ = false;
+  kj::ForkedPromise<void> peer_gone_;
+};
+
+kj::AutoCloseFd newEventFd() {
+  int fd;
+  KJ_SYSCALL(fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+  return kj::AutoCloseFd(fd);
+}
+
+// The accepted or connected socket, as a stream that can pass fds.
+kj::Own<kj::AsyncCapabilityStream> capabilityStream(
+    kj::AsyncIoContext& io, kj::AsyncIoStream& connection) {
+  int fd;
+  KJ_SYSCALL(fd = ::fcntl(KJ_ASSERT_NONNULL(connection.getFd()),
+                          F_DUPFD_CLOEXEC, 0));
+  return io.lowLevelProvider->wrapUnixSocketFd(
+      fd, kj::LowLevelAsyncIoProvider::TAKE_OWNERSHIP |
+              kj::LowLevelAsyncIoProvider::ALREADY_CLOEXEC |
+              kj::LowLevelAsyncIoProvider::ALREADY_NONBLOCK);
+}
+
+constexpr char kScheme[] = "shm:";
+constexpr size_t kSchemeSize = sizeof(kScheme) - 1;
+
+}  // namespace
+
+bool isSharedMemory(kj::StringPtr address) {
+  return address.startsWith(kScheme);
+}
+
+kj::String socketAddress(kj::StringPtr address) {
+  if (!isSharedMemory(address)) return kj::heapString(address);
+  return kj::str("unix:", address.slice(kSchemeSize));
+}
+
+kj::Promise<kj::Own<kj::AsyncIoStream>> accept(
+    kj::AsyncIoContext& io, kj::ConnectionReceiver& listener) {
+  return listener.accept().then(
+      [&io](kj::Own<kj::AsyncIoStream> connection) {
+        auto endpoint = kj::heap<Endpoint>();
+        endpoint->socket = capabilityStream(io, *connection);
+        int memfd;
+        KJ_SYSCALL(memfd = ::memfd_create("capnp-shm", MFD_CLOEXEC));
+        endpoint->memfd = kj::AutoCloseFd(memfd);
+        KJ_SYSCALL(::ftruncate(memfd, kRegionBytes));
+        endpoint->own_wake = newEventFd();
+        endpoint->peer_wake = newEventFd();
+
+        // in the order connect() receives them
+        auto& e = *endpoint;
+        return e.socket->sendFd(e.memfd)
+            .then([&e]() { return e.socket->sendFd(e.peer_wake); })
+            .then([&e]() { return e.socket->sendFd(e.own_wake); })
+            .then([&io, endpoint = kj::mv(endpoint)]() mutable
+                  -> kj::Own<kj::AsyncIoStream> {
+              return kj::heap<ShmStream>(io.unixEventPort, kj::mv(*endpoint),
+                                         true);
+            });
+      });
+}
+
+kj::Promise<kj::Own<kj::AsyncIoStream>> connect(kj::AsyncIoContext& io,
+                                                kj::StringPtr address) {
+  const bool shared_memory = isSharedMemory(address);
+  return io.provider->getNetwork()
+      .parseAddress(socketAddress(address))
+      .then([](kj::Own<kj::NetworkAddress> addr) {
+        return addr->connect().attach(kj::mv(addr));
+      })
+      .then([&io, shared_memory](kj::Own<kj::AsyncIoStream> connection)
+                -> kj::Promise<kj::Own<kj::AsyncIoStream>> {
+        if (!shared_memory) return kj::mv(connection);
+
+        auto endpoint = kj::heap<Endpoint>();
+        endpoint->socket = capabilityStream(io, *connection);
+        auto& e = *endpoint;
+        return e.socket->receiveFd()
+            .then([&e](kj::AutoCloseFd fd) {
+              e.memfd = kj::mv(fd);
+              return e.socket->receiveFd();
+            })
+            .then([&e](kj::AutoCloseFd fd) {
+              e.own_wake = kj::mv(fd);
+              return e.socket->receiveFd();
+            })
+            .then([&io, endpoint = kj::mv(endpoint)](
+                      kj::AutoCloseFd fd) mutable
+                  -> kj::Own<kj::AsyncIoStream> {
+              endpoint->peer_wake = kj::mv(fd);
+              return kj::heap<ShmStream>(io.unixEventPort,
+                                         kj::mv(*endpoint), false);
+            });
+      });
+}
+
+}  // namespace shm_transport
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <kj/async-io.h>
+#include <kj/string.h>
+
+// Shared memory transport for capnp RPC between processes on one host.
+//
+// An ADDRESS of the form "shm:/path/to/socket" still connects through a unix
+// socket at that path, but only to hand over three file descriptors: a memfd
+// holding one ring buffer per direction, and one eventfd per side to wake it
+// up. From then on the connection is a kj::AsyncIoStream that writes capnp's
+// segments straight into the peer's ring and reads them out of its own, with
+// no system call per message: a side only signals the peer's eventfd when the
+// peer said it is about to sleep, waiting for data or for room. The socket
+// stays open to notice when the peer goes away.
+//
+// eventfd rather than a futex, so that waiting is just another fd in the kj
+// event loop.
+namespace shm_transport {
+
+// Whether `address` is a "shm:" address.
+bool isSharedMemory(kj::StringPtr address);
+
+// The address to listen on or connect to with kj's network: "unix:/path"
+// for "shm:/path", anything else unchanged.
+kj::String socketAddress(kj::StringPtr address);
+
+// Accepts the next connection on `listener`, a unix socket, and sets up the
+// shared memory for it.
+kj::Promise<kj::Own<kj::AsyncIoStream>> accept(
+    kj::AsyncIoContext& io, kj::ConnectionReceiver& listener);
+
+// Connects to `address`: through shared memory for a "shm:" address, as a
+// plain kj network connection otherwise.
+kj::Promise<kj::Own<kj::AsyncIoStream>> connect(kj::AsyncIoContext& io,
+                                                kj::StringPtr address);
+
+}  // namespace shm_transport
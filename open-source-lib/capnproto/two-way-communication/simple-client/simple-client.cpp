@@ -8,6 +8,7 @@
 #include <thread>
 
 #include "protocol.capnp.h"
+#include "shm_stream.h"
 
 template <typename DataT>
 class OnDataHandler final : public DataSubscriberHandle<DataT>::Server,
@@ -15,13 +16,22 @@ class OnDataHandler final : public DataSubscriberHandle<DataT>::Server,
  public:
   using RpcContext =
       typename DataSubscriberHandle<DataT>::Server::OnSubscribedDataContext;
-  using DataHandlerT = std::function<void(RpcContext)>;
+  using BatchContext =
+      typename DataSubscriberHandle<DataT>::Server::OnSubscribedBatchContext;
+  using DataHandlerT = std::function<void(typename DataT::Reader)>;
   OnDataHandler(DataHandlerT&& callback)
       : on_data_callback_(std::move(callback)) {}
 
  public:
   kj::Promise<void> onSubscribedData(RpcContext context) override {
-    on_data_callback_(context);
+    on_data_callback_(context.getParams().getDataFromPublisher());
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> onSubscribedBatch(BatchContext context) override {
+    for (auto event : context.getParams().getBatch()) {
+      on_data_callback_(event);
+    }
     return kj::READY_NOW;
   }
 
@@ -48,11 +58,10 @@ int main(int argc, const char* argv[]) {
   // `waitScope`, then it does not block!
   auto& waitScope = io.waitScope;
 
-  // Using KJ APIs, let's parse our network address and connect to it.
-  kj::Network& network = io.provider->getNetwork();
-  kj::Own<kj::NetworkAddress> addr =
-      network.parseAddress(argv[1]).wait(waitScope);
-  kj::Own<kj::AsyncIoStream> conn = addr->connect().wait(waitScope);
+  // Using KJ APIs, let's parse our network address and connect to it
+  // (through shared memory for a "shm:" address).
+  kj::Own<kj::AsyncIoStream> conn =
+      shm_transport::connect(io, argv[1]).wait(waitScope);
 
   // Now we can start the Cap'n Proto RPC system on this connection.
   capnp::TwoPartyClient client(*conn);
@@ -67,8 +76,7 @@ int main(int argc, const char* argv[]) {
   foo_request.setDataType(DataType::FOO_DATA);
 
   auto on_foo_data_handler =
-      kj::refcounted<OnDataHandler<FooData>>([](auto rpc_context) {
-        auto event = rpc_context.getParams().getDataFromPublisher();
+      kj::refcounted<OnDataHandler<FooData>>([](auto event) {
         std::cout << "client receive event: " << event.getFooString().cStr()
                   << '\n';
       });
@@ -83,8 +91,7 @@ int main(int argc, const char* argv[]) {
   bar_request.setDataType(DataType::BAR_DATA);
 
   auto on_bar_data_handler =
-      kj::refcounted<OnDataHandler<BarData>>([](auto rpc_context) {
-        auto event = rpc_context.getParams().getDataFromPublisher();
+      kj::refcounted<OnDataHandler<BarData>>([](auto event) {
         std::cout << "client receive event: " << event.getBarString().cStr()
                   << '\n';
       });
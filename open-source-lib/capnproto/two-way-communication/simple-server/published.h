@@ -0,0 +1,43 @@
+#pragma once
+
+#include <capnp/message.h>
+#include <kj/refcount.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "protocol.capnp.h"
+
+// A published message. DataProvider::publish() encodes it once, on the
+// publishing thread, and the backlog of every subscriber it goes to shares
+// it; the event loop copies the encoded struct into each subscriber's batch
+// instead of building it again. Event loop only once queued.
+class Published final : public kj::Refcounted {
+ public:
+  Published(kj::StringPtr topic, kj::ArrayPtr<const kj::byte> payload,
+            int64_t published_at)
+      : builder_(wordsFor(topic, payload),
+                 capnp::AllocationStrategy::FIXED_SIZE) {
+    auto message = builder_.initRoot<Message>();
+    message.setTopic(topic);
+    message.setPayload(payload);
+    message.setPublishedAt(published_at);
+    message_ = message.asReader();
+  }
+
+  Message::Reader message() const { return message_; }
+
+ private:
+  // root pointer, the struct, and the text and data it points to, so that the
+  // message is one segment
+  static unsigned wordsFor(kj::StringPtr topic,
+                           kj::ArrayPtr<const kj::byte> payload) {
+    constexpr std::size_t kWord = sizeof(capnp::word);
+    return static_cast<unsigned>(1 + capnp::sizeInWords<Message>() +
+                                 (topic.size() + kWord) / kWord +
+                                 (payload.size() + kWord - 1) / kWord);
+  }
+
+  capnp::MallocMessageBuilder builder_;
+  Message::Reader message_;
+};
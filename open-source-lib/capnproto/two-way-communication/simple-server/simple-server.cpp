@@ -3,23 +3,209 @@
 #include <kj/async-io.h>
 #include <kj/debug.h>
 
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <string_view>
 #include <thread>
+#include <type_traits>
+#include <vector>
 
 #include "protocol.capnp.h"
+#include "published.h"
+#include "shm_stream.h"
+#include "topic_registry.h"
+
+// Delivery accounting over all subscribers, event loop only.
+struct DeliveryStats {
+  uint64_t published = 0;
+  uint64_t sent = 0;  // messages, not calls
+  uint64_t calls = 0;
+  uint64_t dropped = 0;  // trimmed from a backlog
+  uint64_t unsubscribed = 0;
+  uint64_t backlog = 0;  // messages queued for subscribers right now
+  uint64_t peak_backlog = 0;
+};
+
+class Subscriber;
+using Registry = TopicRegistry<Subscriber>;
+
+// One subscription and its delivery state.
+//
+// Messages are sent in batches of up to kMaxBatch through a streaming method.
+// capnp keeps a flow control window per streaming capability: send()
+// resolves once the window has room again, so a slow subscriber has a
+// bounded number of calls in flight, and whatever is published meanwhile
+// waits in its backlog to go out in the next batch. A backlog reaching
+// kHighWatermark is trimmed to kLowWatermark, oldest first, which bounds the
+// memory a subscriber that stopped reading can hold. A failed call
+// unsubscribes it.
+class Subscriber {
+ public:
+  static constexpr std::size_t kMaxBatch = 256;
+  static constexpr std::size_t kHighWatermark = 64 * 1024;
+  static constexpr std::size_t kLowWatermark = 16 * 1024;
+
+  Subscriber(Registry& registry, DeliveryStats& stats)
+      : registry_(registry), stats_(stats) {}
+
+  virtual ~Subscriber() {
+    registry_.unsubscribe(entry_);
+    stats_.backlog -= backlog_.size();
+  }
+
+  Registry::Entry& entry() { return entry_; }
+  bool failed() const { return failed_; }
+
+  void push(Published& message) {
+    backlog_.push_back(kj::addRef(message));
+    ++stats_.backlog;
+    if (backlog_.size() >= kHighWatermark) {
+      const auto trim = backlog_.size() - kLowWatermark;
+      backlog_.erase(backlog_.begin(), backlog_.begin() + trim);
+      stats_.backlog -= trim;
+      stats_.dropped += trim;
+    }
+    stats_.peak_backlog = std::max(stats_.peak_backlog, stats_.backlog);
+    if (idle_) {
+      idle_ = false;
+      sending_ = sendBatches().eagerlyEvaluate(nullptr);
+    }
+  }
+
+ protected:
+  using Backlog = std::deque<kj::Own<Published>>;
+
+  // Sends the first `count` messages of `backlog` in one streaming call.
+  virtual kj::Promise<void> sendBatch(const Backlog& backlog,
+                                      unsigned count) = 0;
+
+ private:
+  // Sends batches until the backlog is empty.
+  kj::Promise<void> sendBatches() {
+    const auto count =
+        static_cast<unsigned>(std::min(backlog_.size(), kMaxBatch));
+    auto sent = sendBatch(backlog_, count);
+    backlog_.erase(backlog_.begin(), backlog_.begin() + count);
+    stats_.backlog -= count;
+    stats_.sent += count;
+    ++stats_.calls;
+
+    return sent.then(
+        [this]() -> kj::Promise<void> {
+          if (backlog_.empty()) {
+            idle_ = true;
+            return kj::READY_NOW;
+          }
+          return sendBatches();
+        },
+        [this](kj::Exception&& exception) -> kj::Promise<void> {
+          std::cout << "Send failed, unsubscribing: "
+                    << exception.getDescription().cStr() << '\n';
+          registry_.unsubscribe(entry_);
+          ++stats_.unsubscribed;
+          failed_ = true;
+          return kj::READY_NOW;
+        });
+  }
+
+  Registry& registry_;
+  DeliveryStats& stats_;
+  Registry::Entry entry_;
+  Backlog backlog_;
+  bool idle_ = true;
+  bool failed_ = false;
+  kj::Promise<void> sending_ = nullptr;
+};
+
+// A makeSubscription() subscriber, getting the payload of "foo" or "bar" as
+// the string of FooData or BarData.
+template <typename DataT>
+class DataSubscriber final : public Subscriber {
+ public:
+  using Client = typename DataSubscriberHandle<DataT>::Client;
+
+  DataSubscriber(Client client, Registry& registry, DeliveryStats& stats)
+      : Subscriber(registry, stats), client_(kj::mv(client)) {}
+
+ private:
+  static capnp::Text::Builder initString(FooData::Builder data,
+                                         unsigned size) {
+    return data.initFooString(size);
+  }
+  static capnp::Text::Builder initString(BarData::Builder data,
+                                         unsigned size) {
+    return data.initBarString(size);
+  }
+
+  kj::Promise<void> sendBatch(const Backlog& backlog,
+                              unsigned count) override {
+    auto request = client_.onSubscribedBatchRequest();
+    auto batch = request.initBatch(count);
+    for (unsigned i = 0; i < count; ++i) {
+      const auto message = backlog[i]->message();
+      const auto payload = message.getPayload();
+      auto text = initString(batch[i], payload.size());
+      std::copy(payload.begin(), payload.end(), text.begin());
+      batch[i].setPublishedAt(message.getPublishedAt());
+    }
+    return request.send();
+  }
+
+  Client client_;
+};
+
+// A subscribe() subscriber, getting messages as they were published.
+class TopicSubscriberImpl final : public Subscriber {
+ public:
+  TopicSubscriberImpl(TopicSubscriber::Client client, Registry& registry,
+                      DeliveryStats& stats)
+      : Subscriber(registry, stats), client_(kj::mv(client)) {}
+
+ private:
+  kj::Promise<void> sendBatch(const Backlog& backlog,
+                              unsigned count) override {
+    auto request = client_.onMessagesRequest();
+    auto messages = request.initMessages(count);
+    for (unsigned i = 0; i < count; ++i) {
+      messages.setWithCaveats(i, backlog[i]->message());
+    }
+    return request.send();
+  }
+
+  TopicSubscriber::Client client_;
+};
+
+// Handed out by subscribe(); when the client drops it, the subscriber is
+// unsubscribed and destroyed.
+class SubscriptionImpl final : public Subscription::Server {
+ public:
+  explicit SubscriptionImpl(kj::Own<TopicSubscriberImpl> subscriber)
+      : subscriber_(kj::mv(subscriber)) {}
+
+ private:
+  kj::Own<TopicSubscriberImpl> subscriber_;
+};
 
 class DataProvider final
     : public DataProviderInterface::Server,
-      public kj::TaskSet::ErrorHandler,  // to handle fail send
       public kj::Refcounted  // as capnp::TwoPartyServer would need a reference
 {
  public:
   DataProvider(kj::Own<kj::ConnectionReceiver>& listenerFromMain,
-               kj::WaitScope& waitScopeFromMain)
+               kj::AsyncIoContext& ioFromMain, bool sharedMemory)
       : listener_(listenerFromMain),
-        wait_scope_(waitScopeFromMain),
-        executor_(kj::getCurrentThreadExecutor()),
-        sent_promises_(*this) {}
+        io_(ioFromMain),
+        wait_scope_(ioFromMain.waitScope),
+        timer_(ioFromMain.provider->getTimer()),
+        shared_memory_(sharedMemory) {}
 
  private:
   template <typename DataT>
@@ -29,15 +215,28 @@ class DataProvider final
                          .castAs<DataSubscriberHandle<DataT>>());
   }
 
+  template <typename DataT>
+  static constexpr const char* topicOf() {
+    return std::is_same<DataT, FooData>::value ? "foo" : "bar";
+  }
+
+  template <typename DataT>
+  void subscribeData(MakeSubscriptionContext context) {
+    auto subscriber = kj::heap<DataSubscriber<DataT>>(
+        GetDataHandle<DataT>(context), registry_, stats_);
+    registry_.subscribe(topicOf<DataT>(), *subscriber, subscriber->entry());
+    data_subscribers_.push_back(kj::mv(subscriber));
+  }
+
  public:
   kj::Promise<void> makeSubscription(MakeSubscriptionContext context) override {
     auto data_type = context.getParams().getDataType();
     switch (data_type) {
       case DataType::FOO_DATA:
-        foo_clients_.add(GetDataHandle<FooData>(context));
+        subscribeData<FooData>(context);
         break;
       case DataType::BAR_DATA:
-        bar_clients_.add(GetDataHandle<BarData>(context));
+        subscribeData<BarData>(context);
         break;
       default:
         std::cout << "Unknown data subscription request\n";
@@ -45,78 +244,197 @@ class DataProvider final
     return kj::READY_NOW;
   }
 
- public:
-  void taskFailed(kj::Exception&& exception) override {
-    // you can see this when you close clients
-    (void)exception;
-    std::cout << "taskFailed triggers ...\n";
+  kj::Promise<void> subscribe(SubscribeContext context) override {
+    auto params = context.getParams();
+    const auto topic = params.getTopic();
+    const std::string_view pattern(topic.cStr(), topic.size());
+    KJ_REQUIRE(Registry::validPattern(pattern), "invalid topic pattern",
+               topic);
+    auto subscriber = kj::heap<TopicSubscriberImpl>(params.getSubscriber(),
+                                                    registry_, stats_);
+    registry_.subscribe(pattern, *subscriber, subscriber->entry());
+    context.getResults().setSubscription(
+        kj::heap<SubscriptionImpl>(kj::mv(subscriber)));
+    return kj::READY_NOW;
   }
 
  public:
+  // Publishes `payload` under `topic` to every matching subscriber. Can be
+  // called from any thread and never waits for the event loop: the message
+  // is encoded here and appended to a queue, and only the first publish after
+  // the loop drained the queue wakes the loop up, so under load one wake-up
+  // carries a whole batch of messages.
+  void publish(kj::StringPtr topic, kj::ArrayPtr<const kj::byte> payload) {
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    auto message = kj::refcounted<Published>(
+        topic, payload,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    queue_.push_back(kj::mv(message));
+    if (!wake_pending_ && wake_fulfiller_ != nullptr) {
+      wake_pending_ = true;
+      wake_fulfiller_->fulfill();
+    }
+  }
+
+  // Publishes to the makeSubscription() subscribers of DataT.
+  template <typename DataT>
+  void publish(kj::StringPtr payload) {
+    static_assert(std::is_same<DataT, FooData>::value ||
+                      std::is_same<DataT, BarData>::value,
+                  "no DataType for this data");
+    publish(topicOf<DataT>(), payload.asBytes());
+  }
+
   void start() {
     // Start the RPC server.
-    std::thread t([this]() {
-      while (true) {
-        executor_.executeSync([this]() {
-          for (auto& client : foo_clients_) {
-            auto event_request = client.onSubscribedDataRequest();
-            event_request.getDataFromPublisher().setFooString("foo");
-            sent_promises_.add(event_request.send().then(
-                [](auto resp) { (void)resp; },
-                [](auto&& exception) {
-                  std::cout
-                      << "Send failed: " << exception.getDescription().cStr()
-                      << '\n';
-                  std::cout << "failed to send Foo\n";
-                  // rethrow to trigger taskFailed for demonstration
-                  // you can also just do a subscriber clean up here
-                  kj::throwRecoverableException(kj::mv(exception));
-                }));
-          }
-          for (auto& client : bar_clients_) {
-            auto event_request = client.onSubscribedDataRequest();
-            event_request.getDataFromPublisher().setBarString("bar");
-            sent_promises_.add(event_request.send().then(
-                [](auto resp) { (void)resp; },
-                [](auto&& exception) {
-                  std::cout
-                      << "Send failed: " << exception.getDescription().cStr()
-                      << '\n';
-                  std::cout << "failed to send Bar\n";
-                  // rethrow to trigger taskFailed for demonstration
-                  // you can also just do a subscriber clean up here
-                  kj::throwRecoverableException(kj::mv(exception));
-                }));
-          }
-        });
+    capnp::TwoPartyServer server(kj::addRef(*this));
+    // Run forever, accepting connections, handling requests and sending
+    // what gets published.
+    auto accepting = shared_memory_ ? acceptSharedMemory(server)
+                                    : server.listen(*listener_);
+    accepting.exclusiveJoin(sendPublished())
+        .exclusiveJoin(reportStats())
+        .wait(wait_scope_);
+  }
 
-        using std::chrono_literals::operator""s;
-        std::this_thread::sleep_for(1s);
+ private:
+  // Like TwoPartyServer::listen(), with every connection moved to shared
+  // memory first. A client that fails the handshake is only reported.
+  kj::Promise<void> acceptSharedMemory(capnp::TwoPartyServer& server) {
+    return shm_transport::accept(io_, *listener_)
+        .then(
+            [&server](kj::Own<kj::AsyncIoStream> connection) {
+              server.accept(kj::mv(connection));
+            },
+            [](kj::Exception&& exception) {
+              std::cout << "Shared memory handshake failed: "
+                        << exception.getDescription().cStr() << '\n';
+            })
+        .then([this, &server]() { return acceptSharedMemory(server); });
+  }
+
+  // Runs on the event loop: hands everything queued so far to the
+  // subscribers, then sleeps until the next publish.
+  //
+  // kj::Executor::executeAsync() would need an event loop on the publishing
+  // thread as well, so the wake-up is a cross-thread fulfiller of the same
+  // executor machinery: fulfilling it from a plain thread only queues an
+  // event for this loop.
+  kj::Promise<void> sendPublished() {
+    kj::Promise<void> woken = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      sending_.clear();
+      sending_.swap(queue_);
+      auto paf = kj::newPromiseAndCrossThreadFulfiller<void>();
+      woken = kj::mv(paf.promise);
+      wake_fulfiller_ = kj::mv(paf.fulfiller);
+      wake_pending_ = false;
+    }
+    // failed ones are already unsubscribed; destroying them has to wait
+    // until their own continuation is done
+    data_subscribers_.erase(
+        std::remove_if(data_subscribers_.begin(), data_subscribers_.end(),
+                       [](const auto& subscriber) {
+                         return subscriber->failed();
+                       }),
+        data_subscribers_.end());
+    stats_.published += sending_.size();
+    for (const auto& message : sending_) {
+      const auto topic = message->message().getTopic();
+      registry_.forEachSubscriber(
+          std::string_view(topic.cStr(), topic.size()),
+          [&message](Subscriber& subscriber) { subscriber.push(*message); });
+    }
+    return woken.then([this]() { return sendPublished(); });
+  }
+
+  // Prints the delivery rate and the memory held for subscribers once a
+  // second.
+  kj::Promise<void> reportStats() {
+    return timer_.afterDelay(1 * kj::SECONDS).then([this]() {
+      const auto delta = [](uint64_t now, uint64_t& last) {
+        const auto d = now - last;
+        last = now;
+        return static_cast<unsigned long long>(d);
       };
+      std::printf(
+          "published/s=%llu sent/s=%llu calls/s=%llu subscriptions=%zu "
+          "topics=%zu backlog=%llu peak_backlog=%llu dropped=%llu "
+          "unsubscribed=%llu rss=%.1fMB\n",
+          delta(stats_.published, last_.published),
+          delta(stats_.sent, last_.sent), delta(stats_.calls, last_.calls),
+          registry_.subscriptions(), registry_.patterns(),
+          static_cast<unsigned long long>(stats_.backlog),
+          static_cast<unsigned long long>(stats_.peak_backlog),
+          static_cast<unsigned long long>(stats_.dropped),
+          static_cast<unsigned long long>(stats_.unsubscribed),
+          residentMegabytes());
+      std::fflush(stdout);
+      return reportStats();
     });
+  }
 
-    capnp::TwoPartyServer server(kj::addRef(*this));
-    // Run forever, accepting connections and handling requests.
-    server.listen(*listener_).wait(wait_scope_);
+  static double residentMegabytes() {
+    long pages = 0;
+    if (FILE* f = std::fopen("/proc/self/statm", "r")) {
+      if (std::fscanf(f, "%*ld %ld", &pages) != 1) pages = 0;
+      std::fclose(f);
+    }
+    return pages * static_cast<double>(sysconf(_SC_PAGESIZE)) / (1 << 20);
   }
 
  private:
   kj::Own<kj::ConnectionReceiver>& listener_;
-  kj::Vector<DataSubscriberHandle<FooData>::Client> foo_clients_;
-  kj::Vector<DataSubscriberHandle<BarData>::Client> bar_clients_;
+  kj::AsyncIoContext& io_;
   kj::WaitScope& wait_scope_;
-  kj::TaskSet sent_promises_;
+  kj::Timer& timer_;
+  const bool shared_memory_;
+  DeliveryStats stats_;
+  DeliveryStats last_;  // stats_ at the previous report
+  // declared before the subscribers, which unsubscribe when destroyed
+  Registry registry_;
+  std::vector<kj::Own<Subscriber>> data_subscribers_;
 
-  const kj::Executor& executor_;
+  std::mutex queue_mutex_;
+  std::vector<kj::Own<Published>> queue_;  // guarded by queue_mutex_
+  bool wake_pending_ = false;              // guarded by queue_mutex_
+  kj::Own<kj::CrossThreadPromiseFulfiller<void>> wake_fulfiller_;
+  std::vector<kj::Own<Published>> sending_;  // event loop only
 };
 
+// Publishes one foo and one bar `rate` times a second, from a thread of its
+// own like any producer outside the event loop would.
+void runPublisher(DataProvider& provider, double rate) {
+  using clock = std::chrono::steady_clock;
+  const auto start = clock::now();
+  uint64_t published = 0;
+  while (true) {
+    const double elapsed =
+        std::chrono::duration<double>(clock::now() - start).count();
+    const auto due = static_cast<uint64_t>(elapsed * rate) + 1;
+    for (; published < due; ++published) {
+      provider.publish<FooData>("foo");
+      provider.publish<BarData>("bar");
+    }
+    // paced in 1ms slices
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
 int main(int argc, const char* argv[]) {
-  if (argc != 2) {
+  if (argc != 2 && argc != 3) {
     std::cerr << "usage: " << argv[0]
-              << " ADDRESS[:PORT]\n"
+              << " ADDRESS[:PORT] [RATE]\n"
                  "Runs the server bound to the given address/port.\n"
                  "ADDRESS may be '*' to bind to all local addresses.\n"
-                 ":PORT may be omitted to choose a port automatically."
+                 ":PORT may be omitted to choose a port automatically.\n"
+                 "ADDRESS shm:/path/to/socket serves clients on the same "
+                 "host through shared memory.\n"
+                 "RATE is how many foo and bar events are published per "
+                 "second (default 1)."
               << std::endl;
     return 1;
   }
@@ -127,8 +445,10 @@ int main(int argc, const char* argv[]) {
 
   // Using KJ APIs, let's parse our network address and listen on it.
   kj::Network& network = io.provider->getNetwork();
+  const bool shared_memory = shm_transport::isSharedMemory(argv[1]);
   kj::Own<kj::NetworkAddress> addr =
-      network.parseAddress(argv[1]).wait(io.waitScope);
+      network.parseAddress(shm_transport::socketAddress(argv[1]))
+          .wait(io.waitScope);
   kj::Own<kj::ConnectionReceiver> listener = addr->listen();
 
   // Write the port number to stdout, in case it was chosen automatically.
@@ -140,6 +460,16 @@ int main(int argc, const char* argv[]) {
   } else {
     std::cout << "Listening on port " << port << "..." << std::endl;
   }
-  auto data_provider = kj::refcounted<DataProvider>(listener, io.waitScope);
+  const double rate = argc == 3 ? std::atof(argv[2]) : 1.0;
+  if (!(rate > 0)) {
+    std::cerr << "RATE must be positive" << std::endl;
+    return 1;
+  }
+  auto data_provider =
+      kj::refcounted<DataProvider>(listener, io, shared_memory);
+  // the server runs forever, so the publisher never outlives the provider
+  std::thread([&provider = *data_provider, rate]() {
+    runPublisher(provider, rate);
+  }).detach();
   data_provider->start();
 }
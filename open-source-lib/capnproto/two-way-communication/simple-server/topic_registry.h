@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Subscriptions by topic.
+//
+// A pattern is either a topic ("sensors.kitchen.temp") or whole leading
+// segments of one followed by '*' ("sensors.*", or "*" for every topic).
+// Every pattern keeps a vector of its subscribers and every subscription
+// keeps its index in that vector in its Entry, so subscribe and unsubscribe
+// are a hash lookup plus a push_back or a swap-remove, whatever the number of
+// topics and subscribers. Matching a topic is one lookup, plus one per
+// segment while there are prefix subscriptions at all.
+template <typename Sink>
+class TopicRegistry {
+  struct Pattern;
+
+ public:
+  // A subscription's place in the registry. The subscriber owns it and must
+  // not move it while subscribed.
+  class Entry {
+   public:
+    bool subscribed() const { return pattern_ != nullptr; }
+
+   private:
+    friend class TopicRegistry;
+    Pattern* pattern_ = nullptr;
+    std::size_t index_ = 0;
+  };
+
+  static bool validPattern(std::string_view pattern) {
+    if (pattern.empty()) return false;
+    const auto star = pattern.find('*');
+    if (star == std::string_view::npos) return true;
+    // only as the last segment
+    return star == pattern.size() - 1 &&
+           (star == 0 || pattern[star - 1] == '.');
+  }
+
+  // Returns false, and does nothing, for an invalid pattern or an `entry`
+  // that is already subscribed.
+  bool subscribe(std::string_view pattern, Sink& sink, Entry& entry) {
+    if (!validPattern(pattern) || entry.subscribed()) return false;
+    const bool prefix = pattern.back() == '*';
+    if (prefix) pattern.remove_suffix(1);
+    auto& patterns = prefix ? prefixes_ : exact_;
+    key_.assign(pattern.data(), pattern.size());
+    auto it = patterns.find(key_);
+    if (it == patterns.end()) {
+      it = patterns.emplace(key_, Pattern{key_, prefix, {}}).first;
+    }
+    Pattern& p = it->second;
+    entry.pattern_ = &p;
+    entry.index_ = p.subscribers.size();
+    p.subscribers.emplace_back(&sink, &entry);
+    ++subscriptions_;
+    return true;
+  }
+
+  // Does nothing if `entry` is not subscribed.
+  void unsubscribe(Entry& entry) {
+    Pattern* p = entry.pattern_;
+    if (p == nullptr) return;
+    auto& subscribers = p->subscribers;
+    if (entry.index_ != subscribers.size() - 1) {
+      subscribers[entry.index_] = subscribers.back();
+      subscribers[entry.index_].second->index_ = entry.index_;
+    }
+    subscribers.pop_back();
+    entry.pattern_ = nullptr;
+    --subscriptions_;
+    if (subscribers.empty()) {
+      key_ = p->key;  // not the key of the node being erased
+      (p->prefix ? prefixes_ : exact_).erase(key_);
+    }
+  }
+
+  // Calls `f(sink)` for every subscription matching `topic`; a sink
+  // subscribed through several matching patterns is called once per
+  // pattern. `f` must not subscribe or unsubscribe.
+  template <typename F>
+  void forEachSubscriber(std::string_view topic, F&& f) {
+    key_.assign(topic.data(), topic.size());
+    visit(exact_, f);
+    if (prefixes_.empty()) return;
+    key_.clear();
+    visit(prefixes_, f);  // "*"
+    for (std::size_t i = 0; i < topic.size(); ++i) {
+      if (topic[i] != '.') continue;
+      key_.assign(topic.data(), i + 1);
+      visit(prefixes_, f);
+    }
+  }
+
+  std::size_t patterns() const { return exact_.size() + prefixes_.size(); }
+  std::size_t subscriptions() const { return subscriptions_; }
+
+ private:
+  struct Pattern {
+    std::string key;  // without the '*'
+    bool prefix;
+    std::vector<std::pair<Sink*, Entry*>> subscribers;
+  };
+
+  template <typename F>
+  void visit(std::unordered_map<std::string, Pattern>& patterns, F& f) {
+    const auto it = patterns.find(key_);
+    if (it == patterns.end()) return;
+    for (const auto& subscriber : it->second.subscribers) f(*subscriber.first);
+  }
+
+  std::unordered_map<std::string, Pattern> exact_;
+  std::unordered_map<std::string, Pattern> prefixes_;
+  std::string key_;  // lookup key, reused so matching does not allocate
+  std::size_t subscriptions_ = 0;
+};
@@ -0,0 +1,196 @@
+// TopicRegistry and fan-out cost at scale, in process, without the RPC.
+//
+// `topics` topics "g<group>.t<i>" in 100 groups and `subscribers`
+// subscribers. Every subscriber subscribes to 10 random topics, every tenth
+// one also to a whole group ("g<k>.*"), and all of them to "hot".
+//
+//   subscribe    ns per TopicRegistry::subscribe, over all subscriptions
+//   unsubscribe  ns per TopicRegistry::unsubscribe, in random order
+//   match        ns per forEachSubscriber for a random topic, and the
+//                subscribers it finds
+//   fan-out      "hot" published to every subscriber, each queueing it and
+//                putting it into its List(Message) batch of 256:
+//                  copy      a copy of topic and payload per subscriber,
+//                            encoded per subscriber (what the provider did
+//                            before Published)
+//                  shared    one Published per message, referenced by
+//                            every backlog and copied in encoded form
+//                ns per delivery
+//
+// usage: topic-bench [topics] [subscribers] [payload_bytes]
+
+#include <capnp/message.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "protocol.capnp.h"
+#include "published.h"
+#include "topic_registry.h"
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+constexpr int kGroups = 100;
+constexpr int kTopicsPerSubscriber = 10;
+constexpr unsigned kBatch = 256;
+
+struct Sink {
+  std::vector<TopicRegistry<Sink>::Entry> entries;
+  std::size_t matched = 0;
+};
+
+double nsPer(Clock::time_point start, std::size_t ops) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - start)
+             .count() /
+         static_cast<double>(ops);
+}
+
+std::string topicName(int topic) {
+  return "g" + std::to_string(topic % kGroups) + ".t" + std::to_string(topic);
+}
+
+// Subscribes every sink to its patterns, returns the number of subscriptions.
+std::size_t subscribeAll(TopicRegistry<Sink>& registry,
+                         const std::vector<std::vector<std::string>>& patterns,
+                         std::vector<Sink>& sinks) {
+  std::size_t count = 0;
+  for (std::size_t s = 0; s < sinks.size(); ++s) {
+    sinks[s].entries.resize(patterns[s].size());
+    for (std::size_t p = 0; p < patterns[s].size(); ++p) {
+      registry.subscribe(patterns[s][p], sinks[s], sinks[s].entries[p]);
+      ++count;
+    }
+  }
+  return count;
+}
+
+struct CopiedMessage {
+  std::string topic;
+  std::string payload;
+  int64_t published_at;
+};
+
+// What sendBatch() does with a full batch: a request with a List(Message).
+template <typename Queued, typename Fill>
+void sendBatch(std::vector<Queued>& queued, Fill fill) {
+  capnp::MallocMessageBuilder request;
+  auto list = request.initRoot<TopicSubscriber::OnMessagesParams>()
+                  .initMessages(kBatch);
+  for (unsigned i = 0; i < kBatch; ++i) fill(list, i, queued[i]);
+  queued.clear();
+}
+
+double fanOutCopied(std::size_t subscribers, int messages,
+                    const std::string& payload) {
+  std::vector<std::vector<CopiedMessage>> backlogs(subscribers);
+  const auto start = Clock::now();
+  for (int m = 0; m < messages; ++m) {
+    const CopiedMessage message{"hot", payload, m};
+    for (auto& backlog : backlogs) {
+      backlog.push_back(message);
+      if (backlog.size() < kBatch) continue;
+      sendBatch(backlog, [](capnp::List<Message>::Builder list, unsigned i,
+                            const CopiedMessage& queued) {
+        auto out = list[i];
+        out.setTopic(queued.topic);
+        out.setPayload(kj::StringPtr(queued.payload).asBytes());
+        out.setPublishedAt(queued.published_at);
+      });
+    }
+  }
+  return nsPer(start, subscribers * static_cast<std::size_t>(messages));
+}
+
+double fanOutShared(std::size_t subscribers, int messages,
+                    const std::string& payload) {
+  std::vector<std::vector<kj::Own<Published>>> backlogs(subscribers);
+  const auto start = Clock::now();
+  for (int m = 0; m < messages; ++m) {
+    auto message =
+        kj::refcounted<Published>("hot", kj::StringPtr(payload).asBytes(), m);
+    for (auto& backlog : backlogs) {
+      backlog.push_back(kj::addRef(*message));
+      if (backlog.size() < kBatch) continue;
+      sendBatch(backlog, [](capnp::List<Message>::Builder list, unsigned i,
+                            const kj::Own<Published>& queued) {
+        list.setWithCaveats(i, queued->message());
+      });
+    }
+  }
+  return nsPer(start, subscribers * static_cast<std::size_t>(messages));
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int topics = argc > 1 ? std::atoi(argv[1]) : 10000;
+  const int subscribers = argc > 2 ? std::atoi(argv[2]) : 1000;
+  const int payload_bytes = argc > 3 ? std::atoi(argv[3]) : 64;
+  std::printf("%d topics, %d subscribers, %d byte payloads\n\n", topics,
+              subscribers, payload_bytes);
+
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> any_topic(0, topics - 1);
+  std::vector<std::vector<std::string>> patterns(subscribers);
+  for (int s = 0; s < subscribers; ++s) {
+    for (int i = 0; i < kTopicsPerSubscriber; ++i) {
+      patterns[s].push_back(topicName(any_topic(rng)));
+    }
+    if (s % 10 == 0) {
+      patterns[s].push_back("g" + std::to_string(s / 10 % kGroups) + ".*");
+    }
+    patterns[s].push_back("hot");
+  }
+  std::vector<std::string> names(topics);
+  for (int t = 0; t < topics; ++t) names[t] = topicName(t);
+
+  TopicRegistry<Sink> registry;
+  std::vector<Sink> sinks(subscribers);
+  auto start = Clock::now();
+  const auto subscriptions = subscribeAll(registry, patterns, sinks);
+  std::printf("%-12s %8.0f ns  (%zu subscriptions, %zu patterns)\n",
+              "subscribe", nsPer(start, subscriptions), subscriptions,
+              registry.patterns());
+
+  const int publishes = 1000000;
+  std::vector<int> order(publishes);
+  for (auto& t : order) t = any_topic(rng);
+  start = Clock::now();
+  for (const int t : order) {
+    registry.forEachSubscriber(names[t], [](Sink& sink) { ++sink.matched; });
+  }
+  const double match_ns = nsPer(start, publishes);
+  std::size_t matched = 0;
+  for (const auto& sink : sinks) matched += sink.matched;
+  std::printf("%-12s %8.0f ns  (%.2f subscribers per topic)\n", "match",
+              match_ns, static_cast<double>(matched) / publishes);
+
+  std::vector<std::pair<int, int>> all;
+  for (int s = 0; s < subscribers; ++s) {
+    for (std::size_t p = 0; p < patterns[s].size(); ++p) {
+      all.emplace_back(s, static_cast<int>(p));
+    }
+  }
+  std::shuffle(all.begin(), all.end(), rng);
+  start = Clock::now();
+  for (const auto& sp : all) {
+    registry.unsubscribe(sinks[sp.first].entries[sp.second]);
+  }
+  std::printf("%-12s %8.0f ns  (%zu patterns left)\n\n", "unsubscribe",
+              nsPer(start, all.size()), registry.patterns());
+
+  const std::string payload(payload_bytes, 'x');
+  const int messages = std::max(1, 10000000 / subscribers);
+  std::printf("fan-out of %d messages to %d subscribers, per delivery\n",
+              messages, subscribers);
+  std::printf("%-12s %8.1f ns\n", "copy",
+              fanOutCopied(subscribers, messages, payload));
+  std::printf("%-12s %8.1f ns\n", "shared",
+              fanOutShared(subscribers, messages, payload));
+  return 0;
+}
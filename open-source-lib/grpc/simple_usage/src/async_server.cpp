@@ -0,0 +1,169 @@
+// Greeter on the async API: one completion queue and one thread per core.
+//
+// server.cpp uses the sync Greeter::Service, where gRPC's own thread pool
+// takes every call and each call heap allocates its context, request and
+// response. Here every queue owns a fixed pool of CallData objects, each one
+// a slot for one call in flight. A slot asks for the next SayHello, answers
+// it and asks again, so after start-up nothing is created per call:
+//
+// - the request and the response live on the slot's protobuf Arena, whose
+//   first block is part of the slot, and the arena is reset between calls
+// - the reply is written into the response's string in place instead of
+//   concatenating a temporary
+//
+// The ServerContext and the responder have to be new for every call; they
+// are rebuilt in place in std::optionals.
+//
+// Only SayHello is async. SayHelloStream is served synchronously on gRPC's
+// own threads, as in server.cpp.
+//
+// usage: async_server [ADDRESS] [threads] [calls per thread]
+
+#include <google/protobuf/arena.h>
+#include <grpcpp/grpcpp.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "greeter_service.h"
+
+using greeter::Greeter;
+using greeter::HelloBatch;
+using greeter::HelloBatchResponse;
+using greeter::HelloRequest;
+using greeter::HelloResponse;
+using grpc::Server;
+using grpc::ServerAsyncResponseWriter;
+using grpc::ServerBuilder;
+using grpc::ServerCompletionQueue;
+using grpc::ServerContext;
+using grpc::ServerReaderWriter;
+using grpc::Status;
+
+namespace {
+// Enough for a request, a response and their strings, so the arena does not
+// allocate for ordinary names.
+constexpr std::size_t kArenaBlock = 1024;
+
+class Service final
+    : public Greeter::WithAsyncMethod_SayHello<Greeter::Service> {
+  Status SayHelloStream(
+      ServerContext* context,
+      ServerReaderWriter<HelloBatchResponse, HelloBatch>* stream) override {
+    return ServeHelloStream(stream);
+  }
+};
+
+class CallData {
+ public:
+  CallData(Service& service, ServerCompletionQueue& cq)
+      : service_(service), cq_(cq), arena_(arenaOptions(block_)) {
+    Request();
+  }
+
+  CallData(const CallData&) = delete;
+  CallData& operator=(const CallData&) = delete;
+
+  // Called by the queue's thread with the outcome of the last operation.
+  void Proceed(bool ok) {
+    if (state_ == State::kRequested) {
+      // not ok: the server is shutting down and no call arrived
+      if (!ok) return;
+      Greet(*request_, response_);
+      state_ = State::kFinishing;
+      responder_->Finish(*response_, Status::OK, this);
+      return;
+    }
+    // the reply is sent (or the call is gone); on to the next call
+    Request();
+  }
+
+ private:
+  enum class State { kRequested, kFinishing };
+
+  static google::protobuf::ArenaOptions arenaOptions(
+      std::array<char, kArenaBlock>& block) {
+    google::protobuf::ArenaOptions options;
+    options.initial_block = block.data();
+    options.initial_block_size = block.size();
+    return options;
+  }
+
+  void Request() {
+    responder_.reset();
+    context_.reset();
+    arena_.Reset();
+    request_ = google::protobuf::Arena::CreateMessage<HelloRequest>(&arena_);
+    response_ = google::protobuf::Arena::CreateMessage<HelloResponse>(&arena_);
+    context_.emplace();
+    responder_.emplace(&*context_);
+    state_ = State::kRequested;
+    service_.RequestSayHello(&*context_, request_, &*responder_, &cq_, &cq_,
+                             this);
+  }
+
+  Service& service_;
+  ServerCompletionQueue& cq_;
+  std::array<char, kArenaBlock> block_;
+  google::protobuf::Arena arena_;
+  HelloRequest* request_ = nullptr;
+  HelloResponse* response_ = nullptr;
+  std::optional<ServerContext> context_;
+  std::optional<ServerAsyncResponseWriter<HelloResponse>> responder_;
+  State state_ = State::kRequested;
+};
+
+void HandleCalls(Service& service, ServerCompletionQueue& cq,
+                 int calls) {
+  std::vector<std::unique_ptr<CallData>> pool;
+  pool.reserve(calls);
+  for (int i = 0; i < calls; ++i) {
+    pool.push_back(std::make_unique<CallData>(service, cq));
+  }
+  void* tag;
+  bool ok;
+  while (cq.Next(&tag, &ok)) {
+    static_cast<CallData*>(tag)->Proceed(ok);
+  }
+}
+
+void RunServer(const std::string& server_address, int threads, int calls) {
+  Service service;
+
+  ServerBuilder builder;
+  builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
+  builder.RegisterService(&service);
+  std::vector<std::unique_ptr<ServerCompletionQueue>> queues;
+  for (int i = 0; i < threads; ++i) {
+    queues.push_back(builder.AddCompletionQueue());
+  }
+  std::unique_ptr<Server> server(builder.BuildAndStart());
+  std::cout << "Async server listening on " << server_address << " with "
+            << threads << " queues x " << calls << " calls" << std::endl;
+
+  std::vector<std::thread> workers;
+  for (auto& cq : queues) {
+    workers.emplace_back(HandleCalls, std::ref(service), std::ref(*cq), calls);
+  }
+  for (auto& worker : workers) worker.join();
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  const std::string address = argc > 1 ? argv[1] : "0.0.0.0:50052";
+  const int threads =
+      argc > 2 ? std::atoi(argv[2])
+               : static_cast<int>(
+                     std::max(1u, std::thread::hardware_concurrency()));
+  const int calls = argc > 3 ? std::atoi(argv[3]) : 128;
+  RunServer(address, threads, calls);
+  return 0;
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <grpcpp/grpcpp.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "greeter.grpc.pb.h"
+
+// SayHello for many caller threads over one SayHelloStream.
+//
+// Callers block in SayHello() as with the unary stub, but their requests are
+// collected into HelloBatch messages: a batch goes out when it holds
+// `max_batch` requests or when its oldest request has waited `max_delay`,
+// whichever comes first. The server answers each batch in order, so replies
+// are matched to callers by position.
+//
+// One thread writes batches and one reads replies; gRPC allows one read and
+// one write in flight on a stream at a time. With a single caller every
+// request waits the full `max_delay`, so the delay is the latency paid for
+// fewer, larger messages under load.
+class BatchingGreeter {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  BatchingGreeter(greeter::Greeter::Stub& stub, int max_batch,
+                  Clock::duration max_delay)
+      : max_batch_(max_batch),
+        max_delay_(max_delay),
+        stream_(stub.SayHelloStream(&context_)),
+        writer_([this] { WriteBatches(); }),
+        reader_([this] { ReadReplies(); }) {}
+
+  BatchingGreeter(const BatchingGreeter&) = delete;
+  BatchingGreeter& operator=(const BatchingGreeter&) = delete;
+
+  // Sends what is queued, then closes the stream.
+  ~BatchingGreeter() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closing_ = true;
+    }
+    queued_cv_.notify_one();
+    writer_.join();
+    reader_.join();
+    stream_->Finish();
+  }
+
+  // Returns the greeting, or "RPC failed" once the stream broke.
+  std::string SayHello(const std::string& name) {
+    std::future<std::string> reply;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (broken_) return "RPC failed";
+      queued_.push_back(Call{name, Clock::now(), {}});
+      reply = queued_.back().reply.get_future();
+      if (queued_.size() == 1 ||
+          queued_.size() == static_cast<std::size_t>(max_batch_)) {
+        queued_cv_.notify_one();
+      }
+    }
+    return reply.get();
+  }
+
+  // Batches written so far.
+  std::uint64_t batches() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return batches_;
+  }
+
+ private:
+  struct Call {
+    std::string name;
+    Clock::time_point queued_at;
+    std::promise<std::string> reply;
+  };
+
+  void WriteBatches() {
+    greeter::HelloBatch batch;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      queued_cv_.wait(lock, [this] { return closing_ || !queued_.empty(); });
+      if (queued_.empty()) break;
+      // wait for a full batch, the oldest call's deadline or the end
+      const auto deadline = queued_.front().queued_at + max_delay_;
+      queued_cv_.wait_until(lock, deadline, [this] {
+        return closing_ ||
+               queued_.size() >= static_cast<std::size_t>(max_batch_);
+      });
+
+      batch.Clear();
+      const auto count =
+          std::min(queued_.size(), static_cast<std::size_t>(max_batch_));
+      for (std::size_t i = 0; i < count; ++i) {
+        batch.add_requests()->set_name(std::move(queued_.front().name));
+        sent_.push_back(std::move(queued_.front().reply));
+        queued_.pop_front();
+      }
+      ++batches_;
+
+      lock.unlock();
+      const bool written = stream_->Write(batch);
+      lock.lock();
+      if (!written) {
+        Break(lock);
+        break;
+      }
+    }
+    lock.unlock();
+    stream_->WritesDone();
+  }
+
+  void ReadReplies() {
+    greeter::HelloBatchResponse reply;
+    while (stream_->Read(&reply)) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (auto& response : *reply.mutable_responses()) {
+        if (sent_.empty()) break;
+        sent_.front().set_value(std::move(*response.mutable_message()));
+        sent_.pop_front();
+      }
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    Break(lock);
+  }
+
+  // Fails every call still waiting; no new ones are taken.
+  void Break(std::unique_lock<std::mutex>&) {
+    broken_ = true;
+    for (auto& call : queued_) call.reply.set_value("RPC failed");
+    queued_.clear();
+    for (auto& reply : sent_) reply.set_value("RPC failed");
+    sent_.clear();
+  }
+
+  const int max_batch_;
+  const Clock::duration max_delay_;
+  grpc::ClientContext context_;
+  std::unique_ptr<grpc::ClientReaderWriter<greeter::HelloBatch,
+                                           greeter::HelloBatchResponse>>
+      stream_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable queued_cv_;
+  std::deque<Call> queued_;                     // not written yet
+  std::deque<std::promise<std::string>> sent_;  // written, not answered
+  std::uint64_t batches_ = 0;
+  bool closing_ = false;
+  bool broken_ = false;
+
+  std::thread writer_;
+  std::thread reader_;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <grpcpp/grpcpp.h>
+
+#include <string_view>
+
+#include "greeter.grpc.pb.h"
+
+// Writes "Hello <name>" into `response` in place.
+inline void Greet(const greeter::HelloRequest& request,
+                  greeter::HelloResponse* response) {
+  constexpr std::string_view kPrefix = "Hello ";
+  auto* message = response->mutable_message();
+  message->reserve(kPrefix.size() + request.name().size());
+  message->assign(kPrefix.data(), kPrefix.size());
+  message->append(request.name());
+}
+
+// Answers every HelloBatch on `stream` until the client is done writing.
+inline grpc::Status ServeHelloStream(
+    grpc::ServerReaderWriter<greeter::HelloBatchResponse, greeter::HelloBatch>*
+        stream) {
+  // both messages are reused for the whole stream
+  greeter::HelloBatch batch;
+  greeter::HelloBatchResponse reply;
+  while (stream->Read(&batch)) {
+    reply.Clear();
+    reply.mutable_responses()->Reserve(batch.requests_size());
+    for (const auto& request : batch.requests()) {
+      Greet(request, reply.add_responses());
+    }
+    if (!stream->Write(reply)) break;
+  }
+  return grpc::Status::OK;
+}
+
+// The sync Greeter, shared by server.cpp and stream_bench.cpp.
+class GreeterServiceImpl final : public greeter::Greeter::Service {
+  grpc::Status SayHello(grpc::ServerContext* context,
+                        const greeter::HelloRequest* request,
+                        greeter::HelloResponse* response) override {
+    Greet(*request, response);
+    return grpc::Status::OK;
+  }
+
+  grpc::Status SayHelloStream(
+      grpc::ServerContext* context,
+      grpc::ServerReaderWriter<greeter::HelloBatchResponse,
+                               greeter::HelloBatch>* stream) override {
+    return ServeHelloStream(stream);
+  }
+};
@@ -0,0 +1,161 @@
+// Load generator for the Greeter servers.
+//
+// Opens `channels` channels, each with a connection of its own, a completion
+// queue and a thread, and keeps `inflight` SayHello calls outstanding on each
+// of them: whenever a reply comes back the next call goes out. After one
+// second of warm-up it counts replies for `seconds` seconds and prints the
+// rate and the latency percentiles (LatencyHistogram, microseconds).
+//
+// Run it against both servers to compare them:
+//
+//   server                      sync Greeter::Service on :50051
+//   async_server                completion queues on :50052
+//   load_client localhost:50051
+//   load_client localhost:50052
+//
+// usage: load_client [ADDRESS] [channels] [inflight] [seconds]
+
+#include <grpcpp/grpcpp.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "greeter.grpc.pb.h"
+#include "latency_histogram.h"
+
+using greeter::Greeter;
+using greeter::HelloRequest;
+using greeter::HelloResponse;
+using grpc::ClientAsyncResponseReader;
+using grpc::ClientContext;
+using grpc::CompletionQueue;
+using grpc::Status;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+constexpr auto kWarmUp = std::chrono::seconds(1);
+
+// One call slot: sent again as soon as its reply is in.
+struct Call {
+  Clock::time_point start;
+  std::optional<ClientContext> context;
+  HelloResponse response;
+  Status status;
+  std::unique_ptr<ClientAsyncResponseReader<HelloResponse>> reader;
+};
+
+struct Result {
+  LatencyHistogram latency;
+  std::uint64_t failed = 0;
+};
+
+class Channel {
+ public:
+  Channel(const std::string& address, int index) {
+    grpc::ChannelArguments args;
+    // a connection per channel instead of one shared by all of them
+    args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+    args.SetInt("load_client.channel", index);
+    stub_ = Greeter::NewStub(grpc::CreateCustomChannel(
+        address, grpc::InsecureChannelCredentials(), args));
+    request_.set_name("world");
+  }
+
+  // Keeps `inflight` calls going until `stop`, recording the ones that
+  // complete while `measuring`.
+  void Run(int inflight, const std::atomic<bool>& measuring,
+           const std::atomic<bool>& stop) {
+    std::vector<Call> calls(inflight);
+    for (auto& call : calls) Start(call);
+
+    int outstanding = inflight;
+    void* tag;
+    bool ok;
+    while (outstanding > 0 && cq_.Next(&tag, &ok)) {
+      auto& call = *static_cast<Call*>(tag);
+      if (measuring.load(std::memory_order_relaxed)) {
+        if (ok && call.status.ok()) {
+          result_.latency.record(Clock::now() - call.start);
+        } else {
+          ++result_.failed;
+        }
+      }
+      if (stop.load(std::memory_order_relaxed)) {
+        --outstanding;
+      } else {
+        Start(call);
+      }
+    }
+    cq_.Shutdown();
+    while (cq_.Next(&tag, &ok)) {
+    }
+  }
+
+  const Result& result() const { return result_; }
+
+ private:
+  void Start(Call& call) {
+    call.context.reset();
+    call.context.emplace();
+    call.start = Clock::now();
+    call.reader = stub_->PrepareAsyncSayHello(&*call.context, request_, &cq_);
+    call.reader->StartCall();
+    call.reader->Finish(&call.response, &call.status, &call);
+  }
+
+  std::unique_ptr<Greeter::Stub> stub_;
+  CompletionQueue cq_;
+  HelloRequest request_;
+  Result result_;
+};
+}  // namespace
+
+int main(int argc, char** argv) {
+  const std::string address = argc > 1 ? argv[1] : "localhost:50051";
+  const int channel_count = argc > 2 ? std::atoi(argv[2]) : 4;
+  const int inflight = argc > 3 ? std::atoi(argv[3]) : 64;
+  const int seconds = argc > 4 ? std::atoi(argv[4]) : 10;
+  std::printf("%s: %d channels x %d in flight, %ds\n", address.c_str(),
+              channel_count, inflight, seconds);
+
+  std::vector<std::unique_ptr<Channel>> channels;
+  for (int i = 0; i < channel_count; ++i) {
+    channels.push_back(std::make_unique<Channel>(address, i));
+  }
+  std::atomic<bool> measuring{false};
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> threads;
+  for (auto& channel : channels) {
+    threads.emplace_back([&channel, inflight, &measuring, &stop] {
+      channel->Run(inflight, measuring, stop);
+    });
+  }
+
+  std::this_thread::sleep_for(kWarmUp);
+  const auto start = Clock::now();
+  measuring = true;
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  measuring = false;
+  const double elapsed =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  stop = true;
+  for (auto& thread : threads) thread.join();
+
+  Result total;
+  for (const auto& channel : channels) {
+    total.latency.merge(channel->result().latency);
+    total.failed += channel->result().failed;
+  }
+  std::printf("%.0f calls/s, %llu failed\n",
+              static_cast<double>(total.latency.count()) / elapsed,
+              static_cast<unsigned long long>(total.failed));
+  total.latency.print("latency");
+  return total.failed == 0 ? 0 : 1;
+}
@@ -4,24 +4,10 @@
 #include <memory>
 #include <string>
 
-#include "greeter.grpc.pb.h"
+#include "greeter_service.h"
 
-using greeter::Greeter;
-using greeter::HelloRequest;
-using greeter::HelloResponse;
 using grpc::Server;
 using grpc::ServerBuilder;
-using grpc::ServerContext;
-using grpc::Status;
-
-class GreeterServiceImpl final : public Greeter::Service {
-  Status SayHello(ServerContext* context, const HelloRequest* request,
-                  HelloResponse* response) override {
-    std::string prefix("Hello ");
-    response->set_message(prefix + request->name());
-    return Status::OK;
-  }
-};
 
 void RunServer() {
   std::string server_address("0.0.0.0:50051");
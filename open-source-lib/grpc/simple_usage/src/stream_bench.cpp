@@ -0,0 +1,157 @@
+// Unary SayHello vs batched SayHelloStream on localhost.
+//
+// Starts GreeterServiceImpl in this process and runs 1, 64 and 1024 caller
+// threads against it, each calling SayHello in a loop and waiting for the
+// reply:
+//
+//   unary    Greeter::Stub::SayHello, one RPC per greeting
+//   stream   BatchingGreeter over one SayHelloStream, batches of up to
+//            `max_batch` greetings, flushed after `max_delay_us` at the latest
+//
+// Both use a single channel. Reported per run: greetings/s, the latency a
+// caller sees, and CPU per greeting: user + system time of the whole process,
+// so client and server together, divided by the greetings. For the stream
+// also the average batch size.
+//
+// usage: stream_bench [seconds] [max_batch] [max_delay_us]
+
+#include <grpcpp/grpcpp.h>
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batching_greeter.h"
+#include "greeter_service.h"
+#include "latency_histogram.h"
+
+using greeter::Greeter;
+using greeter::HelloRequest;
+using greeter::HelloResponse;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+constexpr auto kWarmUp = std::chrono::milliseconds(500);
+
+double CpuSeconds() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+         static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) /
+             1e6;
+}
+
+struct Caller {
+  LatencyHistogram latency;
+  std::uint64_t failed = 0;
+};
+
+// Runs `callers` threads calling `say_hello(name)` until told to stop, and
+// measures them after the warm-up.
+template <typename SayHello>
+void Run(const char* mode, int callers, int seconds, SayHello say_hello,
+         const std::function<std::uint64_t()>& messages = {}) {
+  std::vector<Caller> results(callers);
+  std::atomic<bool> measuring{false};
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < callers; ++i) {
+    threads.emplace_back([&, i] {
+      const std::string name = "caller " + std::to_string(i);
+      auto& result = results[i];
+      while (!stop.load(std::memory_order_relaxed)) {
+        const auto start = Clock::now();
+        const bool ok = say_hello(name);
+        if (!measuring.load(std::memory_order_relaxed)) continue;
+        if (ok) {
+          result.latency.record(Clock::now() - start);
+        } else {
+          ++result.failed;
+        }
+      }
+    });
+  }
+
+  std::this_thread::sleep_for(kWarmUp);
+  const auto messages0 = messages ? messages() : 0;
+  const double cpu0 = CpuSeconds();
+  const auto start = Clock::now();
+  measuring = true;
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  measuring = false;
+  const double elapsed =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  const double cpu = CpuSeconds() - cpu0;
+  const auto sent = messages ? messages() - messages0 : 0;
+  stop = true;
+  for (auto& thread : threads) thread.join();
+
+  LatencyHistogram latency;
+  std::uint64_t failed = 0;
+  for (const auto& result : results) {
+    latency.merge(result.latency);
+    failed += result.failed;
+  }
+  const auto count = static_cast<double>(latency.count());
+  std::printf("%-7s %7d %12.0f %8lld %8lld %10.2f", mode, callers,
+              count / elapsed,
+              static_cast<long long>(latency.percentile(0.5).count()),
+              static_cast<long long>(latency.percentile(0.99).count()),
+              count > 0 ? cpu * 1e6 / count : 0.0);
+  if (sent > 0) std::printf(" %8.1f", count / static_cast<double>(sent));
+  if (failed > 0) {
+    std::printf("  (%llu failed)", static_cast<unsigned long long>(failed));
+  }
+  std::printf("\n");
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  const int seconds = argc > 1 ? std::atoi(argv[1]) : 3;
+  const int max_batch = argc > 2 ? std::atoi(argv[2]) : 64;
+  const auto max_delay =
+      std::chrono::microseconds(argc > 3 ? std::atoi(argv[3]) : 200);
+
+  GreeterServiceImpl service;
+  int port = 0;
+  grpc::ServerBuilder builder;
+  builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(),
+                           &port);
+  builder.RegisterService(&service);
+  std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
+  auto stub = Greeter::NewStub(
+      grpc::CreateChannel("127.0.0.1:" + std::to_string(port),
+                          grpc::InsecureChannelCredentials()));
+
+  std::printf("max_batch %d, max_delay %lldus, %ds per run\n\n", max_batch,
+              static_cast<long long>(max_delay.count()), seconds);
+  std::printf("%-7s %7s %12s %8s %8s %10s %8s\n", "mode", "callers",
+              "greetings/s", "p50(us)", "p99(us)", "cpu/msg(us)", "batch");
+  for (int callers : {1, 64, 1024}) {
+    Run("unary", callers, seconds, [&stub](const std::string& name) {
+      HelloRequest request;
+      request.set_name(name);
+      HelloResponse response;
+      grpc::ClientContext context;
+      return stub->SayHello(&context, request, &response).ok();
+    });
+
+    BatchingGreeter batching(*stub, max_batch, max_delay);
+    Run(
+        "stream", callers, seconds,
+        [&batching](const std::string& name) {
+          return batching.SayHello(name) != "RPC failed";
+        },
+        [&batching] { return batching.batches(); });
+  }
+
+  server->Shutdown();
+  return 0;
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <fcntl.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/message_lite.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+/*
+Files of length-delimited records: every record is its size as a varint
+followed by the serialized message, the format of writeDelimitedTo /
+parseDelimitedFrom in the Java and Python libraries.
+
+DelimitedWriter keeps one CodedOutputStream over a FileOutputStream for the
+whole file, so a record costs a ByteSizeLong, a varint and the serialization
+into the stream's buffer.
+
+MappedFile and forEachRecord read without copying: the file is mapped and a
+CodedInputStream reads straight from the mapping. How a record is parsed is
+up to the caller, e.g. into one message that is reused (ParseFromCodedStream
+clears it first but keeps its strings and repeated fields allocated) or into
+messages on an Arena.
+*/
+
+namespace delimited_records {
+
+class DelimitedWriter {
+ public:
+  // Creates or truncates `path`. Throws std::system_error.
+  explicit DelimitedWriter(const std::string& path)
+      : fd_(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                   0644)) {
+    if (fd_ == -1) {
+      throw std::system_error(errno, std::generic_category(), path);
+    }
+    file_.emplace(fd_, kBufferSize);
+    out_.emplace(&*file_);
+  }
+
+  DelimitedWriter(const DelimitedWriter&) = delete;
+  DelimitedWriter& operator=(const DelimitedWriter&) = delete;
+
+  // Closes the file if close() was not called; errors are lost then.
+  ~DelimitedWriter() {
+    try {
+      close();
+    } catch (const std::system_error&) {
+    }
+  }
+
+  void write(const google::protobuf::MessageLite& message) {
+    const auto size = static_cast<std::uint32_t>(message.ByteSizeLong());
+    out_->WriteVarint32(size);
+    message.SerializeWithCachedSizes(&*out_);
+    bytes_ += google::protobuf::io::CodedOutputStream::VarintSize32(size) + size;
+  }
+
+  // Bytes written so far, buffered ones included.
+  std::uint64_t bytes() const { return bytes_; }
+
+  // Flushes and closes the file. Throws std::system_error.
+  void close() {
+    if (fd_ == -1) return;
+    const bool ok = !out_->HadError();
+    out_.reset();
+    const bool closed = file_->Close();
+    const int error = file_->GetErrno();
+    file_.reset();
+    fd_ = -1;
+    if (!ok || !closed) {
+      throw std::system_error(error, std::generic_category(), "write");
+    }
+  }
+
+ private:
+  static constexpr int kBufferSize = 1 << 20;
+
+  int fd_;
+  std::uint64_t bytes_ = 0;
+  std::optional<google::protobuf::io::FileOutputStream> file_;
+  std::optional<google::protobuf::io::CodedOutputStream> out_;
+};
+
+// A file mapped read-only. Throws std::system_error.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+      throw std::system_error(errno, std::generic_category(), path);
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) == 0) size_ = static_cast<std::size_t>(st.st_size);
+    if (size_ > 0) {
+      void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        const int error = errno;
+        ::close(fd);
+        throw std::system_error(error, std::generic_category(), path);
+      }
+      // records are read front to back
+      ::madvise(data, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const std::uint8_t*>(data);
+    }
+    ::close(fd);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    if (data_) ::munmap(const_cast<std::uint8_t*>(data_), size_);
+  }
+
+  const std::uint8_t* data() const { return data_; }
+  std::size_t size() const { return size_; }
+
+ private:
+  const std::uint8_t* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+// Calls `parse(in)` for every record in [data, data + size), with `in`
+// limited to the record. `parse` returns false if the record does not parse.
+// Returns the number of records; throws std::runtime_error on a corrupt or
+// truncated record.
+//
+// A CodedInputStream counts its position in an int, so files over 1GiB are
+// read through several streams, each starting at a record boundary.
+template <typename Parse>
+std::uint64_t forEachRecord(const std::uint8_t* data, std::size_t size,
+                            Parse&& parse) {
+  constexpr std::size_t kWindow = std::size_t{1} << 30;
+  std::uint64_t records = 0;
+  std::size_t offset = 0;
+  while (offset < size) {
+    const int window = static_cast<int>(std::min(size - offset, kWindow));
+    google::protobuf::io::CodedInputStream in(data + offset, window);
+    int consumed = 0;  // up to the end of the last whole record
+    while (consumed < window) {
+      std::uint32_t length;
+      if (!in.ReadVarint32(&length)) break;
+      // a record that crosses the window starts the next one
+      if (length > static_cast<std::uint32_t>(window - in.CurrentPosition())) {
+        break;
+      }
+      const auto limit = in.PushLimit(static_cast<int>(length));
+      if (!parse(in) || in.BytesUntilLimit() != 0) {
+        throw std::runtime_error("corrupt record at offset " +
+                                 std::to_string(offset + consumed));
+      }
+      in.PopLimit(limit);
+      consumed = in.CurrentPosition();
+      ++records;
+    }
+    if (consumed == 0) {
+      throw std::runtime_error("truncated record at offset " +
+                               std::to_string(offset));
+    }
+    offset += static_cast<std::size_t>(consumed);
+  }
+  return records;
+}
+
+}  // namespace delimited_records
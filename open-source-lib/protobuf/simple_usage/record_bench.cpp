@@ -0,0 +1,266 @@
+// PersonDetail at volume: a file of length-delimited records (see
+// delimited_records.h), written and read back in different ways.
+//
+// write   `MB` megabytes of records, every person with `phones` phones:
+//           heap        a new PersonDetail per record, numbers made with
+//                       std::to_string concatenation as in main.cpp
+//           reuse       one PersonDetail, Clear()ed and refilled, numbers
+//                       formatted with std::to_chars into one buffer
+//           arena       a PersonDetail per record on an Arena, Reset() every
+//                       kArenaBatch records
+// read    the file the last writer left:
+//           istream     std::ifstream and ParseDelimitedFromZeroCopyStream
+//                       into one message; the file is copied into the
+//                       stream's buffer first
+//           mmap heap   mapped, a new PersonDetail per record
+//           mmap reuse  mapped, one message parsed again and again
+//           mmap arena  mapped, messages on an Arena as above
+//
+// The file is in the page cache once it is written, so the reads measure
+// parsing, not the disk. Reported: records/s and MB/s.
+//
+// usage: record_bench [file] [MB] [phones]
+
+#include <google/protobuf/arena.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/util/delimited_message_util.h>
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "delimited_records.h"
+#include "proto/message.pb.h"
+
+using Clock = std::chrono::steady_clock;
+using delimited_records::DelimitedWriter;
+using delimited_records::MappedFile;
+using simple_demo::PersonDetail;
+
+namespace {
+constexpr int kArenaBatch = 1024;
+// big enough for kArenaBatch people with a few phones
+constexpr std::size_t kArenaBlock = 4 << 20;
+constexpr std::int64_t kEpoch = 1700000000;
+
+struct Result {
+  std::uint64_t records = 0;
+  std::uint64_t checksum = 0;  // the same for every reader
+};
+
+void add(Result& result, const PersonDetail& pd) {
+  ++result.records;
+  result.checksum += static_cast<std::uint64_t>(pd.id()) + pd.phones_size() +
+                     pd.name().size();
+}
+
+void report(const char* name, double seconds, std::uint64_t records,
+            std::uint64_t bytes) {
+  std::printf("%-12s %10.2fs %14.0f %10.1f\n", name, seconds,
+              static_cast<double>(records) / seconds,
+              static_cast<double>(bytes) / seconds / 1e6);
+}
+
+double since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+google::protobuf::ArenaOptions arenaOptions(std::vector<char>& block) {
+  google::protobuf::ArenaOptions options;
+  options.initial_block = block.data();
+  options.initial_block_size = block.size();
+  return options;
+}
+
+//-------------------------------------------------------------------- write
+
+void fillHeap(PersonDetail& pd, int i, int phones) {
+  pd.set_name("person " + std::to_string(i));
+  pd.set_id(i);
+  pd.set_email("person" + std::to_string(i) + "@example.com");
+  for (int p = 0; p < phones; ++p) {
+    auto* number = pd.add_phones();
+    number->set_number("3345678" + std::to_string(p));
+    number->set_type(static_cast<PersonDetail::PhoneType>(p % 3));
+  }
+  pd.mutable_last_updated()->set_seconds(kEpoch + i);
+}
+
+// Assigns `prefix` followed by `n` to `out`, reusing its capacity.
+void setNumbered(std::string& out, std::string_view prefix, int n,
+                 std::string_view suffix = {}) {
+  char digits[16];
+  const auto end = std::to_chars(digits, digits + sizeof digits, n).ptr;
+  out.assign(prefix.data(), prefix.size());
+  out.append(digits, end);
+  out.append(suffix.data(), suffix.size());
+}
+
+void fillReused(PersonDetail& pd, int i, int phones) {
+  setNumbered(*pd.mutable_name(), "person ", i);
+  pd.set_id(i);
+  setNumbered(*pd.mutable_email(), "person", i, "@example.com");
+  for (int p = 0; p < phones; ++p) {
+    auto* number = pd.add_phones();
+    setNumbered(*number->mutable_number(), "3345678", p);
+    number->set_type(static_cast<PersonDetail::PhoneType>(p % 3));
+  }
+  pd.mutable_last_updated()->set_seconds(kEpoch + i);
+}
+
+template <typename WriteOne>
+void write(const char* name, const std::string& path, std::uint64_t target,
+           WriteOne write_one) {
+  const auto start = Clock::now();
+  DelimitedWriter writer(path);
+  int i = 0;
+  while (writer.bytes() < target) write_one(writer, i++);
+  writer.close();
+  report(name, since(start), static_cast<std::uint64_t>(i), writer.bytes());
+}
+
+//--------------------------------------------------------------------- read
+
+Result readIstream(const std::string& path) {
+  Result result;
+  std::ifstream file(path, std::ios::binary);
+  google::protobuf::io::IstreamInputStream input(&file, 1 << 20);
+  PersonDetail pd;
+  bool clean_eof = false;
+  while (true) {
+    // ParseDelimitedFrom* merges into the message
+    pd.Clear();
+    if (!google::protobuf::util::ParseDelimitedFromZeroCopyStream(
+            &pd, &input, &clean_eof)) {
+      break;
+    }
+    add(result, pd);
+  }
+  if (!clean_eof) std::fprintf(stderr, "istream: corrupt record\n");
+  return result;
+}
+
+Result readMappedHeap(const MappedFile& file) {
+  Result result;
+  delimited_records::forEachRecord(
+      file.data(), file.size(), [&](google::protobuf::io::CodedInputStream& in) {
+        auto pd = std::make_unique<PersonDetail>();
+        if (!pd->ParseFromCodedStream(&in)) return false;
+        add(result, *pd);
+        return true;
+      });
+  return result;
+}
+
+Result readMappedReuse(const MappedFile& file) {
+  Result result;
+  PersonDetail pd;
+  delimited_records::forEachRecord(
+      file.data(), file.size(), [&](google::protobuf::io::CodedInputStream& in) {
+        if (!pd.ParseFromCodedStream(&in)) return false;
+        add(result, pd);
+        return true;
+      });
+  return result;
+}
+
+Result readMappedArena(const MappedFile& file) {
+  Result result;
+  std::vector<char> block(kArenaBlock);
+  google::protobuf::Arena arena(arenaOptions(block));
+  int in_arena = 0;
+  delimited_records::forEachRecord(
+      file.data(), file.size(), [&](google::protobuf::io::CodedInputStream& in) {
+        if (in_arena++ == kArenaBatch) {
+          arena.Reset();
+          in_arena = 1;
+        }
+        auto* pd = google::protobuf::Arena::CreateMessage<PersonDetail>(&arena);
+        if (!pd->ParseFromCodedStream(&in)) return false;
+        add(result, *pd);
+        return true;
+      });
+  return result;
+}
+
+bool read(const char* name, const std::string& path, std::uint64_t size,
+          Result (*reader)(const std::string&), const Result& expected) {
+  const auto start = Clock::now();
+  const auto result = reader(path);
+  report(name, since(start), result.records, size);
+  return result.records == expected.records &&
+         result.checksum == expected.checksum;
+}
+
+bool read(const char* name, const std::string& path, std::uint64_t size,
+          Result (*reader)(const MappedFile&), const Result& expected) {
+  const auto start = Clock::now();
+  const MappedFile file(path);
+  const auto result = reader(file);
+  report(name, since(start), result.records, size);
+  return result.records == expected.records &&
+         result.checksum == expected.checksum;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+  const std::string path = argc > 1 ? argv[1] : "/tmp/person_records.bin";
+  const std::uint64_t megabytes = argc > 2 ? std::atoll(argv[2]) : 1024;
+  const int phones = argc > 3 ? std::atoi(argv[3]) : 3;
+  const std::uint64_t target = megabytes << 20;
+  std::printf("%s: %llu MB of people with %d phones\n\n", path.c_str(),
+              static_cast<unsigned long long>(megabytes), phones);
+
+  std::printf("%-12s %11s %14s %10s\n", "write", "time", "records/s", "MB/s");
+  write("heap", path, target, [phones](DelimitedWriter& writer, int i) {
+    auto pd = std::make_unique<PersonDetail>();
+    fillHeap(*pd, i, phones);
+    writer.write(*pd);
+  });
+  std::vector<char> block(kArenaBlock);
+  google::protobuf::Arena arena(arenaOptions(block));
+  write("arena", path, target, [phones, &arena](DelimitedWriter& writer,
+                                                int i) {
+    if (i % kArenaBatch == 0) arena.Reset();
+    auto* pd = google::protobuf::Arena::CreateMessage<PersonDetail>(&arena);
+    fillReused(*pd, i, phones);
+    writer.write(*pd);
+  });
+  PersonDetail reused;
+  write("reuse", path, target, [phones, &reused](DelimitedWriter& writer,
+                                                 int i) {
+    reused.Clear();
+    fillReused(reused, i, phones);
+    writer.write(reused);
+  });
+
+  // what every reader has to find
+  Result expected;
+  {
+    const MappedFile file(path);
+    expected = readMappedReuse(file);
+  }
+  const std::uint64_t size = MappedFile(path).size();
+
+  std::printf("\n%-12s %11s %14s %10s\n", "read", "time", "records/s",
+              "MB/s");
+  bool ok = read("istream", path, size, readIstream, expected);
+  ok &= read("mmap heap", path, size, readMappedHeap, expected);
+  ok &= read("mmap reuse", path, size, readMappedReuse, expected);
+  ok &= read("mmap arena", path, size, readMappedArena, expected);
+  std::remove(path.c_str());
+  if (!ok) {
+    std::printf("readers disagree\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,344 @@
+#include "record_file.h"
+
+#include <fcntl.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace record_file {
+
+namespace {
+constexpr char kMagic[8] = {'P', 'B', 'R', 'E', 'C', 'v', '1', '\0'};
+// fast levels: the point is throughput, not the last few percent of size
+constexpr int kZstdLevel = 1;
+
+struct BlockHeader {
+  std::uint32_t stored_size;  // bytes following the header
+  std::uint32_t raw_size;     // after decompression
+  std::uint32_t records;
+  std::uint32_t codec;
+};
+
+struct IndexEntry {
+  std::uint64_t offset;
+  std::uint64_t first_record;
+};
+
+struct Footer {
+  std::uint64_t index_offset;
+  std::uint64_t blocks;
+  std::uint64_t records;
+  char magic[8];
+};
+
+[[noreturn]] void corrupt(const std::string& what) {
+  throw std::runtime_error("record file: " + what);
+}
+
+template <typename T>
+T load(const std::uint8_t* p) {
+  T value;
+  std::memcpy(&value, p, sizeof value);
+  return value;
+}
+
+// Compresses `raw` into `out`. Returns false if the codec is not built in
+// or the result is not smaller.
+bool compress(Codec codec, [[maybe_unused]] std::string_view raw,
+              [[maybe_unused]] std::string& out) {
+  switch (codec) {
+    case Codec::kNone:
+      return false;
+    case Codec::kLz4:
+#ifdef HAVE_LZ4
+    {
+      out.resize(LZ4_compressBound(static_cast<int>(raw.size())));
+      const int size =
+          LZ4_compress_default(raw.data(), out.data(),
+                               static_cast<int>(raw.size()),
+                               static_cast<int>(out.size()));
+      if (size <= 0 || static_cast<std::size_t>(size) >= raw.size()) {
+        return false;
+      }
+      out.resize(size);
+      return true;
+    }
+#else
+      return false;
+#endif
+    case Codec::kZstd:
+#ifdef HAVE_ZSTD
+    {
+      out.resize(ZSTD_compressBound(raw.size()));
+      const std::size_t size = ZSTD_compress(out.data(), out.size(),
+                                             raw.data(), raw.size(), kZstdLevel);
+      if (ZSTD_isError(size) || size >= raw.size()) return false;
+      out.resize(size);
+      return true;
+    }
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+void decompress(Codec codec, [[maybe_unused]] std::string_view stored,
+                [[maybe_unused]] std::string& out) {
+  switch (codec) {
+    case Codec::kNone:
+      break;
+    case Codec::kLz4:
+#ifdef HAVE_LZ4
+    {
+      const int size = LZ4_decompress_safe(stored.data(), out.data(),
+                                           static_cast<int>(stored.size()),
+                                           static_cast<int>(out.size()));
+      if (size < 0 || static_cast<std::size_t>(size) != out.size()) {
+        corrupt("bad lz4 block");
+      }
+      return;
+    }
+#else
+      break;
+#endif
+    case Codec::kZstd:
+#ifdef HAVE_ZSTD
+    {
+      const std::size_t size = ZSTD_decompress(out.data(), out.size(),
+                                               stored.data(), stored.size());
+      if (ZSTD_isError(size) || size != out.size()) {
+        corrupt("bad zstd block");
+      }
+      return;
+    }
+#else
+      break;
+#endif
+  }
+  corrupt(std::string("codec not built in: ") + name(codec));
+}
+}  // namespace
+
+bool available(Codec codec) {
+  switch (codec) {
+    case Codec::kNone:
+      return true;
+    case Codec::kLz4:
+#ifdef HAVE_LZ4
+      return true;
+#else
+      return false;
+#endif
+    case Codec::kZstd:
+#ifdef HAVE_ZSTD
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+Codec bestCodec() {
+  if (available(Codec::kZstd)) return Codec::kZstd;
+  if (available(Codec::kLz4)) return Codec::kLz4;
+  return Codec::kNone;
+}
+
+const char* name(Codec codec) {
+  switch (codec) {
+    case Codec::kNone:
+      return "none";
+    case Codec::kLz4:
+      return "lz4";
+    case Codec::kZstd:
+      return "zstd";
+  }
+  return "unknown";
+}
+
+//------------------------------------------------------------- RecordWriter
+
+RecordWriter::RecordWriter(const std::string& path, Codec codec,
+                           std::size_t block_size)
+    : fd_(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                 0644)),
+      codec_(codec),
+      block_size_(block_size) {
+  if (fd_ == -1) {
+    throw std::system_error(errno, std::generic_category(), path);
+  }
+  block_.reserve(block_size_ + (block_size_ >> 2));
+  append(kMagic, sizeof kMagic);
+}
+
+RecordWriter::~RecordWriter() {
+  try {
+    close();
+  } catch (const std::exception&) {
+  }
+}
+
+void RecordWriter::write(const google::protobuf::MessageLite& message) {
+  using google::protobuf::io::CodedOutputStream;
+  const std::size_t size = message.ByteSizeLong();
+  const std::size_t start = block_.size();
+  block_.resize(start + CodedOutputStream::VarintSize32(
+                            static_cast<std::uint32_t>(size)) +
+                size);
+  auto* p = reinterpret_cast<std::uint8_t*>(block_.data()) + start;
+  p = CodedOutputStream::WriteVarint32ToArray(static_cast<std::uint32_t>(size),
+                                              p);
+  message.SerializeWithCachedSizesToArray(p);
+  ++block_records_;
+  ++records_;
+  raw_bytes_ += block_.size() - start;
+  if (block_.size() >= block_size_) flushBlock();
+}
+
+void RecordWriter::flushBlock() {
+  if (block_records_ == 0) return;
+  const bool compressed = compress(codec_, block_, compressed_);
+  const std::string& stored = compressed ? compressed_ : block_;
+  const BlockHeader header{static_cast<std::uint32_t>(stored.size()),
+                           static_cast<std::uint32_t>(block_.size()),
+                           block_records_,
+                           static_cast<std::uint32_t>(
+                               compressed ? codec_ : Codec::kNone)};
+  index_.emplace_back(offset_, records_ - block_records_);
+  append(&header, sizeof header);
+  append(stored.data(), stored.size());
+  block_.clear();
+  block_records_ = 0;
+}
+
+void RecordWriter::close() {
+  if (fd_ == -1) return;
+  flushBlock();
+  const std::uint64_t index_offset = offset_;
+  for (const auto& [offset, first_record] : index_) {
+    const IndexEntry entry{offset, first_record};
+    append(&entry, sizeof entry);
+  }
+  Footer footer{index_offset, index_.size(), records_, {}};
+  std::memcpy(footer.magic, kMagic, sizeof kMagic);
+  append(&footer, sizeof footer);
+  const int fd = fd_;
+  fd_ = -1;
+  if (::close(fd) != 0) {
+    throw std::system_error(errno, std::generic_category(), "close");
+  }
+}
+
+void RecordWriter::append(const void* data, std::size_t size) {
+  const auto* p = static_cast<const char*>(data);
+  while (size > 0) {
+    const ssize_t n = ::write(fd_, p, size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      throw std::system_error(errno, std::generic_category(), "write");
+    }
+    p += n;
+    size -= static_cast<std::size_t>(n);
+    offset_ += static_cast<std::uint64_t>(n);
+  }
+}
+
+//------------------------------------------------------------- RecordReader
+
+RecordReader::RecordReader(const std::string& path) : file_(path) {
+  const std::uint8_t* data = file_.data();
+  const std::size_t size = file_.size();
+  if (size < sizeof kMagic + sizeof(Footer) ||
+      std::memcmp(data, kMagic, sizeof kMagic) != 0) {
+    corrupt(path + " is not a record file");
+  }
+  const auto footer = load<Footer>(data + size - sizeof(Footer));
+  if (std::memcmp(footer.magic, kMagic, sizeof kMagic) != 0 ||
+      footer.index_offset > size - sizeof(Footer) ||
+      footer.blocks != (size - sizeof(Footer) - footer.index_offset) /
+                           sizeof(IndexEntry)) {
+    corrupt(path + " has a bad footer");
+  }
+  records_ = footer.records;
+  blocks_.reserve(footer.blocks);
+  for (std::uint64_t i = 0; i < footer.blocks; ++i) {
+    const auto entry = load<IndexEntry>(data + footer.index_offset +
+                                        i * sizeof(IndexEntry));
+    if (entry.offset + sizeof(BlockHeader) > footer.index_offset) {
+      corrupt(path + " has a bad index");
+    }
+    blocks_.push_back(Block{entry.offset, entry.first_record});
+  }
+}
+
+Codec RecordReader::codec(std::size_t block) const {
+  return static_cast<Codec>(
+      load<BlockHeader>(file_.data() + blocks_[block].offset).codec);
+}
+
+std::string_view RecordReader::block(std::size_t i,
+                                     std::string& scratch) const {
+  const std::uint8_t* p = file_.data() + blocks_[i].offset;
+  const auto header = load<BlockHeader>(p);
+  const std::string_view stored(
+      reinterpret_cast<const char*>(p + sizeof header), header.stored_size);
+  if (blocks_[i].offset + sizeof header + header.stored_size >
+      file_.size()) {
+    corrupt("block " + std::to_string(i) + " is truncated");
+  }
+  const auto codec = static_cast<Codec>(header.codec);
+  if (codec == Codec::kNone) return stored;
+  // no need to keep the old contents when growing
+  scratch.clear();
+  scratch.resize(header.raw_size);
+  decompress(codec, stored, scratch);
+  return scratch;
+}
+
+void RecordReader::read(std::uint64_t n,
+                        google::protobuf::MessageLite& message,
+                        std::string& scratch) const {
+  if (n >= records_) {
+    throw std::out_of_range("record " + std::to_string(n) + " of " +
+                            std::to_string(records_));
+  }
+  // the last block starting at or before n
+  const auto it = std::upper_bound(
+      blocks_.begin(), blocks_.end(), n,
+      [](std::uint64_t r, const Block& b) { return r < b.first_record; });
+  const std::size_t i = static_cast<std::size_t>(it - blocks_.begin()) - 1;
+  const auto records = block(i, scratch);
+
+  google::protobuf::io::CodedInputStream in(
+      reinterpret_cast<const std::uint8_t*>(records.data()),
+      static_cast<int>(records.size()));
+  for (std::uint64_t skip = n - blocks_[i].first_record; skip > 0; --skip) {
+    std::uint32_t length;
+    if (!in.ReadVarint32(&length) || !in.Skip(static_cast<int>(length))) {
+      corrupt("block " + std::to_string(i) + " is short of records");
+    }
+  }
+  std::uint32_t length;
+  if (!in.ReadVarint32(&length)) corrupt("bad record " + std::to_string(n));
+  const auto limit = in.PushLimit(static_cast<int>(length));
+  if (!message.ParseFromCodedStream(&in) || in.BytesUntilLimit() != 0) {
+    corrupt("bad record " + std::to_string(n));
+  }
+  in.PopLimit(limit);
+}
+
+}  // namespace record_file
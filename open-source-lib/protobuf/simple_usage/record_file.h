@@ -0,0 +1,146 @@
+#pragma once
+
+#include <google/protobuf/message_lite.h>
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "delimited_records.h"
+
+/*
+A file of protobuf records in compressed blocks, with an index for seeking.
+
+  file    "PBRECv1\0" block* index footer
+  block   BlockHeader, then the block's records compressed with its codec:
+          length-delimited records (a varint size before each message),
+          at least block_size bytes of them except in the last block
+  index   one IndexEntry per block
+  footer  Footer
+
+Integers are little endian. Each block names its codec, so a block that does
+not shrink is stored as is. The index is sparse: it holds where each block
+starts and the number of its first record, so record n is found with a binary
+search over the blocks, then by decompressing one block and skipping to the
+record.
+
+Blocks decompress independently, which lets forEachBlock spread them over
+threads. The file is mapped; blocks stored without compression are handed
+out straight from the mapping.
+
+Errors throw std::system_error (I/O) or std::runtime_error (format).
+*/
+
+namespace record_file {
+
+enum class Codec : std::uint32_t { kNone = 0, kLz4 = 1, kZstd = 2 };
+
+// The best codec this build has: zstd, then lz4, then none.
+Codec bestCodec();
+bool available(Codec codec);
+const char* name(Codec codec);
+
+class RecordWriter {
+ public:
+  static constexpr std::size_t kDefaultBlockSize = 64 << 10;
+
+  // Creates or truncates `path`.
+  explicit RecordWriter(const std::string& path, Codec codec = bestCodec(),
+                        std::size_t block_size = kDefaultBlockSize);
+  RecordWriter(const RecordWriter&) = delete;
+  RecordWriter& operator=(const RecordWriter&) = delete;
+  // Closes the file if close() was not called; errors are lost then.
+  ~RecordWriter();
+
+  void write(const google::protobuf::MessageLite& message);
+
+  // Writes the last block, the index and the footer.
+  void close();
+
+  std::uint64_t records() const { return records_; }
+  // Serialized records, before compression.
+  std::uint64_t rawBytes() const { return raw_bytes_; }
+  // The file so far.
+  std::uint64_t fileBytes() const { return offset_; }
+
+ private:
+  void flushBlock();
+  void append(const void* data, std::size_t size);
+
+  int fd_;
+  Codec codec_;
+  std::size_t block_size_;
+  std::string block_;  // records of the current block
+  std::uint32_t block_records_ = 0;
+  std::string compressed_;  // reused for every block
+  // offset and first record of every block written
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> index_;
+  std::uint64_t records_ = 0;
+  std::uint64_t raw_bytes_ = 0;
+  std::uint64_t offset_ = 0;
+};
+
+class RecordReader {
+ public:
+  explicit RecordReader(const std::string& path);
+
+  std::uint64_t records() const { return records_; }
+  std::size_t blocks() const { return blocks_.size(); }
+  Codec codec(std::size_t block) const;
+
+  // The records of block `i`, length-delimited. Points into the mapping or
+  // into `scratch`.
+  std::string_view block(std::size_t i, std::string& scratch) const;
+
+  // Parses record `n` into `message`. `scratch` holds the decompressed
+  // block; passing the same one again saves reallocating it.
+  void read(std::uint64_t n, google::protobuf::MessageLite& message,
+            std::string& scratch) const;
+
+  // Calls `f(thread, block, records)` for every block, with `threads`
+  // threads each decompressing its own blocks. `f` runs concurrently for
+  // different blocks, in no particular order; `thread` is in [0, threads).
+  // The first exception (a corrupt block, or one from `f`) stops handing out
+  // blocks and is rethrown once every thread has finished.
+  template <typename F>
+  void forEachBlock(int threads, F&& f) const {
+    std::atomic<std::size_t> next{0};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto work = [&](int thread) {
+      std::string scratch;
+      try {
+        for (std::size_t i = next++; i < blocks_.size(); i = next++) {
+          f(thread, i, block(i, scratch));
+        }
+      } catch (...) {
+        next = blocks_.size();
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) error = std::current_exception();
+      }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; ++t) pool.emplace_back(work, t);
+    work(0);
+    for (auto& thread : pool) thread.join();
+    if (error) std::rethrow_exception(error);
+  }
+
+ private:
+  struct Block {
+    std::uint64_t offset;
+    std::uint64_t first_record;
+  };
+
+  delimited_records::MappedFile file_;
+  std::vector<Block> blocks_;
+  std::uint64_t records_ = 0;
+};
+
+}  // namespace record_file
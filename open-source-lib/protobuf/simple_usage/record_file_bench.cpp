@@ -0,0 +1,160 @@
+// Throughput and seek latency of record_file.h.
+//
+// For every codec this build has (none, and lz4 / zstd when found):
+//
+//   write    `MB` megabytes of serialized PersonDetail records through
+//            RecordWriter; records/s, raw MB/s and file size / raw size
+//   read     every record parsed back with forEachBlock on 1 and on
+//            `threads` threads, each thread parsing into a message of its own
+//   seek     `seeks` reads of random records with RecordReader::read: find
+//            the block in the index, decompress it, skip to the record;
+//            latency percentiles
+//
+// The file is in the page cache, so this is decompression and parsing, not
+// the disk.
+//
+// usage: record_file_bench [file] [MB] [threads] [seeks]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "delimited_records.h"
+#include "latency_histogram.h"
+#include "proto/message.pb.h"
+#include "record_file.h"
+
+using Clock = std::chrono::steady_clock;
+using record_file::Codec;
+using record_file::RecordReader;
+using record_file::RecordWriter;
+using simple_demo::PersonDetail;
+
+namespace {
+constexpr int kPhones = 3;
+
+double since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void fill(PersonDetail& pd, int i) {
+  pd.Clear();
+  pd.set_name("person " + std::to_string(i));
+  pd.set_id(i);
+  pd.set_email("person" + std::to_string(i) + "@example.com");
+  for (int p = 0; p < kPhones; ++p) {
+    auto* number = pd.add_phones();
+    number->set_number("3345678" + std::to_string(p));
+    number->set_type(static_cast<PersonDetail::PhoneType>(p % 3));
+  }
+  pd.mutable_last_updated()->set_seconds(1700000000 + i);
+}
+
+void write(const std::string& path, Codec codec, std::uint64_t target) {
+  PersonDetail pd;
+  const auto start = Clock::now();
+  RecordWriter writer(path, codec);
+  for (int i = 0; writer.rawBytes() < target; ++i) {
+    fill(pd, i);
+    writer.write(pd);
+  }
+  writer.close();
+  const double seconds = since(start);
+  std::printf("  write          %12.0f records/s %8.1f MB/s   size %.2f\n",
+              static_cast<double>(writer.records()) / seconds,
+              static_cast<double>(writer.rawBytes()) / seconds / 1e6,
+              static_cast<double>(writer.fileBytes()) /
+                  static_cast<double>(writer.rawBytes()));
+}
+
+// Returns false if not every record came back.
+bool read(const RecordReader& reader, int threads) {
+  struct alignas(64) Count {
+    std::uint64_t records = 0;
+    std::uint64_t ids = 0;
+  };
+  std::vector<Count> counts(threads);
+  std::vector<PersonDetail> people(threads);
+  const auto start = Clock::now();
+  reader.forEachBlock(threads, [&](int thread, std::size_t,
+                                   std::string_view records) {
+    auto& pd = people[thread];
+    auto& count = counts[thread];
+    delimited_records::forEachRecord(
+        reinterpret_cast<const std::uint8_t*>(records.data()), records.size(),
+        [&](google::protobuf::io::CodedInputStream& in) {
+          if (!pd.ParseFromCodedStream(&in)) return false;
+          ++count.records;
+          count.ids += static_cast<std::uint64_t>(pd.id());
+          return true;
+        });
+  });
+  const double seconds = since(start);
+  Count total;
+  for (const auto& c : counts) {
+    total.records += c.records;
+    total.ids += c.ids;
+  }
+  std::printf("  read  %2d thr   %12.0f records/s\n", threads,
+              static_cast<double>(total.records) / seconds);
+  // ids are 0 .. records - 1
+  const std::uint64_t n = reader.records();
+  return total.records == n && total.ids == n * (n - 1) / 2;
+}
+
+bool seek(const RecordReader& reader, int seeks) {
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<std::uint64_t> pick(0, reader.records() - 1);
+  PersonDetail pd;
+  std::string scratch;
+  LatencyHistogram latency;
+  bool ok = true;
+  for (int i = 0; i < seeks; ++i) {
+    const auto n = pick(rng);
+    const auto start = Clock::now();
+    reader.read(n, pd, scratch);
+    latency.record(Clock::now() - start);
+    ok &= pd.id() == static_cast<std::int32_t>(n);
+  }
+  latency.print("  seek");
+  return ok;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+  const std::string path = argc > 1 ? argv[1] : "/tmp/person_blocks.bin";
+  const std::uint64_t megabytes = argc > 2 ? std::atoll(argv[2]) : 1024;
+  const int threads =
+      argc > 3 ? std::atoi(argv[3])
+               : static_cast<int>(
+                     std::max(2u, std::thread::hardware_concurrency()));
+  const int seeks = argc > 4 ? std::atoi(argv[4]) : 10000;
+  std::printf("%s: %llu MB of records, %d threads, %d seeks\n", path.c_str(),
+              static_cast<unsigned long long>(megabytes), threads, seeks);
+
+  bool ok = true;
+  for (const auto codec : {Codec::kNone, Codec::kLz4, Codec::kZstd}) {
+    if (!record_file::available(codec)) continue;
+    std::printf("\n%s\n", record_file::name(codec));
+    write(path, codec, megabytes << 20);
+    const RecordReader reader(path);
+    ok &= read(reader, 1);
+    ok &= read(reader, threads);
+    ok &= seek(reader, seeks);
+  }
+  std::remove(path.c_str());
+  if (!ok) {
+    std::printf("records did not come back\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,274 @@
+// Cost of PersonDetail in protobuf and in Cap'n Proto.
+//
+// The same person with a small (3) and a large (1000) phones list, in
+// proto/message.proto and in its field for field copy proto/person.capnp:
+//
+//   Encode  build the message from plain C++ data and serialize it into a
+//           reused buffer
+//   Decode  bytes -> a message whose fields can be read
+//   Access  read every field of a decoded message, phones included
+//
+// protobuf is run with heap allocated messages and with an Arena (reset per
+// iteration, first block supplied up front, so it does not allocate in the
+// steady state). Cap'n Proto is run plain and packed: a plain message is
+// its own wire format, so decoding only checks the segment table, while
+// packing trades CPU for size. The "bytes" counter is the encoded size.
+//
+// The Cap'n Proto half is only built when CMake finds Cap'n Proto.
+//
+// usage: serialization_bench [google benchmark flags]
+
+#include <benchmark/benchmark.h>
+#include <google/protobuf/arena.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "proto/message.pb.h"
+
+#ifdef HAVE_CAPNP
+#include <capnp/message.h>
+#include <capnp/serialize-packed.h>
+#include <capnp/serialize.h>
+#include <kj/io.h>
+
+#include "proto/person.capnp.h"
+#endif
+
+namespace {
+struct Phone {
+  std::string number;
+  int type;
+};
+
+struct Person {
+  std::string name;
+  int32_t id;
+  std::string email;
+  std::vector<Phone> phones;
+  int64_t seconds;
+  int32_t nanos;
+};
+
+Person makePerson(int64_t phones) {
+  Person person{"Ada Lovelace", 1815, "ada@analytical.engine", {}, 1700000000,
+                123456789};
+  for (int64_t i = 0; i < phones; ++i) {
+    person.phones.push_back(Phone{"+44 20 7946 " + std::to_string(1000 + i),
+                                  static_cast<int>(i % 3)});
+  }
+  return person;
+}
+
+// A first arena block big enough for the large person.
+constexpr std::size_t kArenaBlock = 256 * 1024;
+
+google::protobuf::ArenaOptions arenaOptions(std::vector<char>& block) {
+  google::protobuf::ArenaOptions options;
+  options.initial_block = block.data();
+  options.initial_block_size = block.size();
+  return options;
+}
+
+//----------------------------------------------------------------- protobuf
+
+void fill(simple_demo::PersonDetail& pd, const Person& person) {
+  pd.set_name(person.name);
+  pd.set_id(person.id);
+  pd.set_email(person.email);
+  pd.mutable_phones()->Reserve(static_cast<int>(person.phones.size()));
+  for (const auto& phone : person.phones) {
+    auto* number = pd.add_phones();
+    number->set_number(phone.number);
+    number->set_type(
+        static_cast<simple_demo::PersonDetail::PhoneType>(phone.type));
+  }
+  auto* updated = pd.mutable_last_updated();
+  updated->set_seconds(person.seconds);
+  updated->set_nanos(person.nanos);
+}
+
+int64_t access(const simple_demo::PersonDetail& pd) {
+  int64_t sum = static_cast<int64_t>(pd.name().size() + pd.email().size()) +
+                pd.id() + pd.last_updated().seconds() +
+                pd.last_updated().nanos();
+  for (const auto& phone : pd.phones()) {
+    sum += static_cast<int64_t>(phone.number().size()) + phone.type();
+  }
+  return sum;
+}
+
+std::string protobufBytes(const Person& person) {
+  simple_demo::PersonDetail pd;
+  fill(pd, person);
+  return pd.SerializeAsString();
+}
+
+void BM_ProtobufEncode(benchmark::State& state) {
+  const auto person = makePerson(state.range(0));
+  std::string out;
+  for (auto _ : state) {
+    simple_demo::PersonDetail pd;
+    fill(pd, person);
+    pd.SerializeToString(&out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.counters["bytes"] = static_cast<double>(out.size());
+}
+
+void BM_ProtobufArenaEncode(benchmark::State& state) {
+  const auto person = makePerson(state.range(0));
+  std::vector<char> block(kArenaBlock);
+  google::protobuf::Arena arena(arenaOptions(block));
+  std::string out;
+  for (auto _ : state) {
+    auto* pd =
+        google::protobuf::Arena::CreateMessage<simple_demo::PersonDetail>(
+            &arena);
+    fill(*pd, person);
+    pd->SerializeToString(&out);
+    benchmark::DoNotOptimize(out.data());
+    arena.Reset();
+  }
+  state.counters["bytes"] = static_cast<double>(out.size());
+}
+
+void BM_ProtobufDecode(benchmark::State& state) {
+  const auto bytes = protobufBytes(makePerson(state.range(0)));
+  for (auto _ : state) {
+    simple_demo::PersonDetail pd;
+    pd.ParseFromString(bytes);
+    benchmark::DoNotOptimize(pd.phones_size());
+  }
+  state.counters["bytes"] = static_cast<double>(bytes.size());
+}
+
+void BM_ProtobufArenaDecode(benchmark::State& state) {
+  const auto bytes = protobufBytes(makePerson(state.range(0)));
+  std::vector<char> block(kArenaBlock);
+  google::protobuf::Arena arena(arenaOptions(block));
+  for (auto _ : state) {
+    auto* pd =
+        google::protobuf::Arena::CreateMessage<simple_demo::PersonDetail>(
+            &arena);
+    pd->ParseFromString(bytes);
+    benchmark::DoNotOptimize(pd->phones_size());
+    arena.Reset();
+  }
+  state.counters["bytes"] = static_cast<double>(bytes.size());
+}
+
+void BM_ProtobufAccess(benchmark::State& state) {
+  simple_demo::PersonDetail pd;
+  pd.ParseFromString(protobufBytes(makePerson(state.range(0))));
+  for (auto _ : state) benchmark::DoNotOptimize(access(pd));
+}
+
+BENCHMARK(BM_ProtobufEncode)->Arg(3)->Arg(1000);
+BENCHMARK(BM_ProtobufArenaEncode)->Arg(3)->Arg(1000);
+BENCHMARK(BM_ProtobufDecode)->Arg(3)->Arg(1000);
+BENCHMARK(BM_ProtobufArenaDecode)->Arg(3)->Arg(1000);
+BENCHMARK(BM_ProtobufAccess)->Arg(3)->Arg(1000);
+
+//--------------------------------------------------------------- Cap'n Proto
+
+#ifdef HAVE_CAPNP
+using CapnpPerson = simple_demo_capnp::PersonDetail;
+
+void fill(CapnpPerson::Builder builder, const Person& person) {
+  builder.setName(person.name);
+  builder.setId(person.id);
+  builder.setEmail(person.email);
+  auto phones =
+      builder.initPhones(static_cast<unsigned>(person.phones.size()));
+  for (unsigned i = 0; i < person.phones.size(); ++i) {
+    phones[i].setNumber(person.phones[i].number);
+    phones[i].setType(
+        static_cast<CapnpPerson::PhoneType>(person.phones[i].type));
+  }
+  auto updated = builder.initLastUpdated();
+  updated.setSeconds(person.seconds);
+  updated.setNanos(person.nanos);
+}
+
+int64_t access(CapnpPerson::Reader reader) {
+  auto updated = reader.getLastUpdated();
+  int64_t sum = static_cast<int64_t>(reader.getName().size() +
+                                     reader.getEmail().size()) +
+                reader.getId() + updated.getSeconds() + updated.getNanos();
+  for (auto phone : reader.getPhones()) {
+    sum += static_cast<int64_t>(phone.getNumber().size()) +
+           static_cast<int64_t>(phone.getType());
+  }
+  return sum;
+}
+
+// The person as a plain message and as a packed one.
+kj::Array<capnp::word> capnpWords(const Person& person) {
+  capnp::MallocMessageBuilder message;
+  fill(message.initRoot<CapnpPerson>(), person);
+  return capnp::messageToFlatArray(message);
+}
+
+kj::Array<kj::byte> capnpPacked(const Person& person) {
+  capnp::MallocMessageBuilder message;
+  fill(message.initRoot<CapnpPerson>(), person);
+  kj::VectorOutputStream out;
+  capnp::writePackedMessage(out, message);
+  return kj::heapArray(out.getArray());
+}
+
+template <bool kPacked>
+void BM_CapnpEncode(benchmark::State& state) {
+  const auto person = makePerson(state.range(0));
+  kj::VectorOutputStream out;
+  for (auto _ : state) {
+    capnp::MallocMessageBuilder message;
+    fill(message.initRoot<CapnpPerson>(), person);
+    out.clear();
+    if (kPacked) {
+      capnp::writePackedMessage(out, message);
+    } else {
+      capnp::writeMessage(out, message);
+    }
+    benchmark::DoNotOptimize(out.getArray().begin());
+  }
+  state.counters["bytes"] = static_cast<double>(out.getArray().size());
+}
+
+void BM_CapnpDecode(benchmark::State& state) {
+  const auto words = capnpWords(makePerson(state.range(0)));
+  for (auto _ : state) {
+    capnp::FlatArrayMessageReader reader(words);
+    benchmark::DoNotOptimize(reader.getRoot<CapnpPerson>().getId());
+  }
+  state.counters["bytes"] = static_cast<double>(words.asBytes().size());
+}
+
+void BM_CapnpPackedDecode(benchmark::State& state) {
+  const auto bytes = capnpPacked(makePerson(state.range(0)));
+  for (auto _ : state) {
+    kj::ArrayInputStream in(bytes);
+    capnp::PackedMessageReader reader(in);
+    benchmark::DoNotOptimize(reader.getRoot<CapnpPerson>().getId());
+  }
+  state.counters["bytes"] = static_cast<double>(bytes.size());
+}
+
+void BM_CapnpAccess(benchmark::State& state) {
+  const auto words = capnpWords(makePerson(state.range(0)));
+  capnp::FlatArrayMessageReader reader(words);
+  const auto root = reader.getRoot<CapnpPerson>();
+  for (auto _ : state) benchmark::DoNotOptimize(access(root));
+}
+
+BENCHMARK_TEMPLATE(BM_CapnpEncode, false)->Arg(3)->Arg(1000);
+BENCHMARK_TEMPLATE(BM_CapnpEncode, true)->Arg(3)->Arg(1000);
+BENCHMARK(BM_CapnpDecode)->Arg(3)->Arg(1000);
+BENCHMARK(BM_CapnpPackedDecode)->Arg(3)->Arg(1000);
+BENCHMARK(BM_CapnpAccess)->Arg(3)->Arg(1000);
+#endif
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -2,15 +2,20 @@
 
 #include <tbb/tbb.h>
 
+#include <atomic>
 #include <chrono>
 #include <cmath>
 #include <iostream>
 #include <random>
 
 int main() {
+  // One engine per thread: sharing one between the parallel_for threads is a
+  // data race, and its state would bounce between the cores.
   std::random_device seed;
-  std::default_random_engine engine(seed());
-  std::uniform_real_distribution<double> uniform_dist(0.0, 10.0);
+  const auto base_seed = seed();
+  std::atomic<unsigned> next_seed{0};
+  tbb::enumerable_thread_specific<std::default_random_engine> engines(
+      [&] { return std::default_random_engine(base_seed + next_seed++); });
 
   constexpr int num_elements = 1000000;
   std::vector<double> x_optimal(num_elements);
@@ -19,7 +24,8 @@ int main() {
     constexpr double epsilon = 1e-15;
     constexpr double rate = 0.99;
 
-    double x = uniform_dist(engine);
+    std::uniform_real_distribution<double> uniform_dist(0.0, 10.0);
+    double x = uniform_dist(engines.local());
     double a = 0.5;
     while (true) {
       const double delta = a * std::cos(x);
@@ -0,0 +1,287 @@
+// read -> parse -> compute -> reduce, three ways.
+//
+// The input is `lines` lines of text, "<id> <x>\n" with x in [0, 10), made up
+// front by a parallel_for with an engine per thread. It is worked through in
+// chunks of `chunk` lines:
+//
+//   read     cut the next chunk off the input
+//   parse    std::from_chars the x of every line
+//   compute  main.cpp's gradient descent from every x
+//   reduce   add the results up
+//
+// run by
+//
+//   serial      one thread, one chunk after the other
+//   flow graph  tbb::flow::graph: an input_node reads, a limiter_node lets at
+//               most `tokens` chunks past it, parse and compute are unlimited
+//               function_nodes and a serial reduce node hands the token back
+//   EventLoop   concurrency/event_loop/event_loop.h: one EventLoop per
+//               thread parses and computes the chunks it is given
+//               round robin, one more reduces; the reader enqueues as fast as
+//               it reads, as the queues are unbounded
+//
+// Reported: time, lines/s, the result (equal up to the order of the
+// additions) and the most chunks read but not reduced yet at any time (for
+// the flow graph: let past the limiter but not reduced yet).
+//
+// `threads` (default: the hardware threads) caps TBB through global_control
+// and is the number of EventLoop workers.
+//
+// usage: pipeline_bench [lines] [chunk] [tokens] [threads]
+
+#include <tbb/tbb.h>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "event_loop.h"
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+// One chunk on its way through the stages.
+struct Work {
+  std::string_view text;
+  std::vector<double> values;
+};
+using WorkPtr = std::shared_ptr<Work>;
+
+// Chunks read and not reduced yet, and the most there ever were.
+class InFlight {
+ public:
+  void add() {
+    const int now = ++count_;
+    int peak = peak_.load(std::memory_order_relaxed);
+    while (now > peak && !peak_.compare_exchange_weak(peak, now)) {
+    }
+  }
+  void done() { --count_; }
+  int peak() const { return peak_; }
+
+ private:
+  std::atomic<int> count_{0};
+  std::atomic<int> peak_{0};
+};
+
+std::string makeInput(int lines) {
+  constexpr int kLineSize = 32;
+  std::random_device seed;
+  const auto base_seed = seed();
+  std::atomic<unsigned> next_seed{0};
+  tbb::enumerable_thread_specific<std::default_random_engine> engines(
+      [&] { return std::default_random_engine(base_seed + next_seed++); });
+
+  // fixed-width lines, so every one can be written in place
+  std::string input(static_cast<std::size_t>(lines) * kLineSize, ' ');
+  tbb::parallel_for(tbb::blocked_range<int>(0, lines),
+                    [&](const tbb::blocked_range<int>& range) {
+                      auto& engine = engines.local();
+                      std::uniform_real_distribution<double> dist(0.0, 10.0);
+                      for (int i = range.begin(); i != range.end(); ++i) {
+                        char* line = &input[static_cast<std::size_t>(i) *
+                                            kLineSize];
+                        std::snprintf(line, kLineSize, "%d %.17g", i,
+                                      dist(engine));
+                        // snprintf's terminator becomes padding
+                        std::replace(line, line + kLineSize - 1, '\0', ' ');
+                        line[kLineSize - 1] = '\n';
+                      }
+                    });
+  return input;
+}
+
+// The next `lines` lines of `input` from `offset` on.
+std::string_view read(std::string_view input, std::size_t& offset,
+                      int lines) {
+  const std::size_t start = offset;
+  for (int i = 0; i < lines && offset < input.size(); ++i) {
+    offset = input.find('\n', offset);
+    offset = offset == std::string_view::npos ? input.size() : offset + 1;
+  }
+  return input.substr(start, offset - start);
+}
+
+void parse(Work& work) {
+  const char* p = work.text.data();
+  const char* end = p + work.text.size();
+  while (p < end) {
+    const char* line_end = std::find(p, end, '\n');
+    const char* x = std::find(p, line_end, ' ');  // after the id
+    while (x < line_end && *x == ' ') ++x;
+    double value = 0;
+    std::from_chars(x, line_end, value);
+    work.values.push_back(value);
+    p = line_end + 1;
+  }
+}
+
+// main.cpp's perform_gradient_descent
+double descend(double x) {
+  constexpr double epsilon = 1e-15;
+  constexpr double rate = 0.99;
+  double a = 0.5;
+  while (true) {
+    const double delta = a * std::cos(x);
+    x -= delta;
+    a *= rate;
+    if (delta < epsilon) break;
+  }
+  return x;
+}
+
+void compute(Work& work) {
+  for (auto& x : work.values) x = descend(x);
+}
+
+double sum(const Work& work) {
+  double total = 0;
+  for (double x : work.values) total += x;
+  return total;
+}
+
+struct Result {
+  double seconds;
+  double value;
+  int peak;
+};
+
+Result runSerial(std::string_view input, int chunk) {
+  const auto start = Clock::now();
+  double total = 0;
+  std::size_t offset = 0;
+  while (offset < input.size()) {
+    Work work{read(input, offset, chunk), {}};
+    parse(work);
+    compute(work);
+    total += sum(work);
+  }
+  return {std::chrono::duration<double>(Clock::now() - start).count(), total,
+          1};
+}
+
+Result runFlowGraph(std::string_view input, int chunk, int tokens) {
+  using namespace tbb::flow;
+  const auto start = Clock::now();
+  InFlight in_flight;
+  double total = 0;
+  std::size_t offset = 0;
+
+  graph g;
+  input_node<WorkPtr> reader(g, [&](tbb::flow_control& control) -> WorkPtr {
+    if (offset == input.size()) {
+      control.stop();
+      return nullptr;
+    }
+    return std::make_shared<Work>(Work{read(input, offset, chunk), {}});
+  });
+  limiter_node<WorkPtr> limiter(g, static_cast<std::size_t>(tokens));
+  // counted past the limiter: the input_node reads one chunk ahead of a
+  // closed limiter and holds it, which would make the peak tokens + 1
+  function_node<WorkPtr, WorkPtr> parser(g, unlimited, [&](WorkPtr work) {
+    in_flight.add();
+    parse(*work);
+    return work;
+  });
+  function_node<WorkPtr, WorkPtr> computer(g, unlimited, [](WorkPtr work) {
+    compute(*work);
+    return work;
+  });
+  function_node<WorkPtr, continue_msg> reducer(g, serial,
+                                               [&](const WorkPtr& work) {
+                                                 total += sum(*work);
+                                                 in_flight.done();
+                                                 return continue_msg();
+                                               });
+  make_edge(reader, limiter);
+  make_edge(limiter, parser);
+  make_edge(parser, computer);
+  make_edge(computer, reducer);
+  make_edge(reducer, limiter.decrementer());
+  reader.activate();
+  g.wait_for_all();
+  return {std::chrono::duration<double>(Clock::now() - start).count(), total,
+          in_flight.peak()};
+}
+
+Result runEventLoops(std::string_view input, int chunk, int threads) {
+  const auto start = Clock::now();
+  InFlight in_flight;
+  double total = 0;
+  {
+    EventLoop reducer;
+    std::vector<std::unique_ptr<EventLoop>> workers;
+    for (int i = 0; i < threads; ++i) {
+      workers.push_back(std::make_unique<EventLoop>());
+    }
+    std::size_t offset = 0;
+    for (std::size_t i = 0; offset < input.size(); ++i) {
+      in_flight.add();
+      auto work = std::make_shared<Work>(Work{read(input, offset, chunk), {}});
+      workers[i % workers.size()]->enqueue([work, &reducer, &total,
+                                            &in_flight] {
+        parse(*work);
+        compute(*work);
+        reducer.enqueue([work, &total, &in_flight] {
+          total += sum(*work);
+          in_flight.done();
+        });
+      });
+    }
+    // every worker has queued its last reduction once it ran this
+    for (auto& worker : workers) worker->enqueueSync([] {});
+    reducer.enqueueSync([] {});
+  }
+  return {std::chrono::duration<double>(Clock::now() - start).count(), total,
+          in_flight.peak()};
+}
+
+void report(const char* name, const Result& result, int lines) {
+  std::printf("%-12s %9.3f %12.0f %22.12f %8d\n", name, result.seconds,
+              lines / result.seconds, result.value, result.peak);
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int lines = argc > 1 ? std::atoi(argv[1]) : 1000000;
+  const int chunk = argc > 2 ? std::atoi(argv[2]) : 1000;
+  const int threads =
+      argc > 4 ? std::atoi(argv[4])
+               : static_cast<int>(
+                     std::max(1u, std::thread::hardware_concurrency()));
+  const int tokens = argc > 3 ? std::atoi(argv[3]) : 2 * threads;
+  tbb::global_control parallelism(
+      tbb::global_control::max_allowed_parallelism, threads);
+
+  const std::string input = makeInput(lines);
+  std::printf("%d lines in chunks of %d, %d threads, %d tokens\n\n", lines,
+              chunk, threads, tokens);
+  std::printf("%-12s %9s %12s %22s %8s\n", "", "time(s)", "lines/s", "result",
+              "peak");
+
+  const auto serial = runSerial(input, chunk);
+  report("serial", serial, lines);
+  const auto graph = runFlowGraph(input, chunk, tokens);
+  report("flow graph", graph, lines);
+  const auto loops = runEventLoops(input, chunk, threads);
+  report("EventLoop", loops, lines);
+
+  const auto same = [&](double value) {
+    return std::abs(value - serial.value) <= 1e-9 * std::abs(serial.value);
+  };
+  if (!same(graph.value) || !same(loops.value)) {
+    std::printf("results differ\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,12 @@
+# LatencyHistogram (latency_histogram.h), shared by the benchmarks of the
+# projects under open-source-lib. Header only:
+#
+#   include(<open-source-lib>/util/latency_histogram.cmake)
+#   target_link_libraries(my_bench PRIVATE latency_histogram)
+#
+# Safe to include more than once.
+if(NOT TARGET latency_histogram)
+  add_library(latency_histogram INTERFACE)
+  target_include_directories(latency_histogram
+                             INTERFACE ${CMAKE_CURRENT_LIST_DIR})
+endif()
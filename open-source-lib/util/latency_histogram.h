@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+/*
+Fixed-size log-linear latency histogram (HdrHistogram in miniature).
+
+Values are recorded in microseconds. Below 16us every value has its own
+bucket; above that, each power of two is split into 16 linear sub-buckets,
+so any reported percentile is within ~6% of the true value. Recording is
+a couple of shifts and an increment, and there is no allocation, so one
+histogram per thread can be kept on the hot path and merged at the end.
+*/
+
+class LatencyHistogram {
+ public:
+  void record(std::chrono::nanoseconds latency) {
+    auto us = latency.count() < 0 ? 0 : latency.count() / 1000;
+    ++buckets_[indexOf(static_cast<std::uint64_t>(us))];
+    ++count_;
+    if (static_cast<std::uint64_t>(us) > max_us_) max_us_ = us;
+  }
+
+  void merge(const LatencyHistogram& other) {
+    for (std::size_t i = 0; i < kBuckets; ++i) {
+      buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+    if (other.max_us_ > max_us_) max_us_ = other.max_us_;
+  }
+
+  std::uint64_t count() const { return count_; }
+
+  // Lower bound of the bucket holding the p-th percentile, p in [0, 1].
+  std::chrono::microseconds percentile(double p) const {
+    if (count_ == 0) return std::chrono::microseconds(0);
+    auto rank = static_cast<std::uint64_t>(p * (count_ - 1)) + 1;
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < kBuckets; ++i) {
+      seen += buckets_[i];
+      if (seen >= rank) {
+        return std::chrono::microseconds(valueOf(i));
+      }
+    }
+    return std::chrono::microseconds(max_us_);
+  }
+
+  std::chrono::microseconds max() const {
+    return std::chrono::microseconds(max_us_);
+  }
+
+  void print(const char* title) const {
+    std::printf(
+        "%s: n=%llu p50=%lldus p90=%lldus p99=%lldus p99.9=%lldus "
+        "max=%lldus\n",
+        title, static_cast<unsigned long long>(count_),
+        static_cast<long long>(percentile(0.5).count()),
+        static_cast<long long>(percentile(0.9).count()),
+        static_cast<long long>(percentile(0.99).count()),
+        static_cast<long long>(percentile(0.999).count()),
+        static_cast<long long>(max_us_));
+  }
+
+ private:
+  static constexpr std::size_t kSubBits = 4;
+  static constexpr std::size_t kSub = 1 << kSubBits;
+  static constexpr std::size_t kBuckets = 64 * kSub;
+
+  static std::size_t indexOf(std::uint64_t us) {
+    if (us < kSub) return us;
+    const std::size_t msb = 63 - __builtin_clzll(us);
+    const std::size_t shift = msb - kSubBits;
+    return (msb - kSubBits + 1) * kSub + ((us >> shift) & (kSub - 1));
+  }
+
+  static std::uint64_t valueOf(std::size_t index) {
+    if (index < kSub) return index;
+    const std::size_t msb = index / kSub + kSubBits - 1;
+    return (kSub + index % kSub) << (msb - kSubBits);
+  }
+
+  std::array<std::uint64_t, kBuckets> buckets_{};
+  std::uint64_t count_ = 0;
+  std::uint64_t max_us_ = 0;
+};